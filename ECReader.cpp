@@ -1,7 +1,16 @@
 #include <windows.h>
+#include <mmsystem.h>
+#include <avrt.h>
+#include <pdh.h>
+#include <pdhmsg.h>
+#include <evntprov.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <conio.h>
+#include <stdarg.h>
 #include <vector>
 
 #define ECREADER_VERSION "2025.11.30"
@@ -12,624 +21,7615 @@
 #define IOCTL_PAWNIO_EXECUTE CTL_CODE(PAWNIO_DEVICE_TYPE, 0x841, METHOD_BUFFERED, FILE_ANY_ACCESS)
 #define FN_NAME_LENGTH 32
 
+// LpcACPIEC module: linked in as an RCDATA resource (resource.rc), --module overrides
+#define MODULE_RESOURCE_NAME "LPCACPIEC"
+#define MODULE_FILE_NAME     "LpcACPIEC.bin"
+
 static bool g_verbose = false;
 
 // EC ports and flags
 #define EC_DATA_PORT    0x62
 #define EC_CMD_PORT     0x66
+#define EC_SECONDARY_DATA_PORT  0x68    // Second ACPI EC interface many laptops expose (--channel)
+#define EC_SECONDARY_CMD_PORT   0x6C
+#define EC_CHANNELS_MAX         4       // --channel options per session
+#define EC_CHANNEL_PORT_MIN     0x62    // Custom --channel pairs: <data>,<data + 4> inside this block
+#define EC_CHANNEL_PORT_MAX     0x6F
+#define EC_KBC_CMD_PORT         0x64    // 8042 keyboard controller, never a channel port
 #define EC_IBF  0x02
 #define EC_OBF  0x01
+#define EC_BURST 0x10   // Status: EC is in burst mode
+
+// ACPI EC burst mode (ACPI 12.3): the EC stays dedicated to the host between enable and disable
+#define EC_CMD_BURST_ENABLE   0x82
+#define EC_CMD_BURST_DISABLE  0x83
+#define EC_BURST_ACK          0x90
+#define EC_BURST_MAX_REGISTERS 32   // Registers per burst session, bounds how long other EC work waits
 
 // Safety constants
 #define MUTEX_TIMEOUT_MS      1000
 #define MUTEX_RETRY_COUNT     3
 #define MUTEX_RETRY_DELAY_MS  100
-#define MIN_INTERVAL_MS       2000  // Minimum 2 seconds
+#define MIN_INTERVAL_MS       2000  // Full-scan period the default bus budget is sized for
 
-// Performance optimization constants
-#define EC_WAIT_TIMEOUT_MS        20    // Reduced from 100ms
-#define EC_BUSY_WAIT_ITERATIONS   100   // ~1-2ms tight polling
-#define EC_MAX_RETRIES            3     // Retry attempts
+// Real-time acquisition profile (--realtime)
+#define RT_TIMER_RESOLUTION_MS    1     // timeBeginPeriod while the profile is active
+#define RT_SPIN_LEAD_US           500   // Timer wakes this early; the rest of the gap is spun
+#define RT_MMCSS_TASK             "Pro Audio"
 
-// No longer needed - we use direct DeviceIoControl
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002   // Windows 10 1803+
+#endif
 
-class ECReader {
-private:
-    HANDLE hDriver;
-    HANDLE hMutex;
-    bool verboseMode;
+// EC transaction budget: by default the same bus time as one full scan per MIN_INTERVAL_MS.
+// Enforced at run time by BusGovernor; the CLI derives minimum intervals from it.
+#define EC_READ_BUDGET_PER_SEC    (256 * 1000 / MIN_INTERVAL_MS)
+#define EC_READ_BUDGET_MAX        4096  // --budget ceiling (reads/s)
+#define EC_READ_BUDGET_BURST      256   // Bucket depth: one full scan may go out at once
+#define WATCH_MIN_INTERVAL_MS     100   // Floor for watchlist refresh
 
-public:
-    bool suppressVerbose;
+// Console frame sizes (see ConsoleFrame)
+#define FRAME_MAX_COLS            120
+#define MONITOR_FRAME_ROWS        24
+#define MONITOR_PANEL_ROWS        3     // Detail panel below the grid (blank line + 2 lines)
+#define DUMP_FRAME_ROWS           22    // Includes a trailing blank line
+#define WATCH_HEADER_ROWS         6
+#define RENDER_POLL_MS            100   // Renderer wakes at least this often (keys, Ctrl+C)
+#define CHANNELS_HEADER_ROWS      4     // Multi-channel monitor: title, keys, legend, rule
+#define CHANNEL_BLOCK_ROWS        19    // ... then per channel: status line, grid header, 16 rows, blank
 
-private:
-    int mutexWaitFailures;
-    int mutexRetries;
-    int successfulReads;
-    int failedReads;
-    int retryCount;  // Track retry attempts
+// Adaptive monitor scheduler (see ScanScheduler)
+#define SCHED_MAX_INTERVAL        32    // Static registers are re-verified at least this often (cycles)
+#define SCHED_DEFAULT_FULL_EVERY  16    // Full sweep period with --adaptive (cycles)
 
-    bool AcquireMutex() {
-        if (hMutex == NULL) {
-            if (verboseMode) printf("Warning: No mutex available\n");
-            return true;
-        }
+// Monitor rolling statistics (see RegisterWindow)
+#define STATS_WINDOW              64    // Samples kept per register
 
-        for (int retry = 0; retry < MUTEX_RETRY_COUNT; retry++) {
-            DWORD waitResult = WaitForSingleObject(hMutex, MUTEX_TIMEOUT_MS);
-            
-            if (waitResult == WAIT_OBJECT_0) {
-                if (verboseMode && retry > 0) printf("Mutex acquired after %d retries\n", retry);
-                if (retry > 0) mutexRetries++;
-                return true;
-            }
-            else if (waitResult == WAIT_ABANDONED) {
-                if (verboseMode) printf("Warning: Mutex was abandoned\n");
-                return true;
-            }
-            else if (waitResult == WAIT_TIMEOUT) {
-                if (verboseMode) printf("Mutex timeout (attempt %d/%d)\n", retry + 1, MUTEX_RETRY_COUNT);
-                if (retry < MUTEX_RETRY_COUNT - 1) Sleep(MUTEX_RETRY_DELAY_MS);
-            }
-            else {
-                if (verboseMode) printf("Mutex wait failed: %lu\n", GetLastError());
-                break;
-            }
-        }
-        
-        mutexWaitFailures++;
-        return false;
-    }
+// Correlate mode (see CorrelationTracker)
+#define CORRELATE_DEFAULT_WINDOW  60    // Paired samples per register and lag
+#define CORRELATE_MAX_WINDOW      1024
+#define CORRELATE_MAX_LAG         64    // Scans a register may trail the host signal
+#define CORRELATE_DEFAULT_TOP     10
+#define CORRELATE_MAX_TOP         40
+#define CORRELATE_MIN_PAIRS       8     // Coefficients over fewer pairs are not ranked
+#define CORRELATE_HEADER_ROWS     5
 
-    void ReleaseMutexSafe() {
-        if (hMutex != NULL) ReleaseMutex(hMutex);
-    }
+// Benchmark defaults
+#define BENCH_DEFAULT_SCANS       5
+#define BENCH_DEFAULT_SAMPLES     200
+#define BENCH_RAW_CHUNK           50    // Raw IOCTLs per mutex hold
 
-public:
-    ECReader() : hDriver(INVALID_HANDLE_VALUE), hMutex(NULL), verboseMode(false),
-                 suppressVerbose(false), mutexWaitFailures(0), mutexRetries(0),
-                 successfulReads(0), failedReads(0), retryCount(0) {}
+// Typed field reads (see ECField, FieldProfile)
+#define FIELD_NAME_MAX            32
+#define FIELD_UNIT_MAX            8
+#define FIELD_PROFILE_MAX_BYTES   (64 * 1024)
+#define FIELD_TEAR_RETRIES        3     // --verify: re-reads when the high byte moved under the low byte
 
-    void SetVerbose(bool verbose) {
-        verboseMode = verbose;
-        g_verbose = verbose;
-    }
+// Port-level trace ring (--trace, T in monitor, -v). Build with -DECREADER_TRACE=0 to compile
+// the recording out.
+#ifndef ECREADER_TRACE
+#define ECREADER_TRACE            1
+#endif
+#define TRACE_ENTRIES             4096  // Power of two, 32 bytes each
+#define TRACE_FILE                "ECReader-trace.txt"
+#define TRACE_ERROR_FILE          "ECReader-trace-errors.txt"   // --trace error while a full-screen frame is up
 
-    bool Open() {
-        // Open PawnIO driver directly
-        hDriver = CreateFileA("\\\\.\\PawnIO",
-                              GENERIC_READ | GENERIC_WRITE,
-                              0,
-                              NULL,
-                              OPEN_EXISTING,
-                              FILE_ATTRIBUTE_NORMAL,
-                              NULL);
+// Serve mode: a resident process answers register reads from other ECReader processes
+#define SERVE_PIPE_NAME           "\\\\.\\pipe\\ECReader"
+#define SERVE_PROTOCOL_VERSION    1
+#define SERVE_MAX_CLIENTS         16    // Pipe instances (concurrent connections)
+#define SERVE_COALESCE_MS         2     // Requests arriving within this window share one EC transaction
+#define SERVE_CONNECT_TIMEOUT_MS  2000  // Client wait for a free pipe instance
+#define SERVE_STATUS_OK           0
+#define SERVE_STATUS_BAD_REQUEST  1
 
-        if (hDriver == INVALID_HANDLE_VALUE) {
-            printf("Error: Failed to open PawnIO driver. (Error: %lu)\n", GetLastError());
-            printf("Possible causes:\n");
-            printf("1. PawnIO driver not installed. Get from https://pawnio.eu \n");
-            printf("2. Not running as Administrator\n");
-            printf("3. Driver service not started. Run 'sc query pawnio' to validate.\n");
-            return false;
-        }
+// Shared snapshot: the latest scan, published for other processes through a named mapping
+#define SHM_NAME_GLOBAL           "Global\\ECReaderSnapshot"
+#define SHM_NAME_LOCAL            "Local\\ECReaderSnapshot"
+#define SHM_MAGIC                 0x53524345    // "ECRS"
+#define SHM_VERSION               2
+#define SHM_READ_RETRIES          10000         // Seqlock read attempts before giving up
+#define SHM_INIT_SPINS            100000        // Wait for a new publisher to finish the header
+#define SHM_TAKEOVER_RETRY_MS     1000          // How often a non-publishing instance checks for a gone publisher
 
-        if (verboseMode) printf("[Verbose] PawnIO driver opened successfully\n");
+// Shared EC bus budget (BusGovernor): one token bucket for every ECReader process on the box
+#define BUDGET_NAME_GLOBAL        "Global\\ECReaderBusBudget"
+#define BUDGET_NAME_LOCAL         "Local\\ECReaderBusBudget"
+#define BUDGET_MAGIC              0x42524345    // "ECRB"
+#define BUDGET_VERSION            2
+#define BUDGET_INIT_SPINS         100000        // Wait for a concurrent creator to publish the layout
+#define BUDGET_SLOTS              64            // Instances that can hold a --budget ceiling at once
 
-        // Load LpcACPIEC module
-        if (verboseMode) printf("[Verbose] Testing LpcACPIEC.bin module load...\n");
-        if (!LoadModule("LpcACPIEC.bin")) {
-            printf("Error: Failed to load LpcACPIEC.bin module\n");
-            CloseHandle(hDriver);
-            return false;
-        }
+// Capture files (record/analyze): a fixed header followed by a stream of records.
+// Every record starts with a CaptureRecordHeader; a keyframe carries all 256 values,
+// a delta only the registers that changed since the previous record.
+#define CAPTURE_MAGIC             "ECRCAP1"
+#define CAPTURE_VERSION           1
+#define CAPTURE_REC_END           0     // Pre-extended, never-written space reads as zero
+#define CAPTURE_REC_KEYFRAME      1
+#define CAPTURE_REC_DELTA         2
+#define CAPTURE_FLAG_COMPLETE     1     // Header counters are final (writer closed cleanly)
+#define CAPTURE_DEFAULT_KEYFRAME  64    // Records between keyframes
+#define CAPTURE_VIEW_BYTES        (4 * 1024 * 1024)   // Mapped window, bounds writer memory
 
-        if (verboseMode) printf("[Verbose] LpcACPIEC.bin loaded successfully!\n");
+// Buffered stdout (see OutputBuffer)
+#define OUTPUT_BUFFER_BYTES       (64 * 1024)
+#define OUTPUT_MAX_LINE           512
 
-        // Open the EC mutex
-        hMutex = OpenMutexA(SYNCHRONIZE, FALSE, "Access_EC");
-        if (hMutex == NULL) {
-            hMutex = OpenMutexA(SYNCHRONIZE, FALSE, "Global\\Access_EC");
-        }
+// Performance optimization constants
+#define EC_WAIT_TIMEOUT_MS        20    // Reduced from 100ms
+#define EC_BUSY_WAIT_ITERATIONS   100   // Initial spin budget before any polls are learned
+#define EC_MAX_RETRIES            3     // Retry attempts
 
-        if (hMutex == NULL) {
-            if (verboseMode) printf("[Verbose] Warning: Access_EC mutex not found (Error: %lu), continuing without sync\n", GetLastError());
-        } else {
-            if (verboseMode) printf("[Verbose] EC mutex opened\n");
-        }
+// Failing registers and a wedged EC (see ECFaultPolicy)
+#define FAULT_BACKOFF_BASE_MS     250   // First backoff window of a failure class, doubled per failure
+#define FAULT_BACKOFF_MAX_MS      8000
+#define FAULT_SHORT_WAIT_MS       2     // Floor of the IBF/OBF timeout while that class backs off
+#define FAULT_SHORT_WAIT_FACTOR   4     // ... which is this many times the p99 of completed waits
+#define FAULT_BACKOFF_SPREAD      3     // Distinct failing registers before a class backs off
+#define FAULT_SHORT_VERIFY_EVERY  4     // After this many uncounted short-wait failures, one read waits in full
+#define FAULT_QUARANTINE_AFTER    3     // Consecutive failed reads that quarantine a register
+#define FAULT_PROBE_MS            5000  // First re-probe of a quarantined register, doubled per failed probe
+#define FAULT_PROBE_MAX_MS        60000
+#define FAULT_BREAKER_TRIP        16    // Consecutive failed reads (any registers) that open the breaker
+#define FAULT_BREAKER_MUTEX_TRIP  2     // ... or consecutive timed-out Access_EC acquires
+#define FAULT_BREAKER_BASE_MS     1000  // First breaker pause, doubled per failed probe
+#define FAULT_BREAKER_MAX_MS      30000
+#define FAULT_LOG_MAX             32    // Quarantine / breaker events kept for -s
 
-        return true;
-    }
+// ETW provider "ECReader": self-describing (TraceLogging format) events, no manifest to install.
+// Nothing is formatted or written unless a trace session enables the provider.
+#define ETW_KEYWORD_SCAN          0x1   // One event per scan or served batch (verbose level)
+#define ETW_KEYWORD_HEALTH        0x2   // Rates and percentiles every ETW_HEALTH_INTERVAL_MS
+#define ETW_KEYWORD_FAULT         0x4   // Quarantine and breaker transitions
+#define ETW_HEALTH_INTERVAL_MS    1000
+#define ETW_METADATA_MAX          512   // Event name plus field names and types
+#define ETW_FIELDS_MAX            20
 
-    bool LoadModule(const char* filename) {
-        // Get executable directory and construct full path
-        char exePath[MAX_PATH];
-        char fullPath[MAX_PATH];
+// Simulated EC defaults (see SimulatedTransport, --sim-config)
+#define SIM_DEFAULT_IOCTL_US      10
+#define SIM_DEFAULT_IBF_US        40
+#define SIM_DEFAULT_OBF_US        120
+#define SIM_DEFAULT_STALL_RATE    0.001
+#define SIM_DEFAULT_STALL_US      5000
+#define SIM_DEFAULT_BUSY_RATE     0.01
+#define SIM_DEFAULT_BUSY_US       400
+#define SIM_DEFAULT_BURST_US      8     // Mean IBF/OBF latency while in burst mode
+#define SIM_BURST_IDLE_US         1000  // Simulated firmware leaves burst after this much host silence
+#define SIM_DEFAULT_PEER_US       3000  // Lock hold of the simulated peer EC client (peer=<ms>)
+#define SIM_PEER_LOCK_NAME        "Local\\ECReaderSimPeer"
 
-        if (GetModuleFileNameA(NULL, exePath, MAX_PATH) == 0) {
-            if (verboseMode) printf("[Verbose] Warning: Failed to get exe path, trying relative: %s\n", filename);
-            strncpy_s(fullPath, MAX_PATH, filename, _TRUNCATE);
-        } else {
-            // Extract directory by finding last backslash
-            char* lastSlash = strrchr(exePath, '\\');
-            if (lastSlash != NULL) {
-                *lastSlash = '\0';  // Truncate at last backslash
-                snprintf(fullPath, MAX_PATH, "%s\\%s", exePath, filename);
-            } else {
-                strncpy_s(fullPath, MAX_PATH, filename, _TRUNCATE);
-            }
-        }
+// Live signals in the simulated register file
+#define SIM_REG_HEARTBEAT         0x10  // Seconds counter
+#define SIM_REG_CPU_TEMP          0x30
+#define SIM_REG_GPU_TEMP          0x31
+#define SIM_REG_FAN_LO            0x4A  // 16-bit little-endian fan RPM
+#define SIM_REG_FAN_HI            0x4B
+#define SIM_THERMAL_LAG_S         6.0   // CPU temperature trails the simulated host load (--signal sim)
 
-        if (verboseMode) printf("[Verbose] Loading module: %s\n", fullPath);
+// Extended EC RAM through an index/data port pair (--xram). Defaults follow the ENE KB9xxx
+// layout: address high byte, address low byte, data. Other vendors use different ports.
+#define XRAM_ENE_ADDR_HI          0x381
+#define XRAM_ENE_ADDR_LO          0x382
+#define XRAM_ENE_DATA             0x383
+#define XRAM_CUSTOM_PORT_MIN      0x380 // Custom --xram triples must stay inside the EC index block
+#define XRAM_CUSTOM_PORT_MAX      0x38F
+#define XRAM_SPACE_SIZE           0x10000
+#define XRAM_PAGE_SIZE            256   // One page = one 16x16 grid, one scheduler slot
+#define XRAM_PAGES                (XRAM_SPACE_SIZE / XRAM_PAGE_SIZE)
+#define XRAM_FRAME_ROWS           24
+#define XRAM_READ_BUDGET_PER_SEC  4096  // Index/data bytes per second, own per-process bucket
 
-        FILE* f = NULL;
-        if (fopen_s(&f, fullPath, "rb") != 0 || f == NULL) {
-            return false;
-        }
+// Live signals in the simulated extended RAM
+#define SIM_XRAM_BATTERY_MV       0x0A00    // 16-bit little-endian pack voltage
+#define SIM_XRAM_BATTERY_PCT      0x0A02
+#define SIM_XRAM_HEARTBEAT        0x0A10
 
-        fseek(f, 0, SEEK_END);
-        long fileSize = ftell(f);
-        fseek(f, 0, SEEK_SET);
+// Adaptive wait backoff (see ECWaitPolicy)
+#define EC_SPIN_MIN_POLLS         4     // Never spin fewer polls than this
+#define EC_SPIN_MAX_POLLS         2000  // Cap on the learned spin budget
+#define EC_YIELD_FACTOR           4     // Yield phase lasts this many spin budgets
+#define EC_SLEEP_MIN_REMAINING_MS 2     // Only Sleep(1) if this much deadline is left
 
-        if (fileSize <= 0 || fileSize > 1024 * 1024) {
-            fclose(f);
-            return false;
-        }
+// Access_EC hold sizing for batched reads (LockChunkPolicy)
+#define LOCK_CHUNK_MIN            8     // Registers per hold while other owners are active
+#define LOCK_CHUNK_MAX            256   // Whole table per hold on an idle system
+#define LOCK_CONTENDED_WAIT_US    200   // An acquire that waited longer found the lock owned
+#define LOCK_HOLD_TARGET_US       2000  // Hold bound under contention, keeps other owners' waits short
+#define LOCK_GROW_AFTER           4     // Uncontended acquires in a row before the chunk doubles
+#define LOCK_QUIET_MS             500   // ... and no contention for this long (periodic owners)
 
-        if (verboseMode) printf("[Verbose] Module file size: %ld bytes\n", fileSize);
+// High-resolution timing helpers (QueryPerformanceCounter based)
+static LONGLONG QpcFrequency() {
+    static LONGLONG frequency = 0;
+    if (frequency == 0) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        frequency = f.QuadPart;
+    }
+    return frequency;
+}
 
-        BYTE* buffer = (BYTE*)malloc(fileSize);
-        if (!buffer) {
-            fclose(f);
-            return false;
-        }
+static inline LONGLONG QpcNow() {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
 
-        size_t bytesRead = fread(buffer, 1, fileSize, f);
-        fclose(f);
+static inline LONGLONG QpcTicksFromMs(int ms) {
+    return (LONGLONG)ms * QpcFrequency() / 1000;
+}
 
-        if (bytesRead != (size_t)fileSize) {
-            free(buffer);
-            return false;
-        }
+static inline double QpcToMs(LONGLONG ticks) {
+    return (double)ticks * 1000.0 / (double)QpcFrequency();
+}
 
-        // Use DeviceIoControl to load module
-        DWORD bytesReturned = 0;
-        BOOL result = DeviceIoControl(hDriver,
-                                      IOCTL_PAWNIO_LOAD_BINARY,
-                                      buffer,
-                                      fileSize,
-                                      NULL,
-                                      0,
-                                      &bytesReturned,
-                                      NULL);
-        free(buffer);
+static inline ULONG64 QpcToMicros(LONGLONG ticks) {
+    if (ticks <= 0) return 0;
+    return (ULONG64)ticks * 1000000ULL / (ULONG64)QpcFrequency();
+}
 
-        if (!result) {
-            if (verboseMode) printf("[Verbose] DeviceIoControl LOAD_BINARY failed (Error: %lu)\n", GetLastError());
-            return false;
-        }
+// Fixed-bucket log-linear histogram (8 sub-buckets per power of two, ~12% resolution).
+// Record() is a few integer ops and never allocates, so it can sit on the IOCTL path.
+#define HIST_SUB_BITS   3
+#define HIST_SUB_COUNT  (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS    256
 
-        return true;
+class LatencyHistogram {
+private:
+    ULONG64 counts[HIST_BUCKETS];
+    ULONG64 total;
+    ULONG64 sum;
+    ULONG64 maxValue;
+
+    static int BucketFor(ULONG64 value) {
+        if (value < HIST_SUB_COUNT) return (int)value;
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - HIST_SUB_BITS;
+        int index = (shift + 1) * HIST_SUB_COUNT + (int)((value >> shift) & (HIST_SUB_COUNT - 1));
+        return (index < HIST_BUCKETS) ? index : HIST_BUCKETS - 1;
     }
 
-    void Close() {
-        if (hMutex != NULL) {
-            CloseHandle(hMutex);
-            hMutex = NULL;
-        }
-        if (hDriver != INVALID_HANDLE_VALUE) {
-            CloseHandle(hDriver);
-            hDriver = INVALID_HANDLE_VALUE;
-        }
+    // Largest value that maps to bucket index
+    static ULONG64 BucketUpper(int index) {
+        if (index < HIST_SUB_COUNT) return (ULONG64)index;
+        int shift = index / HIST_SUB_COUNT - 1;
+        ULONG64 lower = (ULONG64)(HIST_SUB_COUNT + index % HIST_SUB_COUNT) << shift;
+        return lower + (1ULL << shift) - 1;
     }
 
-    // Execute a module function (like LibreHardwareMonitor does)
-    bool Execute(const char* functionName, LONG64* input, int inputCount, LONG64* output, int outputCount) {
-        // Build input buffer: 32-byte function name + input data
-        int inputBufferSize = FN_NAME_LENGTH + (inputCount * sizeof(LONG64));
-        BYTE* inputBuffer = (BYTE*)malloc(inputBufferSize);
-        if (!inputBuffer) return false;
+public:
+    LatencyHistogram() { Reset(); }
 
-        // Clear and copy function name (max 32 chars)
-        memset(inputBuffer, 0, FN_NAME_LENGTH);
-        strncpy_s((char*)inputBuffer, FN_NAME_LENGTH, functionName, _TRUNCATE);
+    void Reset() {
+        memset(counts, 0, sizeof(counts));
+        total = 0;
+        sum = 0;
+        maxValue = 0;
+    }
 
-        // Copy input data after function name
-        if (inputCount > 0 && input != NULL) {
-            memcpy(inputBuffer + FN_NAME_LENGTH, input, inputCount * sizeof(LONG64));
-        }
+    void Record(ULONG64 value) {
+        counts[BucketFor(value)]++;
+        total++;
+        sum += value;
+        if (value > maxValue) maxValue = value;
+    }
 
-        // Prepare output buffer
-        int outputBufferSize = outputCount * sizeof(LONG64);
-        BYTE* outputBuffer = (BYTE*)malloc(outputBufferSize);
-        if (!outputBuffer) {
-            free(inputBuffer);
-            return false;
-        }
-        memset(outputBuffer, 0, outputBufferSize);
+    void Merge(const LatencyHistogram& other) {
+        for (int i = 0; i < HIST_BUCKETS; i++) counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        if (other.maxValue > maxValue) maxValue = other.maxValue;
+    }
 
-        // Call DeviceIoControl
-        DWORD bytesReturned = 0;
-        BOOL result = DeviceIoControl(hDriver,
-                                      IOCTL_PAWNIO_EXECUTE,
-                                      inputBuffer,
-                                      inputBufferSize,
-                                      outputBuffer,
-                                      outputBufferSize,
-                                      &bytesReturned,
-                                      NULL);
+    ULONG64 Count() const { return total; }
+    ULONG64 Max() const { return maxValue; }
+    double Mean() const { return total ? (double)sum / (double)total : 0.0; }
 
-        // Copy output data
-        if (result && output != NULL && bytesReturned > 0) {
-            DWORD copySize = (bytesReturned < (DWORD)outputBufferSize) ? bytesReturned : (DWORD)outputBufferSize;
-            memcpy(output, outputBuffer, copySize);
+    // Upper bound of the bucket holding the p-th percentile (p in 0..100), capped at Max()
+    ULONG64 Percentile(double p) const {
+        if (total == 0) return 0;
+        ULONG64 rank = (ULONG64)(p / 100.0 * (double)total + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > total) rank = total;
+
+        ULONG64 seen = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                ULONG64 upper = BucketUpper(i);
+                return (upper < maxValue) ? upper : maxValue;
+            }
         }
+        return maxValue;
+    }
+};
 
-        free(inputBuffer);
-        free(outputBuffer);
+// Per-phase latency histograms for the EC access path (times in microseconds)
+struct ECPhaseStats {
+    LatencyHistogram mutexWait;     // AcquireMutex, including retries
+    LatencyHistogram lockHold;      // Batched read: one Access_EC hold
+    LatencyHistogram ibfWait;       // WaitECReady wall time
+    LatencyHistogram ibfPolls;      // WaitECReady status polls
+    LatencyHistogram obfWait;       // WaitECOBF wall time
+    LatencyHistogram obfPolls;      // WaitECOBF status polls
+    LatencyHistogram ioctl;         // One DeviceIoControl round trip
+    LatencyHistogram registerRead;  // End-to-end register read, including retries
+    LatencyHistogram scanJitter;    // Acquisition: |scan start - scheduled slot|
+    LatencyHistogram scanDuration;  // Acquisition: one scan, first to last register
 
-        if (!result && verboseMode) {
-            printf("[Verbose] DeviceIoControl EXECUTE failed (Error: %lu)\n", GetLastError());
-        }
+    void Reset() {
+        mutexWait.Reset();
+        lockHold.Reset();
+        ibfWait.Reset();
+        ibfPolls.Reset();
+        obfWait.Reset();
+        obfPolls.Reset();
+        ioctl.Reset();
+        registerRead.Reset();
+        scanJitter.Reset();
+        scanDuration.Reset();
+    }
+};
 
-        return result != FALSE;
+static void PrintHistogramJson(const LatencyHistogram& h) {
+    printf("{\"n\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}",
+           (unsigned long long)h.Count(), h.Mean(),
+           (unsigned long long)h.Percentile(50), (unsigned long long)h.Percentile(90),
+           (unsigned long long)h.Percentile(99), (unsigned long long)h.Max());
+}
+
+static void PrintHistogramLine(const char* label, const LatencyHistogram& h, const char* unit) {
+    if (h.Count() == 0) {
+        printf("%-18s -\n", label);
+        return;
     }
+    printf("%-18s %llu / %llu / %llu / %llu %s  (n=%llu)\n", label,
+           (unsigned long long)h.Percentile(50), (unsigned long long)h.Percentile(90),
+           (unsigned long long)h.Percentile(99), (unsigned long long)h.Max(), unit,
+           (unsigned long long)h.Count());
+}
 
-    // Low-level port I/O using LpcACPIEC module functions
-    bool PortRead(USHORT port, UCHAR* value) {
-        LONG64 input[1] = { port };
-        LONG64 output[1] = { 0 };
-        bool result = Execute("ioctl_pio_read", input, 1, output, 1);
+enum ECWaitKind {
+    EC_WAIT_IBF = 0,    // Waiting for input buffer empty
+    EC_WAIT_OBF = 1,    // Waiting for output buffer full
+    EC_WAIT_KINDS
+};
 
-        if (!result) {
-            if (verboseMode && !suppressVerbose) printf("[Verbose] PortRead(0x%02X) FAILED\n", port);
-            return false;
-        }
+// Spin / yield / sleep policy for the EC status wait loops.
+// Tracks the typical number of polls each wait kind needs on this machine and
+// spins for about twice that before yielding, then sleeps once the wait is clearly stuck.
+class ECWaitPolicy {
+private:
+    int fixedSpin;                          // 0 = adaptive
+    int typicalPolls16[EC_WAIT_KINDS];      // EWMA of polls-to-complete, 1/16 fixed point
+    int samples[EC_WAIT_KINDS];
+    LatencyHistogram completedUs[EC_WAIT_KINDS];    // Duration of waits that completed
 
-        *value = (UCHAR)output[0];
-        if (verboseMode && !suppressVerbose) printf("[Verbose] PortRead(0x%02X) = 0x%02X\n", port, *value);
-        return true;
+public:
+    ECWaitPolicy() : fixedSpin(0) {
+        for (int k = 0; k < EC_WAIT_KINDS; k++) {
+            typicalPolls16[k] = 0;
+            samples[k] = 0;
+        }
     }
 
-    bool PortWrite(USHORT port, UCHAR value) {
-        LONG64 input[2] = { port, value };
-        bool result = Execute("ioctl_pio_write", input, 2, NULL, 0);
+    void SetFixedSpin(int polls) { fixedSpin = polls; }
+    bool IsAdaptive() const { return fixedSpin == 0; }
 
-        if (!result) {
-            if (verboseMode && !suppressVerbose) printf("[Verbose] PortWrite(0x%02X, 0x%02X) FAILED\n", port, value);
-            return false;
-        }
+    double TypicalPolls(ECWaitKind kind) const { return typicalPolls16[kind] / 16.0; }
 
-        if (verboseMode && !suppressVerbose) printf("[Verbose] PortWrite(0x%02X, 0x%02X)\n", port, value);
-        return true;
-    }
+    int SpinBudget(ECWaitKind kind) const {
+        if (fixedSpin > 0) return fixedSpin;
+        if (samples[kind] == 0) return EC_BUSY_WAIT_ITERATIONS;
 
-    // Wait for EC Input Buffer to be empty (IBF=0)
-    bool WaitECReady(int timeoutMs = EC_WAIT_TIMEOUT_MS) {
-        DWORD startTime = GetTickCount();
-        int iterations = 0;
-        bool prevSuppress = suppressVerbose;
-        suppressVerbose = true;
+        int budget = (typicalPolls16[kind] * 2) / 16 + EC_SPIN_MIN_POLLS;
+        return (budget > EC_SPIN_MAX_POLLS) ? EC_SPIN_MAX_POLLS : budget;
+    }
 
-        while (GetTickCount() - startTime < (DWORD)timeoutMs) {
-            UCHAR status;
-            if (!PortRead(EC_CMD_PORT, &status)) {
-                suppressVerbose = prevSuppress;
-                return false;
-            }
+    // Timeout while the wait's failure class backs off: FAULT_SHORT_WAIT_FACTOR x the p99 of
+    // completed waits, so an EC that is slow but answering still gets through. Until a wait
+    // has completed nothing is known, and the full timeout stays.
+    int ShortTimeoutMs(ECWaitKind kind) const {
+        if (completedUs[kind].Count() == 0) return EC_WAIT_TIMEOUT_MS;
+        ULONG64 us = completedUs[kind].Percentile(99) * FAULT_SHORT_WAIT_FACTOR;
+        int ms = (int)((us + 999) / 1000);
+        if (ms < FAULT_SHORT_WAIT_MS) ms = FAULT_SHORT_WAIT_MS;
+        return (ms > EC_WAIT_TIMEOUT_MS) ? EC_WAIT_TIMEOUT_MS : ms;
+    }
 
-            if ((status & EC_IBF) == 0) {
-                suppressVerbose = prevSuppress;
-                return true;
-            }
+    // Record a completed wait (EWMA, alpha = 1/8)
+    void Learn(ECWaitKind kind, int polls, ULONG64 elapsedUs) {
+        completedUs[kind].Record(elapsedUs);
+        if (samples[kind] == 0) {
+            typicalPolls16[kind] = polls * 16;
+        } else {
+            typicalPolls16[kind] += (polls * 16 - typicalPolls16[kind]) / 8;
+        }
+        if (samples[kind] < INT_MAX) samples[kind]++;
+    }
 
-            iterations++;
-            if (iterations > EC_BUSY_WAIT_ITERATIONS) {
-                Sleep(0);
-            }
+    // Called after an unsuccessful poll; remainingTicks is QPC time left before the deadline
+    void Backoff(ECWaitKind kind, int polls, LONGLONG remainingTicks) const {
+        int spin = SpinBudget(kind);
+        if (polls < spin) return;                       // Tight polling
+        if (polls < spin * EC_YIELD_FACTOR) {
+            Sleep(0);                                   // Yield the rest of the quantum
+            return;
+        }
+        if (remainingTicks > QpcTicksFromMs(EC_SLEEP_MIN_REMAINING_MS)) {
+            Sleep(1);                                   // Clearly stuck, stop burning CPU
+        } else {
+            Sleep(0);
         }
-        suppressVerbose = prevSuppress;
-        if (verboseMode) printf("[Verbose] WaitECReady timeout after %dms\n", timeoutMs);
-        return false;
     }
+};
 
-    // Wait for EC Output Buffer to be full (OBF=1)
-    bool WaitECOBF(int timeoutMs = EC_WAIT_TIMEOUT_MS) {
-        DWORD startTime = GetTickCount();
-        int iterations = 0;
-        bool prevSuppress = suppressVerbose;
-        suppressVerbose = true;
+// Registers per Access_EC hold for batched reads. Watches how long acquires wait: on an idle
+// system a whole table goes in one hold; when other EC clients (fan services, HWiNFO) own the
+// lock, holds shrink towards LOCK_HOLD_TARGET_US worth of registers so their waits stay short,
+// then grow back by doubling once acquires have been uncontended for LOCK_QUIET_MS.
+class LockChunkPolicy {
+private:
+    int fixedChunk;             // 0 = adaptive
+    int chunk;
+    int registerUs16;           // EWMA of hold time per register, 1/16 us fixed point
+    int contention256;          // EWMA of the contended fraction of acquires, 1/256 fixed point
+    int quietStreak;
+    LONGLONG lastContended;     // QPC of the last contended acquire
+    int acquires;
+    int contended;
+    int smallestChunk;
 
-        while (GetTickCount() - startTime < (DWORD)timeoutMs) {
-            UCHAR status;
-            if (!PortRead(EC_CMD_PORT, &status)) {
-                suppressVerbose = prevSuppress;
-                return false;
-            }
+public:
+    LockChunkPolicy() : fixedChunk(0), chunk(LOCK_CHUNK_MAX), registerUs16(0), contention256(0),
+                        quietStreak(0), lastContended(0), acquires(0), contended(0), smallestChunk(LOCK_CHUNK_MAX) {}
 
-            if ((status & EC_OBF) != 0) {
-                suppressVerbose = prevSuppress;
-                return true;
-            }
+    void SetFixedChunk(int registers) {
+        fixedChunk = registers;
+        if (registers > 0) chunk = smallestChunk = registers;
+    }
+    bool IsAdaptive() const { return fixedChunk == 0; }
+
+    int Chunk() const { return chunk; }
+    int SmallestChunk() const { return smallestChunk; }
+    int Acquires() const { return acquires; }
+    int Contended() const { return contended; }
+    double ContendedShare() const { return contention256 / 256.0; }
 
-            iterations++;
-            if (iterations > EC_BUSY_WAIT_ITERATIONS) {
-                Sleep(0);
+    // Record one Access_EC acquire: waitUs including retries, retried = a timeout was hit
+    void OnAcquire(ULONG64 waitUs, bool retried) {
+        bool busy = retried || waitUs > LOCK_CONTENDED_WAIT_US;
+        acquires++;
+        if (busy) contended++;
+        contention256 += ((busy ? 256 : 0) - contention256) / 8;
+        if (fixedChunk > 0) return;
+
+        if (busy) {
+            // Halve, and never hold longer than the target at the learned per-register cost
+            int next = chunk / 2;
+            if (registerUs16 > 0) {
+                int bound = LOCK_HOLD_TARGET_US * 16 / registerUs16;
+                if (bound < next) next = bound;
             }
+            chunk = (next < LOCK_CHUNK_MIN) ? LOCK_CHUNK_MIN : next;
+            if (chunk < smallestChunk) smallestChunk = chunk;
+            quietStreak = 0;
+            lastContended = QpcNow();
+        } else if (++quietStreak >= LOCK_GROW_AFTER && chunk < LOCK_CHUNK_MAX &&
+                   QpcNow() - lastContended > QpcTicksFromMs(LOCK_QUIET_MS)) {
+            chunk = (chunk * 2 > LOCK_CHUNK_MAX) ? LOCK_CHUNK_MAX : chunk * 2;
+            quietStreak = 0;
         }
-        suppressVerbose = prevSuppress;
-        if (verboseMode) printf("[Verbose] WaitECOBF timeout after %dms\n", timeoutMs);
-        return false;
     }
 
-    UCHAR ReadECRegister(UCHAR reg, bool* success = NULL) {
-        if (success) *success = false;
+    // Record one completed hold of registers reads (EWMA, alpha = 1/8)
+    void OnHold(ULONG64 holdUs, int registers) {
+        if (registers <= 0) return;
+        int perRegister16 = (int)(holdUs * 16 / registers);
+        if (registerUs16 == 0) registerUs16 = perRegister16;
+        else registerUs16 += (perRegister16 - registerUs16) / 8;
+        if (registerUs16 < 1) registerUs16 = 1;
+    }
+};
 
-        // Retry loop for improved reliability
-        for (int attempt = 0; attempt < EC_MAX_RETRIES; attempt++) {
-            if (!AcquireMutex()) {
-                if (attempt < EC_MAX_RETRIES - 1) {
-                    retryCount++;
-                    if (verboseMode) printf("[Verbose] Mutex acquisition failed, retry %d/%d\n", attempt + 1, EC_MAX_RETRIES - 1);
-                    Sleep(0);  // Brief yield before retry
-                    continue;
-                }
-                failedReads++;
-                return 0xFF;
-            }
+// Persistent IOCTL_PAWNIO_EXECUTE buffers
+#define EXECUTE_MAX_ARGS          8     // Max LONG64 inputs/outputs via Execute()
+
+// Pre-encoded, zero-padded function-name headers (built at compile time)
+static const char FN_PIO_READ[FN_NAME_LENGTH]  = "ioctl_pio_read";
+static const char FN_PIO_WRITE[FN_NAME_LENGTH] = "ioctl_pio_write";
 
-            bool ok = true;
+// IOCTL_PAWNIO_EXECUTE input layouts: 32-byte function name + LONG64 operands
+struct PioReadRequest {
+    char function[FN_NAME_LENGTH];
+    LONG64 port;
+};
 
-            // EC Read Protocol:
-            // 1. Wait for IBF=0 (EC ready)
-            // 2. Write 0x80 (read command) to command port (0x66)
-            // 3. Wait for IBF=0
-            // 4. Write register address to data port (0x62)
-            // 5. Wait for OBF=1 (data ready)
-            // 6. Read data from data port (0x62)
+struct PioWriteRequest {
+    char function[FN_NAME_LENGTH];
+    LONG64 port;
+    LONG64 value;
+};
 
-            if (verboseMode) {
-                printf("[Verbose] Reading EC register 0x%02X\n", reg);
-            }
+static_assert(sizeof(PioReadRequest) == FN_NAME_LENGTH + sizeof(LONG64), "PioReadRequest must be packed");
+static_assert(sizeof(PioWriteRequest) == FN_NAME_LENGTH + 2 * sizeof(LONG64), "PioWriteRequest must be packed");
 
-            // Step 1: Wait for EC to be ready
-            if (!WaitECReady()) {
-                if (verboseMode) printf("[Verbose] EC not ready before command\n");
-                ok = false;
-            }
+// Set of register addresses for sparse batched reads (one bit per register)
+struct ECRegisterMask {
+    ULONG64 bits[4];
 
-            // Step 2: Send read command (0x80)
-            if (ok && !PortWrite(EC_CMD_PORT, 0x80)) {
-                if (verboseMode) printf("[Verbose] Failed to write read command\n");
-                ok = false;
-            }
+    ECRegisterMask() { Clear(); }
 
-            // Step 3: Wait for EC to accept command
-            if (ok && !WaitECReady()) {
-                if (verboseMode) printf("[Verbose] EC not ready after command\n");
-                ok = false;
+    void Clear() { memset(bits, 0, sizeof(bits)); }
+    void Set(UCHAR reg) { bits[reg >> 6] |= (1ULL << (reg & 63)); }
+    void Reset(UCHAR reg) { bits[reg >> 6] &= ~(1ULL << (reg & 63)); }
+    bool Test(UCHAR reg) const { return (bits[reg >> 6] & (1ULL << (reg & 63))) != 0; }
+
+    int Count() const {
+        int count = 0;
+        for (int i = 0; i < 4; i++) {
+            ULONG64 word = bits[i];
+            while (word) {
+                word &= word - 1;
+                count++;
             }
+        }
+        return count;
+    }
+};
 
-            // Steps 4-6: Critical timing section - suppress verbose to prevent printf delays
-            bool prevSuppress = suppressVerbose;
-            suppressVerbose = true;
+// ETW provider for scan health and fault transitions (see ETW_KEYWORD_*)
+// {AB4DC03D-E42B-47E3-A711-C61522ED4858}
+static const GUID ETW_PROVIDER_GUID = { 0xab4dc03d, 0xe42b, 0x47e3, { 0xa7, 0x11, 0xc6, 0x15, 0x22, 0xed, 0x48, 0x58 } };
+static const char ETW_PROVIDER_NAME[] = "ECReader";
 
-            UCHAR value = 0xFF;
-            if (ok) ok = PortWrite(EC_DATA_PORT, reg);      // Step 4: Write register address
-            if (ok) ok = WaitECOBF();                       // Step 5: Wait for data ready
-            if (ok) ok = PortRead(EC_DATA_PORT, &value);    // Step 6: Read data
+#define ETW_LEVEL_WARNING         3
+#define ETW_LEVEL_INFO            4
+#define ETW_LEVEL_VERBOSE         5
+#define ETW_CHANNEL_TRACELOGGING  11    // Marks events whose metadata travels with them
 
-            suppressVerbose = prevSuppress;
+// One self-describing event: field names and types go into metadata sent along with the
+// values, so WPA, PerfView and tracerpt decode it without a manifest. Values are copied,
+// strings must outlive Write.
+class EtwEvent {
+private:
+    UCHAR metadata[ETW_METADATA_MAX];
+    USHORT metadataSize;
+    ULONG64 values[ETW_FIELDS_MAX];
+    EVENT_DATA_DESCRIPTOR data[ETW_FIELDS_MAX + 2];     // Provider traits, metadata, fields
+    int fields;
 
-            if (!ok && verboseMode) {
-                printf("[Verbose] EC read sequence failed\n");
-            }
+    // TraceLogging input types
+    enum { IN_ANSISTRING = 2, IN_UINT8 = 4, IN_INT32 = 7, IN_UINT32 = 8, IN_UINT64 = 10, IN_DOUBLE = 12, IN_BOOL32 = 13 };
 
+    void AddMetadata(const char* text, size_t size) {
+        if (metadataSize + size > sizeof(metadata)) return;
+        memcpy(metadata + metadataSize, text, size);
+        metadataSize += (USHORT)size;
+    }
+
+    void* Field(const char* name, UCHAR inType, ULONG size) {
+        if (fields == ETW_FIELDS_MAX) return NULL;
+        AddMetadata(name, strlen(name) + 1);
+        AddMetadata((const char*)&inType, 1);
+        EventDataDescCreate(&data[2 + fields], &values[fields], size);
+        return &values[fields++];
+    }
+
+public:
+    explicit EtwEvent(const char* name) : metadataSize(2), fields(0) {
+        UCHAR noTags = 0;
+        AddMetadata((const char*)&noTags, 1);
+        AddMetadata(name, strlen(name) + 1);
+    }
+
+    void U8(const char* name, UCHAR v)      { UCHAR* f = (UCHAR*)Field(name, IN_UINT8, sizeof(v)); if (f) *f = v; }
+    void I32(const char* name, LONG v)      { LONG* f = (LONG*)Field(name, IN_INT32, sizeof(v)); if (f) *f = v; }
+    void U32(const char* name, ULONG v)     { ULONG* f = (ULONG*)Field(name, IN_UINT32, sizeof(v)); if (f) *f = v; }
+    void U64(const char* name, ULONG64 v)   { ULONG64* f = (ULONG64*)Field(name, IN_UINT64, sizeof(v)); if (f) *f = v; }
+    void Double(const char* name, double v) { double* f = (double*)Field(name, IN_DOUBLE, sizeof(v)); if (f) *f = v; }
+    void Bool(const char* name, bool v)     { LONG* f = (LONG*)Field(name, IN_BOOL32, sizeof(LONG)); if (f) *f = v ? 1 : 0; }
+
+    void Str(const char* name, const char* v) {
+        if (Field(name, IN_ANSISTRING, 0) != NULL) EventDataDescCreate(&data[1 + fields], v, (ULONG)strlen(v) + 1);
+    }
+
+    // Descriptors for EventWriteTransfer, with the provider traits in front
+    PEVENT_DATA_DESCRIPTOR Descriptors(const void* traits, USHORT traitsSize, ULONG* count) {
+        memcpy(metadata, &metadataSize, sizeof(metadataSize));
+        EventDataDescCreate(&data[0], traits, traitsSize);
+        data[0].Reserved = 2;   // EVENT_DATA_DESCRIPTOR_TYPE_PROVIDER_METADATA
+        EventDataDescCreate(&data[1], metadata, metadataSize);
+        data[1].Reserved = 1;   // EVENT_DATA_DESCRIPTOR_TYPE_EVENT_METADATA
+        *count = 2 + fields;
+        return data;
+    }
+};
+
+// The process's ETW registration. A session enables it by GUID with a level and keywords;
+// the enable callback keeps those in plain fields so Enabled() costs a few compares.
+// Registered while any ECReader is open (Register/Unregister nest).
+class ECEventProvider {
+private:
+    REGHANDLE handle;
+    LONG registrations;
+    volatile LONG enabled;
+    volatile UCHAR level;
+    volatile ULONGLONG anyKeyword;
+    volatile ULONGLONG allKeyword;
+    UCHAR traits[2 + sizeof(ETW_PROVIDER_NAME)];    // Size, then the provider name
+    LONG written;
+
+    static void NTAPI EnableCallback(LPCGUID, ULONG isEnabled, UCHAR newLevel, ULONGLONG matchAny,
+                                     ULONGLONG matchAll, PEVENT_FILTER_DESCRIPTOR, PVOID context) {
+        ECEventProvider* self = (ECEventProvider*)context;
+        if (isEnabled == 2) return;     // Capture-state request: nothing beyond the periodic events
+        self->level = newLevel;
+        self->anyKeyword = matchAny;
+        self->allKeyword = matchAll;
+        InterlockedExchange(&self->enabled, isEnabled ? 1 : 0);
+    }
+
+public:
+    ECEventProvider() : handle(0), registrations(0), enabled(0), level(0), anyKeyword(0), allKeyword(0), written(0) {
+        USHORT size = (USHORT)sizeof(traits);
+        memcpy(traits, &size, sizeof(size));
+        memcpy(traits + 2, ETW_PROVIDER_NAME, sizeof(ETW_PROVIDER_NAME));
+    }
+
+    void Register() {
+        if (registrations++ > 0) return;
+        if (EventRegister(&ETW_PROVIDER_GUID, EnableCallback, this, &handle) != ERROR_SUCCESS) {
+            handle = 0;
+            return;
+        }
+
+        // Windows 8+: honor the descriptor types and know the provider name. Windows 7 lacks
+        // EventSetInformation; tools then see the events by GUID.
+        typedef ULONG (WINAPI *EventSetInformationFn)(REGHANDLE, int, PVOID, ULONG);
+        HMODULE advapi = GetModuleHandleA("advapi32.dll");
+        EventSetInformationFn setInformation = advapi ? (EventSetInformationFn)GetProcAddress(advapi, "EventSetInformation") : NULL;
+        if (setInformation != NULL) {
+            BOOLEAN useTypes = TRUE;
+            setInformation(handle, 3 /* EventProviderUseDescriptorType */, &useTypes, sizeof(useTypes));
+            setInformation(handle, 2 /* EventProviderSetTraits */, traits, sizeof(traits));
+        }
+    }
+
+    void Unregister() {
+        if (registrations == 0 || --registrations > 0) return;
+        if (handle != 0) EventUnregister(handle);
+        handle = 0;
+        InterlockedExchange(&enabled, 0);
+    }
+
+    bool Enabled(UCHAR eventLevel, ULONGLONG keyword) const {
+        if (!enabled) return false;
+        if (level != 0 && eventLevel > level) return false;
+        if (anyKeyword != 0 && (keyword & anyKeyword) == 0) return false;
+        return (keyword & allKeyword) == allKeyword;
+    }
+
+    void Write(EtwEvent& event, UCHAR eventLevel, ULONGLONG keyword) {
+        EVENT_DESCRIPTOR descriptor;
+        memset(&descriptor, 0, sizeof(descriptor));
+        descriptor.Channel = ETW_CHANNEL_TRACELOGGING;
+        descriptor.Level = eventLevel;
+        descriptor.Keyword = keyword;
+        ULONG count = 0;
+        PEVENT_DATA_DESCRIPTOR data = event.Descriptors(traits, (USHORT)sizeof(traits), &count);
+        if (EventWriteTransfer(handle, &descriptor, NULL, NULL, count, data) == ERROR_SUCCESS) {
+            InterlockedIncrement(&written);
+        }
+    }
+
+    // Quarantine / breaker transition, kinds as in ECFaultPolicy's log
+    void Fault(const char* channel, char kind, UCHAR reg, const char* cause, int pauseMs) {
+        if (!Enabled(ETW_LEVEL_WARNING, ETW_KEYWORD_FAULT)) return;
+        EtwEvent event("Fault");
+        event.Str("Channel", channel);
+        event.Str("Kind", kind == 'Q' ? "quarantined" : kind == 'R' ? "released" : kind == 'T' ? "breaker tripped" : "breaker closed");
+        event.U8("Register", reg);
+        event.Str("Cause", cause);
+        event.I32("PauseMs", pauseMs);
+        Write(event, ETW_LEVEL_WARNING, ETW_KEYWORD_FAULT);
+    }
+
+    void PrintStatistics() const {
+        if (written == 0) return;
+        printf("ETW events:       %ld written (provider %s)\n", (long)written, ETW_PROVIDER_NAME);
+    }
+};
+
+static ECEventProvider g_events;
+
+// Why an EC transaction failed, for per-class backoff and the -s report
+enum ECFailure {
+    EC_FAIL_MUTEX = 0,  // Access_EC not acquired in time
+    EC_FAIL_IBF,        // Input buffer never emptied (EC not accepting commands)
+    EC_FAIL_OBF,        // Output buffer never filled (no data for the address)
+    EC_FAIL_IOCTL,      // Port access itself failed
+    EC_FAIL_KINDS,
+    EC_FAIL_NONE = EC_FAIL_KINDS
+};
+
+static const char* g_failureNames[EC_FAIL_KINDS] = { "mutex timeout", "IBF stuck", "OBF never set", "IOCTL error" };
+
+// Failure handling for reads that stop being answered.
+// Per class: after the second consecutive failure, once FAULT_BACKOFF_SPREAD distinct registers
+// have failed (one dead register is left to quarantine), that class backs off for an
+// exponentially growing window in which failed attempts are not retried and IBF/OBF waits are
+// cut to a few times their learned p99; any success ends it. Reads that fail under such a
+// shortened wait count toward neither quarantine nor the breaker; every FAULT_SHORT_VERIFY_EVERY
+// of them, one read runs the full timeout so a wedged EC still trips it.
+// Per register: FAULT_QUARANTINE_AFTER consecutive failed reads quarantine it; batched reads
+// then skip it except for re-probes on a doubling schedule. Whole EC: FAULT_BREAKER_TRIP
+// failed reads in a row (of any registers) open a breaker that pauses all access, then lets
+// one probe read through (half-open) to decide whether to close it or pause twice as long.
+class ECFaultPolicy {
+private:
+    struct Event {
+        LONGLONG qpc;
+        char kind;              // 'Q' quarantined, 'R' released, 'T' breaker tripped, 'C' breaker closed
+        UCHAR reg;
+        UCHAR cause;            // ECFailure
+        int pauseMs;            // 'Q': next probe, 'T': pause
+    };
+
+    LONGLONG startQpc;
+    int streak[EC_FAIL_KINDS];          // Consecutive failed attempts per class
+    LONGLONG backoffUntil[EC_FAIL_KINDS];
+    int failures[EC_FAIL_KINDS];
+    int backoffs[EC_FAIL_KINDS];        // Backoff windows entered
+    ECRegisterMask failedRegs[EC_FAIL_KINDS];   // Registers failing since the class last succeeded
+    bool shortWait;                     // The read in progress ran a shortened wait
+    int shortStreak;                    // Uncounted short-wait failures since the last counted read
+    int shortFailures;                  // Failed reads not counted because of that
+
+    UCHAR regStreak[256];
+    ECRegisterMask quarantined;
+    LONGLONG probeAt[256];
+    int probeMs[256];
+    int quarantines;
+    int releases;
+    int probes;
+
+    int readStreak;                     // Consecutive failed reads, any register
+    LONGLONG breakerUntil;              // 0 = closed
+    bool halfOpen;
+    int breakerMs;
+    int trips;
+    ULONG64 pausedMs;
+    int skipped;                        // Reads not attempted (quarantine or open breaker)
+
+    Event log[FAULT_LOG_MAX];
+    int logCount;
+    int logDropped;
+    const char* channelName;            // ETW only
+
+    void Log(char kind, UCHAR reg, ECFailure cause, int pauseMs) {
+        g_events.Fault(channelName, kind, reg, cause < EC_FAIL_KINDS ? g_failureNames[cause] : "", pauseMs);
+        if (logCount == FAULT_LOG_MAX) {
+            logDropped++;
+            return;
+        }
+        Event& e = log[logCount++];
+        e.qpc = QpcNow();
+        e.kind = kind;
+        e.reg = reg;
+        e.cause = (UCHAR)cause;
+        e.pauseMs = pauseMs;
+    }
+
+    void Trip(ECFailure cause, LONGLONG now) {
+        breakerUntil = now + QpcTicksFromMs(breakerMs);
+        halfOpen = false;
+        trips++;
+        pausedMs += breakerMs;
+        Log('T', 0, cause, breakerMs);
+        // The EC is failing, not these registers
+        memset(regStreak, 0, sizeof(regStreak));
+    }
+
+public:
+    ECFaultPolicy() : channelName("") {
+        Reset();
+    }
+
+    // Names the EC interface in Fault events; the string must outlive the policy
+    void SetChannelName(const char* name) { channelName = name; }
+
+    void Reset() {
+        startQpc = QpcNow();
+        for (int c = 0; c < EC_FAIL_KINDS; c++) {
+            streak[c] = 0;
+            backoffUntil[c] = 0;
+            failures[c] = 0;
+            backoffs[c] = 0;
+            failedRegs[c].Clear();
+        }
+        shortWait = false;
+        shortStreak = 0;
+        shortFailures = 0;
+        memset(regStreak, 0, sizeof(regStreak));
+        quarantined.Clear();
+        for (int i = 0; i < 256; i++) {
+            probeAt[i] = 0;
+            probeMs[i] = FAULT_PROBE_MS;
+        }
+        quarantines = releases = probes = 0;
+        readStreak = 0;
+        breakerUntil = 0;
+        halfOpen = false;
+        breakerMs = FAULT_BREAKER_BASE_MS;
+        trips = 0;
+        pausedMs = 0;
+        skipped = 0;
+        logCount = logDropped = 0;
+    }
+
+    bool BackingOff(ECFailure cause) const {
+        return streak[cause] >= 2 && QpcNow() < backoffUntil[cause];
+    }
+
+    // Retry a failed attempt unless its class is backing off
+    bool RetryAllowed(ECFailure cause) const {
+        return cause == EC_FAIL_NONE || !BackingOff(cause);
+    }
+
+    // IBF/OBF timeout for the next wait. Half-open probes and verification reads get the full timeout.
+    int WaitTimeoutMs(ECWaitKind kind, const ECWaitPolicy& waits) {
+        if (halfOpen || shortStreak >= FAULT_SHORT_VERIFY_EVERY) return EC_WAIT_TIMEOUT_MS;
+        if (!BackingOff(kind == EC_WAIT_IBF ? EC_FAIL_IBF : EC_FAIL_OBF)) return EC_WAIT_TIMEOUT_MS;
+        int ms = waits.ShortTimeoutMs(kind);
+        if (ms < EC_WAIT_TIMEOUT_MS) shortWait = true;
+        return ms;
+    }
+
+    // One failed attempt (before retries are decided); reg < 0 for failures of no register (mutex)
+    void OnAttemptFailed(ECFailure cause, int reg = -1) {
+        if (cause == EC_FAIL_NONE) return;
+        failures[cause]++;
+        if (reg >= 0) failedRegs[cause].Set((UCHAR)reg);
+        if (++streak[cause] < 2) return;
+        if (reg >= 0 && failedRegs[cause].Count() < FAULT_BACKOFF_SPREAD) return;
+        int shift = streak[cause] - 2;
+        int ms = (shift >= 16) ? FAULT_BACKOFF_MAX_MS : FAULT_BACKOFF_BASE_MS << shift;
+        if (ms > FAULT_BACKOFF_MAX_MS) ms = FAULT_BACKOFF_MAX_MS;
+        if (QpcNow() >= backoffUntil[cause]) backoffs[cause]++;
+        backoffUntil[cause] = QpcNow() + QpcTicksFromMs(ms);
+    }
+
+    void OnMutexAcquired() {
+        streak[EC_FAIL_MUTEX] = 0;
+        backoffUntil[EC_FAIL_MUTEX] = 0;
+    }
+
+    // A batch gave up on Access_EC; a stuck owner wedges the EC for us just the same
+    void OnMutexFailed() {
+        LONGLONG now = QpcNow();
+        if (halfOpen || (breakerUntil == 0 && streak[EC_FAIL_MUTEX] >= FAULT_BREAKER_MUTEX_TRIP)) {
+            if (halfOpen) breakerMs = (breakerMs * 2 > FAULT_BREAKER_MAX_MS) ? FAULT_BREAKER_MAX_MS : breakerMs * 2;
+            Trip(EC_FAIL_MUTEX, now);
+        }
+    }
+
+    // Outcome of one register read, after retries. cause = class of the last failed attempt.
+    void OnRead(UCHAR reg, bool ok, ECFailure cause) {
+        LONGLONG now = QpcNow();
+        bool shortened = shortWait;
+        shortWait = false;
+        if (!shortened) shortStreak = 0;
+        if (ok) {
+            for (int c = EC_FAIL_IBF; c < EC_FAIL_KINDS; c++) {
+                streak[c] = 0;
+                backoffUntil[c] = 0;
+                failedRegs[c].Clear();
+            }
+            readStreak = 0;
+            regStreak[reg] = 0;
+            if (halfOpen) {
+                halfOpen = false;
+                breakerUntil = 0;
+                breakerMs = FAULT_BREAKER_BASE_MS;
+                Log('C', reg, EC_FAIL_NONE, 0);
+            }
+            if (quarantined.Test(reg)) {
+                quarantined.Reset(reg);
+                probeMs[reg] = FAULT_PROBE_MS;
+                releases++;
+                Log('R', reg, EC_FAIL_NONE, 0);
+            }
+            return;
+        }
+
+        if (shortened) {
+            // The wait was cut short: says nothing about this register or the EC
+            shortFailures++;
+            shortStreak++;
+            return;
+        }
+        readStreak++;
+        if (halfOpen) {
+            // Probe failed: stay paused, twice as long
+            breakerMs = (breakerMs * 2 > FAULT_BREAKER_MAX_MS) ? FAULT_BREAKER_MAX_MS : breakerMs * 2;
+            Trip(cause, now);
+            return;
+        }
+        if (breakerUntil != 0) return;
+        if (readStreak >= FAULT_BREAKER_TRIP) {
+            Trip(cause, now);
+            return;
+        }
+
+        if (quarantined.Test(reg)) {
+            probeMs[reg] = (probeMs[reg] * 2 > FAULT_PROBE_MAX_MS) ? FAULT_PROBE_MAX_MS : probeMs[reg] * 2;
+            probeAt[reg] = now + QpcTicksFromMs(probeMs[reg]);
+        } else if (++regStreak[reg] >= FAULT_QUARANTINE_AFTER) {
+            quarantined.Set(reg);
+            quarantines++;
+            probeAt[reg] = now + QpcTicksFromMs(probeMs[reg]);
+            Log('Q', reg, cause, probeMs[reg]);
+        }
+    }
+
+    // Batched reads: leave a quarantined register out unless its re-probe is due
+    bool Skip(UCHAR reg) {
+        if (!quarantined.Test(reg)) return false;
+        if (QpcNow() >= probeAt[reg]) {
+            probes++;
+            return false;
+        }
+        skipped++;
+        return true;
+    }
+
+    // False while the breaker pauses access. When the pause is over the breaker half-opens:
+    // *probeOnly asks the caller to read a single register and report it through OnRead.
+    bool Admit(bool* probeOnly) {
+        *probeOnly = false;
+        if (breakerUntil == 0) return true;
+        if (halfOpen) {
+            *probeOnly = true;
+            return true;
+        }
+        if (QpcNow() < breakerUntil) return false;
+        halfOpen = true;
+        *probeOnly = true;
+        return true;
+    }
+
+    bool BreakerOpen() const { return breakerUntil != 0 && !halfOpen && QpcNow() < breakerUntil; }
+
+    int QuarantinedCount() const { return quarantined.Count(); }
+
+    void CountSkipped(int reads) { skipped += reads; }
+
+    void PrintStatistics() const {
+        int total = 0;
+        for (int c = 0; c < EC_FAIL_KINDS; c++) total += failures[c];
+        if (total == 0 && trips == 0 && quarantines == 0) return;
+
+        printf("Failed attempts:  ");
+        for (int c = 0; c < EC_FAIL_KINDS; c++) {
+            printf("%s%s %d (%d backoffs)", c ? ", " : "", g_failureNames[c], failures[c], backoffs[c]);
+        }
+        printf("\n");
+        if (shortFailures > 0) printf("Short waits:      %d reads failed under a shortened wait (not counted)\n", shortFailures);
+        printf("Quarantine:       %d registers now, %d quarantined, %d released, %d re-probes, %d reads skipped\n",
+               quarantined.Count(), quarantines, releases, probes, skipped);
+        printf("Breaker:          %d trips, %.1f s paused%s\n", trips, pausedMs / 1000.0,
+               BreakerOpen() ? " (open)" : halfOpen ? " (half-open)" : "");
+        for (int i = 0; i < logCount; i++) {
+            const Event& e = log[i];
+            double at = QpcToMs(e.qpc - startQpc) / 1000.0;
+            if (e.kind == 'Q') {
+                printf("  %8.1f s  quarantined 0x%02X (%s), first re-probe in %d s\n", at, e.reg, g_failureNames[e.cause], e.pauseMs / 1000);
+            } else if (e.kind == 'R') {
+                printf("  %8.1f s  released 0x%02X\n", at, e.reg);
+            } else if (e.kind == 'T') {
+                printf("  %8.1f s  breaker tripped (%s), paused %d ms\n", at, g_failureNames[e.cause], e.pauseMs);
+            } else {
+                printf("  %8.1f s  breaker closed after probe of 0x%02X\n", at, e.reg);
+            }
+        }
+        if (logDropped > 0) printf("  (%d more events not logged)\n", logDropped);
+    }
+};
+
+// EC port I/O backend. ECReader runs the EC protocol on top of one of these.
+class ECTransport {
+protected:
+    bool verboseMode;
+
+public:
+    ECTransport() : verboseMode(false) {}
+    virtual ~ECTransport() {}
+
+    void SetVerbose(bool verbose) { verboseMode = verbose; }
+
+    virtual const char* Name() const = 0;
+    virtual bool Open() = 0;
+    virtual void Close() = 0;
+    virtual bool PortRead(USHORT port, UCHAR* value) = 0;
+    virtual bool PortWrite(USHORT port, UCHAR value) = 0;
+
+    // Whether accesses must be serialized with other EC users through Access_EC
+    virtual bool UsesSystemMutex() const { return true; }
+
+    // Without Access_EC: name of a backend-private lock to serialize on instead (NULL = none)
+    virtual const char* PrivateLockName() const { return NULL; }
+
+    // Backend-specific lines for -s
+    virtual void PrintStatistics() const {}
+};
+
+// Real hardware: PawnIO driver + LpcACPIEC.bin module
+class PawnIOTransport : public ECTransport {
+private:
+    HANDLE hDriver;
+    const char* modulePath;     // NULL = embedded module
+
+    // Request buffers owned by the instance so the IOCTL hot path never allocates
+    PioReadRequest pioReadRequest;
+    PioWriteRequest pioWriteRequest;
+    LONG64 pioReadResult;
+    BYTE executeInput[FN_NAME_LENGTH + EXECUTE_MAX_ARGS * sizeof(LONG64)];
+    LONG64 executeOutput[EXECUTE_MAX_ARGS];
+
+public:
+    PawnIOTransport() : hDriver(INVALID_HANDLE_VALUE), modulePath(NULL), pioReadResult(0) {
+        memset(&pioReadRequest, 0, sizeof(pioReadRequest));
+        memset(&pioWriteRequest, 0, sizeof(pioWriteRequest));
+        memcpy(pioReadRequest.function, FN_PIO_READ, FN_NAME_LENGTH);
+        memcpy(pioWriteRequest.function, FN_PIO_WRITE, FN_NAME_LENGTH);
+        memset(executeInput, 0, sizeof(executeInput));
+        memset(executeOutput, 0, sizeof(executeOutput));
+    }
+
+    const char* Name() const { return "PawnIO"; }
+
+    bool Open() {
+        // Open PawnIO driver directly
+        hDriver = CreateFileA("\\\\.\\PawnIO",
+                              GENERIC_READ | GENERIC_WRITE,
+                              0,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+
+        if (hDriver == INVALID_HANDLE_VALUE) {
+            printf("Error: Failed to open PawnIO driver. (Error: %lu)\n", GetLastError());
+            printf("Possible causes:\n");
+            printf("1. PawnIO driver not installed. Get from https://pawnio.eu \n");
+            printf("2. Not running as Administrator\n");
+            printf("3. Driver service not started. Run 'sc query pawnio' to validate.\n");
+            return false;
+        }
+
+        if (verboseMode) printf("[Verbose] PawnIO driver opened successfully\n");
+
+        // Load LpcACPIEC module
+        if (verboseMode) printf("[Verbose] Testing LpcACPIEC.bin module load...\n");
+        if (!LoadModule()) {
+            printf("Error: Failed to load %s module\n", modulePath != NULL ? modulePath : MODULE_FILE_NAME);
+            CloseHandle(hDriver);
+            hDriver = INVALID_HANDLE_VALUE;
+            return false;
+        }
+
+        if (verboseMode) printf("[Verbose] LpcACPIEC.bin loaded successfully!\n");
+
+        return true;
+    }
+
+    // Module image: embedded RCDATA resource by default, or an external file from --module
+    void SetModulePath(const char* path) { modulePath = path; }
+
+    // Upload a module image to the driver
+    bool LoadBinary(const void* image, DWORD size) {
+        if (verboseMode) printf("[Verbose] Module size: %lu bytes\n", size);
+
+        // METHOD_BUFFERED: the driver copies the input, so the image is passed in place
+        DWORD bytesReturned = 0;
+        BOOL result = DeviceIoControl(hDriver,
+                                      IOCTL_PAWNIO_LOAD_BINARY,
+                                      (LPVOID)image,
+                                      size,
+                                      NULL,
+                                      0,
+                                      &bytesReturned,
+                                      NULL);
+
+        if (!result) {
+            if (verboseMode) printf("[Verbose] DeviceIoControl LOAD_BINARY failed (Error: %lu)\n", GetLastError());
+            return false;
+        }
+
+        return true;
+    }
+
+    // Module linked into the exe (resource.rc). Locked resource memory is part of the
+    // mapped image, so there is no file I/O and no copy before the IOCTL.
+    bool LoadModuleResource() {
+        HRSRC resource = FindResourceA(NULL, MODULE_RESOURCE_NAME, RT_RCDATA);
+        if (resource == NULL) {
+            if (verboseMode) printf("[Verbose] No embedded module resource (Error: %lu)\n", GetLastError());
+            return false;
+        }
+
+        DWORD size = SizeofResource(NULL, resource);
+        HGLOBAL loaded = LoadResource(NULL, resource);
+        const void* image = (loaded != NULL) ? LockResource(loaded) : NULL;
+        if (image == NULL || size == 0) {
+            if (verboseMode) printf("[Verbose] Failed to lock embedded module resource\n");
+            return false;
+        }
+
+        if (verboseMode) printf("[Verbose] Loading embedded module\n");
+        return LoadBinary(image, size);
+    }
+
+    // Module from a file, mapped read-only instead of read into a heap buffer
+    bool LoadModuleFile(const char* path) {
+        if (verboseMode) printf("[Verbose] Loading module: %s\n", path);
+
+        HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            if (verboseMode) printf("[Verbose] Cannot open %s (Error: %lu)\n", path, GetLastError());
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart <= 0 || fileSize.QuadPart > 1024 * 1024) {
+            CloseHandle(hFile);
+            return false;
+        }
+
+        bool ok = false;
+        HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping != NULL) {
+            const void* image = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            if (image != NULL) {
+                ok = LoadBinary(image, (DWORD)fileSize.QuadPart);
+                UnmapViewOfFile(image);
+            }
+            CloseHandle(hMapping);
+        }
+        CloseHandle(hFile);
+        return ok;
+    }
+
+    // Module file next to the exe (builds without the embedded resource)
+    bool LoadModuleBesideExe(const char* filename) {
+        // Get executable directory and construct full path
+        char exePath[MAX_PATH];
+        char fullPath[MAX_PATH];
+
+        if (GetModuleFileNameA(NULL, exePath, MAX_PATH) == 0) {
+            if (verboseMode) printf("[Verbose] Warning: Failed to get exe path, trying relative: %s\n", filename);
+            strncpy_s(fullPath, MAX_PATH, filename, _TRUNCATE);
+        } else {
+            // Extract directory by finding last backslash
+            char* lastSlash = strrchr(exePath, '\\');
+            if (lastSlash != NULL) {
+                *lastSlash = '\0';  // Truncate at last backslash
+                snprintf(fullPath, MAX_PATH, "%s\\%s", exePath, filename);
+            } else {
+                strncpy_s(fullPath, MAX_PATH, filename, _TRUNCATE);
+            }
+        }
+
+        return LoadModuleFile(fullPath);
+    }
+
+    bool LoadModule() {
+        if (modulePath != NULL) return LoadModuleFile(modulePath);
+        return LoadModuleResource() || LoadModuleBesideExe(MODULE_FILE_NAME);
+    }
+
+    void Close() {
+        if (hDriver != INVALID_HANDLE_VALUE) {
+            CloseHandle(hDriver);
+            hDriver = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    // Execute a module function (like LibreHardwareMonitor does)
+    // Uses the instance-owned request buffers, so no heap traffic per call.
+    bool Execute(const char* functionName, LONG64* input, int inputCount, LONG64* output, int outputCount) {
+        if (inputCount < 0 || inputCount > EXECUTE_MAX_ARGS || outputCount < 0 || outputCount > EXECUTE_MAX_ARGS) {
+            if (verboseMode) printf("[Verbose] Execute(%s): too many arguments\n", functionName);
+            return false;
+        }
+
+        // Build input buffer: 32-byte function name + input data
+        int inputBufferSize = FN_NAME_LENGTH + (inputCount * sizeof(LONG64));
+        memset(executeInput, 0, FN_NAME_LENGTH);
+        strncpy_s((char*)executeInput, FN_NAME_LENGTH, functionName, _TRUNCATE);
+
+        // Copy input data after function name
+        if (inputCount > 0 && input != NULL) {
+            memcpy(executeInput + FN_NAME_LENGTH, input, inputCount * sizeof(LONG64));
+        }
+
+        // Prepare output buffer
+        int outputBufferSize = outputCount * sizeof(LONG64);
+        memset(executeOutput, 0, outputBufferSize);
+
+        // Call DeviceIoControl
+        DWORD bytesReturned = 0;
+        BOOL result = DeviceIoControl(hDriver,
+                                      IOCTL_PAWNIO_EXECUTE,
+                                      executeInput,
+                                      inputBufferSize,
+                                      outputBufferSize > 0 ? executeOutput : NULL,
+                                      outputBufferSize,
+                                      &bytesReturned,
+                                      NULL);
+
+        // Copy output data
+        if (result && output != NULL && bytesReturned > 0) {
+            DWORD copySize = (bytesReturned < (DWORD)outputBufferSize) ? bytesReturned : (DWORD)outputBufferSize;
+            memcpy(output, executeOutput, copySize);
+        }
+
+        if (!result && verboseMode) {
+            printf("[Verbose] DeviceIoControl EXECUTE failed (Error: %lu)\n", GetLastError());
+        }
+
+        return result != FALSE;
+    }
+
+    // Low-level port I/O using LpcACPIEC module functions
+    // Hot path: the function-name header is pre-encoded, only the operands are patched.
+    bool PortRead(USHORT port, UCHAR* value) {
+        pioReadRequest.port = port;
+        pioReadResult = 0;
+
+        DWORD bytesReturned = 0;
+        BOOL result = DeviceIoControl(hDriver,
+                                      IOCTL_PAWNIO_EXECUTE,
+                                      &pioReadRequest,
+                                      sizeof(pioReadRequest),
+                                      &pioReadResult,
+                                      sizeof(pioReadResult),
+                                      &bytesReturned,
+                                      NULL);
+
+        if (!result) return false;
+
+        *value = (UCHAR)pioReadResult;
+        return true;
+    }
+
+    bool PortWrite(USHORT port, UCHAR value) {
+        pioWriteRequest.port = port;
+        pioWriteRequest.value = value;
+
+        DWORD bytesReturned = 0;
+        BOOL result = DeviceIoControl(hDriver,
+                                      IOCTL_PAWNIO_EXECUTE,
+                                      &pioWriteRequest,
+                                      sizeof(pioWriteRequest),
+                                      NULL,
+                                      0,
+                                      &bytesReturned,
+                                      NULL);
+
+        return result != FALSE;
+    }
+};
+
+// Volatility-aware monitor scheduler.
+// Registers that change are re-read every cycle; each unchanged read doubles a register's
+// interval up to SCHED_MAX_INTERVAL cycles. A full sweep runs every fullEvery cycles or on request.
+class ScanScheduler {
+private:
+    USHORT interval[256];       // Cycles between reads
+    ULONG64 dueCycle[256];      // Next cycle the register must be read
+    ULONG64 lastReadCycle[256];
+    int changeRate16[256];      // EWMA of changes per read, 1/65536 fixed point
+    ULONG64 cycle;
+    int fullEvery;              // 1 = every cycle is a full sweep (non-adaptive)
+    bool fullRequested;
+
+public:
+    ScanScheduler(int fullEveryCycles = 1) {
+        Reset(fullEveryCycles);
+    }
+
+    void Reset(int fullEveryCycles) {
+        for (int i = 0; i < 256; i++) {
+            interval[i] = 1;
+            dueCycle[i] = 0;
+            lastReadCycle[i] = 0;
+            changeRate16[i] = 0;
+        }
+        cycle = 0;
+        fullEvery = (fullEveryCycles < 1) ? 1 : fullEveryCycles;
+        fullRequested = true;   // First cycle reads everything
+    }
+
+    void RequestFullSweep() { fullRequested = true; }
+    bool IsAdaptive() const { return fullEvery > 1; }
+    ULONG64 Cycle() const { return cycle; }
+
+    // Cycles until the next periodic full sweep
+    int CyclesToFullSweep() const {
+        return (int)(fullEvery - (cycle % fullEvery)) % fullEvery;
+    }
+
+    // Select the registers to read this cycle. Returns true for a full sweep.
+    bool PlanCycle(ECRegisterMask& mask) {
+        mask.Clear();
+        bool full = fullRequested || (cycle % fullEvery) == 0;
+        for (int i = 0; i < 256; i++) {
+            if (full || dueCycle[i] <= cycle) mask.Set((UCHAR)i);
+        }
+        fullRequested = false;
+        return full;
+    }
+
+    // Feed back the outcome of reading reg in the current cycle
+    void Observe(UCHAR reg, bool success, bool changed) {
+        if (!success) {
+            dueCycle[reg] = cycle + 1;  // Retry next cycle, keep the learned interval
+            return;
+        }
+
+        // The first sweep is the baseline, not a change
+        if (cycle == 0) changed = false;
+
+        lastReadCycle[reg] = cycle;
+        changeRate16[reg] += ((changed ? 65536 : 0) - changeRate16[reg]) / 8;
+
+        if (changed) {
+            interval[reg] = 1;
+        } else if (interval[reg] < SCHED_MAX_INTERVAL) {
+            interval[reg] *= 2;
+        }
+
+        // Stagger registers within their interval so static ones don't come due all at once:
+        // the next cycle c with (c + reg * 7) % interval == 0, a phase fixed per register
+        // rather than relative to the cycle it happened to be read in
+        ULONG64 next = cycle + 1;
+        dueCycle[reg] = next + (interval[reg] - (next + reg * 7) % interval[reg]) % interval[reg];
+    }
+
+    void EndCycle() { cycle++; }
+
+    // True if reg was read in the cycle that just ended (call after EndCycle)
+    bool IsFresh(UCHAR reg) const { return cycle > 0 && lastReadCycle[reg] == cycle - 1; }
+    bool IsHot(UCHAR reg) const { return interval[reg] == 1 && changeRate16[reg] > 0; }
+
+    int HotCount() const {
+        int count = 0;
+        for (int i = 0; i < 256; i++) {
+            if (IsHot((UCHAR)i)) count++;
+        }
+        return count;
+    }
+};
+
+// Full-screen console frames currently shown; output meant for the console (e.g. --trace error
+// dumps) goes to a file meanwhile instead of scribbling over the frame
+static volatile LONG g_fullScreenFrames = 0;
+
+// Off-screen console frame. Text is composed into a CHAR_INFO buffer and Present() pushes
+// only the rectangle that changed since the previous frame with a single WriteConsoleOutputA.
+// When stdout is not a console, Present() emits the frame as plain text in one write, without colors.
+class ConsoleFrame {
+private:
+    HANDLE hConsole;
+    bool isConsole;
+    bool fullScreen;            // Counted in g_fullScreenFrames
+    int cols;
+    int rows;
+    COORD origin;               // Screen-buffer position of the frame's top-left cell
+    WORD defaultAttr;
+    std::vector<CHAR_INFO> back;
+    std::vector<CHAR_INFO> front;
+    bool frontValid;            // front mirrors what is on screen
+    std::vector<char> text;     // Plain-text output buffer
+
+public:
+    ConsoleFrame(int frameCols, int frameRows) : isConsole(false), fullScreen(false), cols(frameCols), rows(frameRows),
+                                                 defaultAttr(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE),
+                                                 frontValid(false) {
+        hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(hConsole, &info)) {
+            isConsole = true;
+            defaultAttr = info.wAttributes;
+            if (cols > info.dwSize.X) cols = info.dwSize.X;
+        }
+        origin.X = 0;
+        origin.Y = 0;
+        back.resize(cols * rows);
+        front.resize(cols * rows);
+        text.reserve((cols + 2) * rows);
+        Clear();
+    }
+
+    ~ConsoleFrame() {
+        if (fullScreen) InterlockedDecrement(&g_fullScreenFrames);
+    }
+
+    bool IsConsole() const { return isConsole; }
+    int Cols() const { return cols; }
+
+    // Foreground color on the console's own background
+    WORD Color(WORD foreground) const { return (WORD)((defaultAttr & 0xF0) | foreground); }
+    WORD DefaultAttr() const { return defaultAttr; }
+
+    // Clear the whole screen buffer once (replaces system("cls")) and anchor the frame at 0,0
+    void BeginFullScreen() {
+        if (!isConsole) return;
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        GetConsoleScreenBufferInfo(hConsole, &info);
+        DWORD cells = (DWORD)info.dwSize.X * info.dwSize.Y;
+        DWORD written = 0;
+        COORD home = { 0, 0 };
+        FillConsoleOutputCharacterA(hConsole, ' ', cells, home, &written);
+        FillConsoleOutputAttribute(hConsole, defaultAttr, cells, home, &written);
+        origin = home;
+        COORD below = { 0, (short)rows };
+        SetConsoleCursorPosition(hConsole, below);
+        frontValid = false;
+        if (!fullScreen) InterlockedIncrement(&g_fullScreenFrames);
+        fullScreen = true;
+    }
+
+    // Anchor the frame at the cursor, scrolling the buffer so all rows fit
+    void BeginAtCursor() {
+        if (!isConsole) return;
+        std::vector<char> newlines(rows, '\n');
+        fwrite(newlines.data(), 1, newlines.size(), stdout);
+        fflush(stdout);
+
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        GetConsoleScreenBufferInfo(hConsole, &info);
+        origin.X = 0;
+        origin.Y = (short)(info.dwCursorPosition.Y - rows);
+        if (origin.Y < 0) origin.Y = 0;
+        frontValid = false;
+    }
+
+    void Clear() {
+        for (size_t i = 0; i < back.size(); i++) {
+            back[i].Char.AsciiChar = ' ';
+            back[i].Attributes = defaultAttr;
+        }
+    }
+
+    // printf-style text at (x, y), clipped to the frame. Returns the column after the text.
+    int Text(int x, int y, WORD attr, const char* format, ...) {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (length < 0 || y < 0 || y >= rows) return x;
+        if (length > (int)sizeof(line) - 1) length = (int)sizeof(line) - 1;
+
+        for (int i = 0; i < length && x < cols; i++, x++) {
+            if (x < 0) continue;
+            CHAR_INFO& cell = back[y * cols + x];
+            cell.Char.AsciiChar = line[i];
+            cell.Attributes = attr;
+        }
+        return x;
+    }
+
+    void Present() {
+        if (!isConsole) {
+            PresentText();
+            return;
+        }
+
+        // Damage rectangle: union of the changed span of every row
+        int left = cols, right = -1, top = rows, bottom = -1;
+        for (int y = 0; y < rows; y++) {
+            const CHAR_INFO* b = &back[y * cols];
+            const CHAR_INFO* f = &front[y * cols];
+            int first = -1, last = -1;
+            for (int x = 0; x < cols; x++) {
+                if (frontValid && b[x].Char.AsciiChar == f[x].Char.AsciiChar && b[x].Attributes == f[x].Attributes) continue;
+                if (first < 0) first = x;
+                last = x;
+            }
+            if (first < 0) continue;
+            if (first < left) left = first;
+            if (last > right) right = last;
+            if (y < top) top = y;
+            bottom = y;
+        }
+        if (bottom < 0) return;     // Nothing changed
+
+        COORD bufferSize = { (short)cols, (short)rows };
+        COORD bufferCoord = { (short)left, (short)top };
+        SMALL_RECT region = { (short)(origin.X + left), (short)(origin.Y + top),
+                              (short)(origin.X + right), (short)(origin.Y + bottom) };
+        WriteConsoleOutputA(hConsole, back.data(), bufferSize, bufferCoord, &region);
+
+        for (int y = top; y <= bottom; y++) {
+            memcpy(&front[y * cols + left], &back[y * cols + left], (right - left + 1) * sizeof(CHAR_INFO));
+        }
+        frontValid = true;
+    }
+
+    // Leave the cursor on the line below the frame
+    void End() {
+        if (!isConsole) return;
+        if (fullScreen) InterlockedDecrement(&g_fullScreenFrames);
+        fullScreen = false;
+        COORD below = { 0, (short)(origin.Y + rows) };
+        SetConsoleCursorPosition(hConsole, below);
+    }
+
+private:
+    void PresentText() {
+        // Trailing blank rows are dropped, trailing spaces are trimmed
+        int lastRow = rows - 1;
+        while (lastRow >= 0 && RowLength(lastRow) == 0) lastRow--;
+
+        text.clear();
+        for (int y = 0; y <= lastRow; y++) {
+            int length = RowLength(y);
+            for (int x = 0; x < length; x++) text.push_back(back[y * cols + x].Char.AsciiChar);
+            text.push_back('\n');
+        }
+        fwrite(text.data(), 1, text.size(), stdout);
+        fflush(stdout);
+    }
+
+    int RowLength(int y) const {
+        int length = cols;
+        while (length > 0 && back[y * cols + length - 1].Char.AsciiChar == ' ') length--;
+        return length;
+    }
+};
+
+// Keys collected for a renderer between frames. Extended keys (arrows, PgUp...) are
+// stored as KEY_EXTENDED | scan code.
+#define KEY_EXTENDED              0x100
+#define KEY_UP                    (KEY_EXTENDED | 72)
+#define KEY_DOWN                  (KEY_EXTENDED | 80)
+#define KEY_LEFT                  (KEY_EXTENDED | 75)
+#define KEY_RIGHT                 (KEY_EXTENDED | 77)
+#define CONSOLE_KEYS_MAX          16
+
+struct ConsoleKeys {
+    int keys[CONSOLE_KEYS_MAX];
+    int count;
+
+    ConsoleKeys() : count(0) {}
+
+    void Add(int key) {
+        if (count < CONSOLE_KEYS_MAX) keys[count++] = key;
+    }
+};
+
+// Drain pending console keys; extended keys (arrows, PgUp) come back as KEY_EXTENDED | code
+static void ReadConsoleKeys(ConsoleKeys& keys) {
+    while (_kbhit()) {
+        int key = _getch();
+        if (key == 0 || key == 0xE0) key = KEY_EXTENDED | _getch();
+        keys.Add(key);
+    }
+}
+
+// Grid column header for 16x16 views, at row y
+static void DrawGridHeader(ConsoleFrame& frame, int y, bool useDecimal) {
+    int x = frame.Text(0, y, frame.DefaultAttr(), "     ");
+    for (int col = 0; col < 16; col++) {
+        x = frame.Text(x, y, frame.DefaultAttr(), useDecimal ? "+%2X " : "+%X ", col);
+    }
+}
+
+// Column of a grid cell (after the "X0:  " row label)
+static int GridCellX(int col, bool useDecimal) {
+    return 5 + col * (useDecimal ? 4 : 3);
+}
+
+// 16x16 register grid (column header at row y, rows below it).
+// Red = differs from 'displayed', cyan = in 'stale' (not re-read), green = non-zero, gray = zero.
+// With 'heat' (levels 0-3 per register) cells are colored by level instead; 'selected' is
+// drawn inverted.
+static void DrawRegisterGrid(ConsoleFrame& frame, int y, const UCHAR* values, const UCHAR* displayed,
+                             const ECRegisterMask* stale, bool useDecimal,
+                             const UCHAR* heat = NULL, int selected = -1) {
+    WORD text = frame.DefaultAttr();
+    DrawGridHeader(frame, y, useDecimal);
+
+    for (int row = 0; row < 16; row++) {
+        int rowY = y + 1 + row;
+        frame.Text(0, rowY, text, "%X0:  ", row);
+
+        for (int col = 0; col < 16; col++) {
+            int index = row * 16 + col;
+            UCHAR value = values[index];
+            WORD attr;
+
+            if (heat != NULL) {
+                static const WORD heatColors[4] = {
+                    FOREGROUND_INTENSITY,                                       // Static
+                    FOREGROUND_GREEN | FOREGROUND_BLUE,                         // Cyan
+                    FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY,   // Yellow
+                    FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY     // Magenta
+                };
+                attr = frame.Color(heatColors[heat[index] & 3]);
+            } else if (value != displayed[index]) {
+                // Red for changed values
+                attr = frame.Color(FOREGROUND_RED | FOREGROUND_INTENSITY);
+            } else if (value != 0 && stale != NULL && stale->Test((UCHAR)index)) {
+                // Cyan for values carried over from an earlier scan
+                attr = frame.Color(FOREGROUND_GREEN | FOREGROUND_BLUE);
+            } else if (value != 0) {
+                // Green for non-zero unchanged values
+                attr = frame.Color(FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            } else {
+                // Dark gray for zero values
+                attr = frame.Color(FOREGROUND_INTENSITY);
+            }
+            if (index == selected) {
+                attr = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY | BACKGROUND_BLUE;
+            }
+
+            frame.Text(GridCellX(col, useDecimal), rowY, attr, useDecimal ? "%3d" : "%02X", value);
+        }
+    }
+}
+
+// Simulated EC latency distributions
+enum SimLatencyDist {
+    SIM_DIST_FIXED,     // Always the mean
+    SIM_DIST_UNIFORM,   // Uniform in [0, 2 * mean]
+    SIM_DIST_EXP        // Exponential with the given mean
+};
+
+// Simulated EC timing model, parsed from --sim-config "key=value,..."
+struct SimConfig {
+    int ioctlUs;            // Cost of one port access (user/kernel round trip)
+    int ibfUs;              // Mean time for IBF to clear after a write
+    int obfUs;              // Mean time for OBF to set after the address write
+    SimLatencyDist dist;
+    double stallRate;       // Probability a read transaction stalls
+    int stallUs;            // Extra OBF delay of a stall
+    double busyRate;        // Probability the EC is busy with another host at command time
+    int busyUs;             // Extra IBF delay while busy
+    bool burst;             // Firmware honors burst mode
+    int burstUs;            // Mean IBF/OBF latency while in burst mode
+    int peerMs;             // Another EC client takes the lock every peerMs (0 = none)
+    int peerUs;             // ... and holds it this long
+    ECRegisterMask dead;    // Registers the EC never answers (OBF stays clear)
+    double wedgeAt;         // The whole EC stops answering (IBF stuck) this many seconds after open
+    double wedgeFor;        // ... for this long (0 = never wedges)
+    ULONG64 seed;
+
+    SimConfig() : ioctlUs(SIM_DEFAULT_IOCTL_US), ibfUs(SIM_DEFAULT_IBF_US), obfUs(SIM_DEFAULT_OBF_US),
+                  dist(SIM_DIST_EXP), stallRate(SIM_DEFAULT_STALL_RATE), stallUs(SIM_DEFAULT_STALL_US),
+                  busyRate(SIM_DEFAULT_BUSY_RATE), busyUs(SIM_DEFAULT_BUSY_US),
+                  burst(true), burstUs(SIM_DEFAULT_BURST_US),
+                  peerMs(0), peerUs(SIM_DEFAULT_PEER_US), wedgeAt(0.0), wedgeFor(0.0), seed(1) {}
+
+    bool Parse(const char* spec) {
+        char buffer[256];
+        strncpy_s(buffer, sizeof(buffer), spec, _TRUNCATE);
+
+        char* context = NULL;
+        for (char* entry = strtok_s(buffer, ",", &context); entry != NULL; entry = strtok_s(NULL, ",", &context)) {
+            char* eq = strchr(entry, '=');
+            if (eq == NULL) {
+                printf("Error: invalid --sim-config entry '%s' (expected key=value)\n", entry);
+                return false;
+            }
+            *eq = '\0';
+            const char* key = entry;
+            const char* value = eq + 1;
+
+            if (strcmp(key, "ioctl") == 0) ioctlUs = atoi(value);
+            else if (strcmp(key, "ibf") == 0) ibfUs = atoi(value);
+            else if (strcmp(key, "obf") == 0) obfUs = atoi(value);
+            else if (strcmp(key, "stall") == 0) stallRate = atof(value);
+            else if (strcmp(key, "stallus") == 0) stallUs = atoi(value);
+            else if (strcmp(key, "busy") == 0) busyRate = atof(value);
+            else if (strcmp(key, "busyus") == 0) busyUs = atoi(value);
+            else if (strcmp(key, "burst") == 0) burst = atoi(value) != 0;
+            else if (strcmp(key, "burstus") == 0) burstUs = atoi(value);
+            else if (strcmp(key, "peer") == 0) peerMs = atoi(value);
+            else if (strcmp(key, "peerus") == 0) peerUs = atoi(value);
+            else if (strcmp(key, "dead") == 0) dead.Set((UCHAR)strtoul(value, NULL, 16));
+            else if (strcmp(key, "wedge") == 0) wedgeAt = atof(value);
+            else if (strcmp(key, "wedgefor") == 0) wedgeFor = atof(value);
+            else if (strcmp(key, "seed") == 0) seed = _strtoui64(value, NULL, 10);
+            else if (strcmp(key, "dist") == 0) {
+                if (strcmp(value, "fixed") == 0) dist = SIM_DIST_FIXED;
+                else if (strcmp(value, "uniform") == 0) dist = SIM_DIST_UNIFORM;
+                else if (strcmp(value, "exp") == 0) dist = SIM_DIST_EXP;
+                else {
+                    printf("Error: unknown --sim-config dist '%s' (fixed|uniform|exp)\n", value);
+                    return false;
+                }
+            }
+            else {
+                printf("Error: unknown --sim-config key '%s'\n", key);
+                return false;
+            }
+        }
+
+        if (ioctlUs < 0 || ibfUs < 0 || obfUs < 0 || stallUs < 0 || busyUs < 0 || burstUs < 0 || peerMs < 0 || peerUs < 0 ||
+            wedgeAt < 0.0 || wedgeFor < 0.0) {
+            printf("Error: --sim-config latencies must be non-negative\n");
+            return false;
+        }
+        if (seed == 0) seed = 1;
+        return true;
+    }
+};
+
+// Offline backend: models the ACPI EC handshake (IBF/OBF timing, stalls, contention)
+// and a register file with a few live signals, so scans can be profiled without the driver.
+class SimulatedTransport : public ECTransport {
+private:
+    enum SimState {
+        SIM_IDLE,           // No transaction in progress
+        SIM_WAIT_ADDRESS,   // Read command accepted, waiting for the address byte
+        SIM_DATA_PENDING    // Address accepted, data arrives at obfSetAt
+    };
+
+    SimConfig config;
+    USHORT dataPort;        // Port pair this EC answers on (--channel)
+    USHORT cmdPort;
+    ULONG64 rngState;
+    LONGLONG openTime;
+    SimState state;
+    LONGLONG ibfClearAt;    // QPC tick at which IBF clears (0 = clear)
+    LONGLONG obfSetAt;      // QPC tick at which OBF sets (0 = no data pending)
+    bool inBurst;
+    LONGLONG lastAccess;    // QPC tick of the last host port access (burst idle timeout)
+    UCHAR dataLatch;
+    UCHAR ram[256];
+    std::vector<UCHAR> xram;    // Extended RAM behind the ENE index/data ports
+    USHORT xramAddress;
+
+    // Simulated peer EC client (fan service, HWiNFO) contending for the lock
+    HANDLE hPeerLock;
+    HANDLE hPeerThread;
+    HANDLE hPeerStop;
+    LatencyHistogram peerWait;  // How long the peer waited for us to release the lock
+
+    static DWORD WINAPI PeerThreadProc(LPVOID param) {
+        SimulatedTransport* sim = (SimulatedTransport*)param;
+        while (WaitForSingleObject(sim->hPeerStop, sim->config.peerMs) == WAIT_TIMEOUT) {
+            LONGLONG waitStart = QpcNow();
+            WaitForSingleObject(sim->hPeerLock, INFINITE);
+            LONGLONG holdStart = QpcNow();
+            sim->peerWait.Record(QpcToMicros(holdStart - waitStart));
+            while (QpcToMicros(QpcNow() - holdStart) < (ULONG64)sim->config.peerUs) Sleep(0);
+            ReleaseMutex(sim->hPeerLock);
+        }
+        return 0;
+    }
+
+    ULONG64 NextRandom() {
+        // xorshift64
+        rngState ^= rngState << 13;
+        rngState ^= rngState >> 7;
+        rngState ^= rngState << 17;
+        return rngState;
+    }
+
+    double NextUniform() {
+        return (double)(NextRandom() >> 11) / 9007199254740992.0;   // [0, 1)
+    }
+
+    LONGLONG SampleTicks(int meanUs) {
+        double us = meanUs;
+        if (config.dist == SIM_DIST_UNIFORM) {
+            us = NextUniform() * 2.0 * meanUs;
+        } else if (config.dist == SIM_DIST_EXP) {
+            us = -log(1.0 - NextUniform()) * meanUs;
+        }
+        return (LONGLONG)(us * QpcFrequency() / 1000000.0);
+    }
+
+    // Model the user/kernel round trip of a real port access
+    void ChargeAccess() {
+        if (config.ioctlUs <= 0) return;
+        LONGLONG until = QpcNow() + (LONGLONG)config.ioctlUs * QpcFrequency() / 1000000;
+        while (QpcNow() < until) {
+            YieldProcessor();
+        }
+    }
+
+    // Firmware drops out of burst mode when the host goes quiet, as the ACPI spec allows
+    void TrackBurstIdle(LONGLONG now) {
+        if (inBurst && now - lastAccess > (LONGLONG)SIM_BURST_IDLE_US * QpcFrequency() / 1000000) {
+            inBurst = false;
+        }
+        lastAccess = now;
+    }
+
+    // Handshake latency: burst mode keeps the EC on the host, so no contention either
+    LONGLONG HandshakeTicks(int meanUs) {
+        return SampleTicks(inBurst ? config.burstUs : meanUs);
+    }
+
+    bool Wedged(LONGLONG when) const {
+        if (config.wedgeFor <= 0.0) return false;
+        double t = (double)(when - openTime) / (double)QpcFrequency();
+        return t >= config.wedgeAt && t < config.wedgeAt + config.wedgeFor;
+    }
+
+    // Register contents at a given time: static background plus a few live signals
+    UCHAR RegisterValue(UCHAR reg, LONGLONG when) {
+        double t = (double)(when - openTime) / (double)QpcFrequency();
+        switch (reg) {
+            case SIM_REG_HEARTBEAT:   return (UCHAR)(ULONG64)t;
+            case SIM_REG_CPU_TEMP:    return (UCHAR)(55.0 + 20.0 * sin((t - SIM_THERMAL_LAG_S) / 30.0) + 2.0 * sin(t * 1.7));
+            case SIM_REG_GPU_TEMP:    return (UCHAR)(45.0 + 10.0 * sin(t / 45.0));
+            case SIM_REG_FAN_LO:
+            case SIM_REG_FAN_HI: {
+                USHORT rpm = (USHORT)(2600.0 + 1400.0 * sin(t / 20.0));
+                return (reg == SIM_REG_FAN_LO) ? (UCHAR)(rpm & 0xFF) : (UCHAR)(rpm >> 8);
+            }
+            default:                  return ram[reg];
+        }
+    }
+
+    UCHAR ExtendedValue(USHORT address, LONGLONG when) {
+        double t = (double)(when - openTime) / (double)QpcFrequency();
+        USHORT mv = (USHORT)(12600.0 - t * 2.0);
+        switch (address) {
+            case SIM_XRAM_BATTERY_MV:     return (UCHAR)(mv & 0xFF);
+            case SIM_XRAM_BATTERY_MV + 1: return (UCHAR)(mv >> 8);
+            case SIM_XRAM_BATTERY_PCT:    return (UCHAR)(100.0 - t / 36.0);
+            case SIM_XRAM_HEARTBEAT:      return (UCHAR)(ULONG64)t;
+            default:                      return xram[address];
+        }
+    }
+
+public:
+    SimulatedTransport() : dataPort(EC_DATA_PORT), cmdPort(EC_CMD_PORT), rngState(1), openTime(0), state(SIM_IDLE), ibfClearAt(0), obfSetAt(0),
+                           inBurst(false), lastAccess(0), dataLatch(0xFF),
+                           xram(XRAM_SPACE_SIZE), xramAddress(0), hPeerLock(NULL), hPeerThread(NULL), hPeerStop(NULL) {
+        memset(ram, 0, sizeof(ram));
+    }
+
+    ~SimulatedTransport() {
+        Close();
+    }
+
+    void Configure(const SimConfig& newConfig) {
+        config = newConfig;
+    }
+
+    void SetPorts(USHORT data, USHORT cmd) {
+        dataPort = data;
+        cmdPort = cmd;
+    }
+
+    const char* Name() const { return "simulated"; }
+    bool UsesSystemMutex() const { return false; }
+    const char* PrivateLockName() const { return (hPeerLock != NULL) ? SIM_PEER_LOCK_NAME : NULL; }
+
+    void PrintStatistics() const {
+        if (config.peerMs == 0) return;
+        printf("Simulated peer:   lock every %d ms for %d us\n", config.peerMs, config.peerUs);
+        PrintHistogramLine("  Peer lock wait:", peerWait, "us");
+    }
+
+    // Simulated host CPU load (%) driving the CPU temperature register, for correlate --signal sim
+    double HostLoad(LONGLONG when) const {
+        double t = (double)(when - openTime) / (double)QpcFrequency();
+        return 50.0 + 45.0 * sin(t / 30.0) + 4.0 * sin(t * 0.9);
+    }
+
+    bool Open() {
+        rngState = config.seed;
+        openTime = QpcNow();
+        state = SIM_IDLE;
+        ibfClearAt = 0;
+        obfSetAt = 0;
+        inBurst = false;
+        lastAccess = openTime;
+
+        // Mostly-zero static background, like a real EC RAM dump
+        for (int i = 0; i < 256; i++) {
+            ULONG64 r = NextRandom();
+            ram[i] = ((r & 3) == 0) ? (UCHAR)(r >> 8) : 0;
+        }
+
+        // Extended RAM: mostly empty, with a few populated pages (tables, battery block)
+        for (int page = 0; page < XRAM_PAGES; page++) {
+            bool populated = (NextRandom() % 16) == 0 || page == (SIM_XRAM_BATTERY_MV >> 8);
+            for (int i = 0; i < XRAM_PAGE_SIZE; i++) {
+                ULONG64 r = populated ? NextRandom() : 0;
+                xram[page * XRAM_PAGE_SIZE + i] = ((r & 1) != 0) ? (UCHAR)(r >> 8) : 0;
+            }
+        }
+
+        if (verboseMode) {
+            printf("[Verbose] Simulated EC: ioctl=%dus ibf=%dus obf=%dus stall=%.4f/%dus busy=%.4f/%dus burst=%s/%dus\n",
+                   config.ioctlUs, config.ibfUs, config.obfUs, config.stallRate, config.stallUs,
+                   config.busyRate, config.busyUs, config.burst ? "on" : "off", config.burstUs);
+        }
+
+        if (config.peerMs > 0) {
+            peerWait.Reset();
+            hPeerLock = CreateMutexA(NULL, FALSE, SIM_PEER_LOCK_NAME);
+            hPeerStop = CreateEventA(NULL, TRUE, FALSE, NULL);
+            if (hPeerLock == NULL || hPeerStop == NULL ||
+                (hPeerThread = CreateThread(NULL, 0, PeerThreadProc, this, 0, NULL)) == NULL) {
+                printf("Error: Failed to start the simulated peer (Error: %lu)\n", GetLastError());
+                Close();
+                return false;
+            }
+            if (verboseMode) printf("[Verbose] Simulated peer takes the lock every %d ms for %d us\n", config.peerMs, config.peerUs);
+        }
+        return true;
+    }
+
+    void Close() {
+        if (hPeerThread != NULL) {
+            SetEvent(hPeerStop);
+            WaitForSingleObject(hPeerThread, INFINITE);
+            CloseHandle(hPeerThread);
+            hPeerThread = NULL;
+        }
+        if (hPeerStop != NULL) {
+            CloseHandle(hPeerStop);
+            hPeerStop = NULL;
+        }
+        if (hPeerLock != NULL) {
+            CloseHandle(hPeerLock);
+            hPeerLock = NULL;
+        }
+    }
+
+    bool PortRead(USHORT port, UCHAR* value) {
+        ChargeAccess();
+        LONGLONG now = QpcNow();
+        TrackBurstIdle(now);
+
+        if (port == cmdPort) {
+            UCHAR status = 0;
+            if (now < ibfClearAt || Wedged(now)) status |= EC_IBF;
+            if (state == SIM_DATA_PENDING && now >= obfSetAt) status |= EC_OBF;
+            if (inBurst) status |= EC_BURST;
+            *value = status;
+            return true;
+        }
+
+        if (port == XRAM_ENE_DATA) {
+            *value = ExtendedValue(xramAddress, now);
+            return true;
+        }
+        if (port == XRAM_ENE_ADDR_HI || port == XRAM_ENE_ADDR_LO) {
+            *value = (port == XRAM_ENE_ADDR_HI) ? (UCHAR)(xramAddress >> 8) : (UCHAR)xramAddress;
+            return true;
+        }
+
+        if (port == dataPort) {
+            // Reading the data port consumes OBF; without OBF the latch is stale
+            if (state == SIM_DATA_PENDING && now >= obfSetAt) {
+                state = SIM_IDLE;
+                obfSetAt = 0;
+            }
+            *value = dataLatch;
+            return true;
+        }
+
+        *value = 0xFF;
+        return true;
+    }
+
+    bool PortWrite(USHORT port, UCHAR value) {
+        ChargeAccess();
+        LONGLONG now = QpcNow();
+        TrackBurstIdle(now);
+
+        // Index ports of the extended RAM window latch immediately
+        if (port == XRAM_ENE_ADDR_HI) {
+            xramAddress = (USHORT)((value << 8) | (xramAddress & 0xFF));
+            return true;
+        }
+        if (port == XRAM_ENE_ADDR_LO) {
+            xramAddress = (USHORT)((xramAddress & 0xFF00) | value);
+            return true;
+        }
+
+        // Writes while IBF is still set are lost, as on real hardware
+        if (now < ibfClearAt || Wedged(now)) return true;
+
+        if (port == cmdPort) {
+            LONGLONG delay = HandshakeTicks(config.ibfUs);
+            if (!inBurst && NextUniform() < config.busyRate) {
+                delay += (LONGLONG)config.busyUs * QpcFrequency() / 1000000;
+            }
+            ibfClearAt = now + delay;
+            state = (value == 0x80) ? SIM_WAIT_ADDRESS : SIM_IDLE;
+            obfSetAt = 0;
+
+            if (value == EC_CMD_BURST_ENABLE && config.burst) {
+                // Acknowledge through OBF; firmware without burst support ignores the command
+                inBurst = true;
+                dataLatch = EC_BURST_ACK;
+                obfSetAt = ibfClearAt + HandshakeTicks(config.obfUs);
+                state = SIM_DATA_PENDING;
+            } else if (value == EC_CMD_BURST_DISABLE) {
+                inBurst = false;
+            }
+            return true;
+        }
+
+        if (port == dataPort && state == SIM_WAIT_ADDRESS) {
+            ibfClearAt = now + HandshakeTicks(config.ibfUs);
+            if (config.dead.Test(value)) {
+                state = SIM_IDLE;       // Address accepted, data never comes
+                return true;
+            }
+            obfSetAt = ibfClearAt + HandshakeTicks(config.obfUs);
+            if (NextUniform() < config.stallRate) {
+                obfSetAt += (LONGLONG)config.stallUs * QpcFrequency() / 1000000;
+            }
+            dataLatch = RegisterValue(value, obfSetAt);
+            state = SIM_DATA_PENDING;
+        }
+        return true;
+    }
+};
+
+// Per-scan latency summary carried with each snapshot (phase histograms stay on the acquisition thread)
+struct ScanSummary {
+    ULONG64 readP50;
+    ULONG64 readP99;
+    ULONG64 ioctlP50;
+    ULONG64 ioctlP99;
+    ULONG64 mutexMax;
+    ULONG64 obfPollsP50;
+    ULONG64 obfPollsP99;
+};
+
+// Rolling statistics of one register over its last STATS_WINDOW samples, carried with each snapshot
+struct RegisterStatsSummary {
+    USHORT samples;
+    USHORT changes;             // Sample-to-sample changes inside the window
+    UCHAR minValue;
+    UCHAR maxValue;
+    float mean;
+    float stddev;
+    float spanSeconds;          // Oldest to newest sample
+    LONGLONG lastChangeQpc;     // 0 = no change seen
+};
+
+// Fixed-size sample ring of one register with running sums and monotonic min/max queues,
+// so adding a sample (and evicting the oldest) is O(1) amortized and never allocates.
+class RegisterWindow {
+private:
+    UCHAR values[STATS_WINDOW];
+    LONGLONG sampleQpc[STATS_WINDOW];
+    ULONG minQueue[STATS_WINDOW];   // Sample numbers with increasing values (front = min)
+    ULONG maxQueue[STATS_WINDOW];   // ... decreasing values (front = max)
+    int minHead, minCount;
+    int maxHead, maxCount;
+    ULONG total;                    // Samples ever added; sample n lives in slot n % STATS_WINDOW
+    int count;
+    LONG sum;
+    LONG64 sumSquares;
+    int changes;
+    LONGLONG lastChangeQpc;
+
+    UCHAR ValueOf(ULONG sample) const { return values[sample % STATS_WINDOW]; }
+
+public:
+    RegisterWindow() {
+        Reset();
+    }
+
+    void Reset() {
+        minHead = minCount = maxHead = maxCount = 0;
+        total = 0;
+        count = 0;
+        sum = 0;
+        sumSquares = 0;
+        changes = 0;
+        lastChangeQpc = 0;
+    }
+
+    void Add(UCHAR value, LONGLONG qpc) {
+        ULONG sample = total++;
+
+        // Evict the oldest sample, and the change between it and its successor
+        if (count == STATS_WINDOW) {
+            ULONG oldest = sample - STATS_WINDOW;
+            UCHAR old = ValueOf(oldest);
+            sum -= old;
+            sumSquares -= (LONG)old * old;
+            if (old != ValueOf(oldest + 1)) changes--;
+            if (minCount > 0 && minQueue[minHead] == oldest) {
+                minHead = (minHead + 1) % STATS_WINDOW;
+                minCount--;
+            }
+            if (maxCount > 0 && maxQueue[maxHead] == oldest) {
+                maxHead = (maxHead + 1) % STATS_WINDOW;
+                maxCount--;
+            }
+        } else {
+            count++;
+        }
+
+        if (sample > 0 && ValueOf(sample - 1) != value) {
+            changes++;
+            lastChangeQpc = qpc;
+        }
+        values[sample % STATS_WINDOW] = value;
+        sampleQpc[sample % STATS_WINDOW] = qpc;
+        sum += value;
+        sumSquares += (LONG)value * value;
+
+        while (minCount > 0 && ValueOf(minQueue[(minHead + minCount - 1) % STATS_WINDOW]) >= value) minCount--;
+        minQueue[(minHead + minCount++) % STATS_WINDOW] = sample;
+        while (maxCount > 0 && ValueOf(maxQueue[(maxHead + maxCount - 1) % STATS_WINDOW]) <= value) maxCount--;
+        maxQueue[(maxHead + maxCount++) % STATS_WINDOW] = sample;
+    }
+
+    void Summarize(RegisterStatsSummary& out) const {
+        out.samples = (USHORT)count;
+        out.changes = (USHORT)changes;
+        out.lastChangeQpc = lastChangeQpc;
+        if (count == 0) {
+            out.minValue = out.maxValue = 0;
+            out.mean = out.stddev = out.spanSeconds = 0.0f;
+            return;
+        }
+        out.minValue = ValueOf(minQueue[minHead]);
+        out.maxValue = ValueOf(maxQueue[maxHead]);
+        double mean = (double)sum / count;
+        double variance = (double)sumSquares / count - mean * mean;
+        out.mean = (float)mean;
+        out.stddev = (float)sqrt(variance > 0.0 ? variance : 0.0);
+        LONGLONG oldestQpc = sampleQpc[(total - count) % STATS_WINDOW];
+        out.spanSeconds = (float)(QpcToMs(sampleQpc[(total - 1) % STATS_WINDOW] - oldestQpc) / 1000.0);
+    }
+};
+
+// Monitor heat map coloring (H cycles through them)
+enum MonitorHeat {
+    HEAT_OFF,       // Change highlighting
+    HEAT_CHANGES,   // Share of samples that changed
+    HEAT_SPREAD,    // Standard deviation
+    HEAT_MODES
+};
+
+// Heat level 0-3 of one register under the given mode
+static UCHAR HeatLevel(const RegisterStatsSummary& stats, int mode) {
+    if (mode == HEAT_CHANGES) {
+        if (stats.samples < 2 || stats.changes == 0) return 0;
+        double share = (double)stats.changes / (stats.samples - 1);
+        return (share < 0.1) ? 1 : (share < 0.5) ? 2 : 3;
+    }
+    if (stats.stddev <= 0.0f) return 0;
+    return (stats.stddev < 1.0f) ? 1 : (stats.stddev < 8.0f) ? 2 : 3;
+}
+
+// Host-side signal that correlate mode samples once per scan
+class HostSignal {
+public:
+    virtual ~HostSignal() {}
+    virtual bool Open() = 0;
+    virtual void Close() {}
+    // Take a sample now. False if no value is available; the scan is then not paired.
+    virtual bool Sample(double* value) = 0;
+    virtual const char* Name() const = 0;
+    virtual const char* Unit() const = 0;
+};
+
+// Performance counter through PDH. Wildcard counters ("(*)") are reduced to one value per
+// sample: the instance whose name contains 'prefer' if there is one, else the maximum.
+class PdhSignal : public HostSignal {
+private:
+    PDH_HQUERY query;
+    PDH_HCOUNTER counter;
+    char path[512];
+    const char* name;
+    const char* unit;
+    double scale;               // Reported value = counter * scale + offset
+    double offset;
+    const char* prefer;
+    std::vector<BYTE> items;    // Formatted counter array, grown on demand and reused
+
+public:
+    PdhSignal() : query(NULL), counter(NULL), name(""), unit(""), scale(1.0), offset(0.0), prefer(NULL) {
+        path[0] = '\0';
+    }
+
+    ~PdhSignal() {
+        Close();
+    }
+
+    // cpu | thermal | power | pdh:<English counter path>
+    bool Configure(const char* spec) {
+        if (strcmp(spec, "cpu") == 0) {
+            strcpy(path, "\\Processor(_Total)\\% Processor Time");
+            name = "CPU utilization";
+            unit = "%";
+        } else if (strcmp(spec, "thermal") == 0) {
+            strcpy(path, "\\Thermal Zone Information(*)\\Temperature");
+            name = "ACPI thermal zone (hottest)";
+            unit = "C";
+            offset = -273.15;   // Reported in Kelvin
+        } else if (strcmp(spec, "power") == 0) {
+            strcpy(path, "\\Energy Meter(*)\\Power");
+            name = "Package power";
+            unit = "W";
+            scale = 0.001;      // Reported in milliwatts
+            prefer = "PKG";     // RAPL_Package0_PKG
+        } else if (strncmp(spec, "pdh:", 4) == 0 && spec[4] != '\0' && strlen(spec + 4) < sizeof(path)) {
+            strcpy(path, spec + 4);
+            name = path;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    const char* Name() const { return name; }
+    const char* Unit() const { return unit; }
+
+    bool Open() {
+        PDH_STATUS status = PdhOpenQueryA(NULL, 0, &query);
+        if (status != ERROR_SUCCESS) {
+            printf("Error: PdhOpenQuery failed (0x%08lX)\n", (unsigned long)status);
+            query = NULL;
+            return false;
+        }
+        status = PdhAddEnglishCounterA(query, path, 0, &counter);
+        if (status != ERROR_SUCCESS) {
+            printf("Error: Performance counter %s is not available (0x%08lX)\n", path, (unsigned long)status);
+            Close();
+            return false;
+        }
+        PdhCollectQueryData(query);     // Rate counters need a first sample to difference against
+        return true;
+    }
+
+    void Close() {
+        if (query != NULL) {
+            PdhCloseQuery(query);
+            query = NULL;
+            counter = NULL;
+        }
+    }
+
+    bool Sample(double* value) {
+        if (PdhCollectQueryData(query) != ERROR_SUCCESS) return false;
+
+        if (strchr(path, '*') == NULL) {
+            PDH_FMT_COUNTERVALUE v;
+            if (PdhGetFormattedCounterValue(counter, PDH_FMT_DOUBLE, NULL, &v) != ERROR_SUCCESS) return false;
+            *value = v.doubleValue * scale + offset;
+            return true;
+        }
+
+        DWORD bytes = (DWORD)items.size();
+        DWORD count = 0;
+        PDH_STATUS status = PdhGetFormattedCounterArrayA(counter, PDH_FMT_DOUBLE, &bytes, &count,
+                                                         items.empty() ? NULL : (PPDH_FMT_COUNTERVALUE_ITEM_A)items.data());
+        if (status == PDH_MORE_DATA) {
+            items.resize(bytes);
+            status = PdhGetFormattedCounterArrayA(counter, PDH_FMT_DOUBLE, &bytes, &count,
+                                                  (PPDH_FMT_COUNTERVALUE_ITEM_A)items.data());
+        }
+        if (status != ERROR_SUCCESS) return false;
+
+        const PDH_FMT_COUNTERVALUE_ITEM_A* item = (const PDH_FMT_COUNTERVALUE_ITEM_A*)items.data();
+        bool found = false;
+        for (DWORD i = 0; i < count; i++) {
+            if (item[i].FmtValue.CStatus != PDH_CSTATUS_VALID_DATA && item[i].FmtValue.CStatus != PDH_CSTATUS_NEW_DATA) continue;
+            double v = item[i].FmtValue.doubleValue;
+            if (prefer != NULL && strstr(item[i].szName, prefer) != NULL) {
+                *value = v * scale + offset;
+                return true;
+            }
+            if (!found || v * scale + offset > *value) *value = v * scale + offset;
+            found = true;
+        }
+        return found;
+    }
+};
+
+// Host load of the simulated EC (--sim), which the simulated CPU temperature follows
+class SimHostSignal : public HostSignal {
+private:
+    const SimulatedTransport* sim;
+
+public:
+    SimHostSignal(const SimulatedTransport* simTransport) : sim(simTransport) {}
+
+    bool Open() { return true; }
+    bool Sample(double* value) {
+        *value = sim->HostLoad(QpcNow());
+        return true;
+    }
+    const char* Name() const { return "simulated CPU load"; }
+    const char* Unit() const { return "%"; }
+};
+
+struct CorrelationResult {
+    UCHAR reg;
+    int lag;                    // Scans the register trails the signal
+    double r;                   // Pearson coefficient at that lag
+    int pairs;
+};
+
+// Pearson correlation of every tracked register with a host signal over the last 'window'
+// scans, at lags 0..maxLag (register sample n paired with signal sample n - lag). Per lag and
+// register it keeps running sums that are updated as pairs enter and leave the window, so a
+// sample costs O(registers x lags) and a coefficient O(1). Signal samples are stored relative
+// to the first one, which keeps the sums of squares from cancelling on large, slow values.
+class CorrelationTracker {
+private:
+    int window;
+    int lags;                   // maxLag + 1
+    int signalSlots;            // window + maxLag + 1: the oldest sample still paired at maxLag
+    ULONG64 total;              // Samples ever added; sample n lives in slot n % ring size
+    double origin;
+    ECRegisterMask tracked;
+    std::vector<double> signal;
+    std::vector<UCHAR> history;         // [reg * window + slot]
+    std::vector<int> pairs;             // Per lag
+    std::vector<double> sx, sxx;
+    std::vector<double> sy, syy, sxy;   // [reg * lags + lag]
+    std::vector<double> xIn, xOut;      // Per-sample scratch: signal entering / leaving each lag
+
+public:
+    CorrelationTracker(int windowScans, int maxLag, const ECRegisterMask& regs)
+        : window(windowScans), lags(maxLag + 1), signalSlots(windowScans + maxLag + 1), total(0), origin(0.0),
+          tracked(regs), signal(signalSlots, 0.0), history(256 * windowScans, 0), pairs(lags, 0),
+          sx(lags, 0.0), sxx(lags, 0.0), sy(256 * lags, 0.0), syy(256 * lags, 0.0), sxy(256 * lags, 0.0),
+          xIn(lags, 0.0), xOut(lags, 0.0) {}
+
+    ULONG64 Samples() const { return total; }
+    int Pairs(int lag) const { return pairs[lag]; }
+
+    void Add(double x, const UCHAR* values) {
+        ULONG64 t = total++;
+        if (t == 0) origin = x;
+        signal[t % signalSlots] = x - origin;
+
+        // Pair (signal t - lag, register t) enters; the one added 'window' samples ago leaves
+        for (int k = 0; k < lags; k++) {
+            xIn[k] = (t >= (ULONG64)k) ? signal[(t - k) % signalSlots] : 0.0;
+            xOut[k] = (t >= (ULONG64)(window + k)) ? signal[(t - window - k) % signalSlots] : 0.0;
+            if (t >= (ULONG64)k) {
+                pairs[k]++;
+                sx[k] += xIn[k];
+                sxx[k] += xIn[k] * xIn[k];
+            }
+            if (t >= (ULONG64)(window + k)) {
+                pairs[k]--;
+                sx[k] -= xOut[k];
+                sxx[k] -= xOut[k] * xOut[k];
+            }
+        }
+
+        int slot = (int)(t % window);
+        for (int reg = 0; reg < 256; reg++) {
+            if (!tracked.Test((UCHAR)reg)) continue;
+            double y = values[reg];
+            double yOld = history[reg * window + slot];
+            history[reg * window + slot] = values[reg];
+            double* rsy = &sy[reg * lags];
+            double* rsyy = &syy[reg * lags];
+            double* rsxy = &sxy[reg * lags];
+            for (int k = 0; k < lags; k++) {
+                if (t >= (ULONG64)k) {
+                    rsy[k] += y;
+                    rsyy[k] += y * y;
+                    rsxy[k] += xIn[k] * y;
+                }
+                if (t >= (ULONG64)(window + k)) {
+                    rsy[k] -= yOld;
+                    rsyy[k] -= yOld * yOld;
+                    rsxy[k] -= xOut[k] * yOld;
+                }
+            }
+        }
+    }
+
+    // False while the pairs are too few or either side is constant
+    bool Coefficient(int reg, int lag, double* r) const {
+        int n = pairs[lag];
+        if (n < CORRELATE_MIN_PAIRS) return false;
+        int i = reg * lags + lag;
+        double vx = n * sxx[lag] - sx[lag] * sx[lag];
+        double vy = n * syy[i] - sy[i] * sy[i];
+        if (vx <= 1e-9 * n * sxx[lag] || vy < 0.5) return false;   // Register values are integers
+        *r = (n * sxy[i] - sx[lag] * sy[i]) / sqrt(vx * vy);
+        return true;
+    }
+
+    // Strongest coefficient of one register over all lags
+    bool Best(int reg, CorrelationResult& out) const {
+        bool found = false;
+        for (int k = 0; k < lags; k++) {
+            double r;
+            if (!Coefficient(reg, k, &r)) continue;
+            if (!found || fabs(r) > fabs(out.r)) {
+                out.reg = (UCHAR)reg;
+                out.lag = k;
+                out.r = r;
+                out.pairs = pairs[k];
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Up to 'top' registers, strongest |r| first. Returns the number filled in.
+    int Rank(CorrelationResult* out, int top) const {
+        int count = 0;
+        for (int reg = 0; reg < 256; reg++) {
+            CorrelationResult c;
+            if (!tracked.Test((UCHAR)reg) || !Best(reg, c)) continue;
+            int pos = count;
+            while (pos > 0 && fabs(out[pos - 1].r) < fabs(c.r)) {
+                if (pos < top) out[pos] = out[pos - 1];
+                pos--;
+            }
+            if (pos < top) {
+                out[pos] = c;
+                if (count < top) count++;
+            }
+        }
+        return count;
+    }
+};
+
+// One timestamped register scan, as produced by the acquisition thread
+struct ECSnapshot {
+    ULONG64 sequence;           // Scan number, starting at 1
+    ULONG64 wallTime;           // FILETIME (100 ns units since 1601) at scan start
+    LONGLONG startQpc;
+    LONGLONG endQpc;
+    UCHAR values[256];          // Latest known value of every register
+    LONGLONG readQpc[256];      // QPC of each register's last successful read (0 = never)
+    ECRegisterMask read;        // Registers read in this scan
+    ECRegisterMask valid;       // ... of which read successfully
+    ECRegisterMask changed;     // ... of which differ from their previous value
+    bool fullSweep;
+    int readCount;
+    int changeCount;
+    int hotCount;               // Scheduler state, for display
+    int cyclesToFullSweep;
+    ScanSummary summary;
+    RegisterStatsSummary stats[256];    // Monitor only (AcquisitionState::trackStats)
+};
+
+// Lock-free single-producer/single-consumer triple buffer.
+// The producer always has a private slot to fill, the consumer always reads a stable slot,
+// and the middle slot is swapped atomically, so neither side ever waits for the other.
+#define SNAPSHOT_DIRTY  4       // Set in 'middle' when it holds an unread snapshot
+
+class SnapshotTripleBuffer {
+private:
+    ECSnapshot slots[3];
+    volatile LONG middle;       // Slot index | SNAPSHOT_DIRTY
+    int writeIndex;             // Owned by the producer
+    int readIndex;              // Owned by the consumer
+
+public:
+    // Slots need no initialization: the consumer only sees a slot after the producer published it
+    SnapshotTripleBuffer() : middle(1), writeIndex(0), readIndex(2) {}
+
+    ECSnapshot& WriteSlot() { return slots[writeIndex]; }
+
+    // Producer: make the filled write slot the latest snapshot
+    void Publish() {
+        LONG previous = InterlockedExchange(&middle, writeIndex | SNAPSHOT_DIRTY);
+        writeIndex = previous & 3;
+    }
+
+    // Consumer: take the latest snapshot if a new one was published since the last call
+    bool Acquire() {
+        if ((middle & SNAPSHOT_DIRTY) == 0) return false;
+        LONG previous = InterlockedExchange(&middle, readIndex);
+        readIndex = previous & 3;
+        return true;
+    }
+
+    const ECSnapshot& ReadSlot() const { return slots[readIndex]; }
+};
+
+// Consumer invoked on the acquisition thread for every snapshot (capture, IPC, ...).
+// Implementations must not block; the renderer instead reads the triple buffer.
+class SnapshotSink {
+public:
+    virtual ~SnapshotSink() {}
+    virtual void OnSnapshot(const ECSnapshot& snapshot) = 0;
+};
+
+// False only once the process is known to have exited (a PID we can't open counts as alive)
+static bool ProcessAlive(DWORD pid) {
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (hProcess == NULL) return GetLastError() == ERROR_ACCESS_DENIED;
+    bool alive = (WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT);
+    CloseHandle(hProcess);
+    return alive;
+}
+
+// Layout of the shared snapshot mapping. Guarded by a seqlock: the writer makes 'sequence'
+// odd while it updates the rest, readers retry until they copy it between two equal even values.
+struct SharedSnapshot {
+    volatile LONG magic;        // Written last by the creator, after the rest of the header
+    ULONG version;
+    volatile LONG publisherPid; // Process publishing, 0 once it closed
+    ULONG reserved;
+    volatile LONG64 sequence;   // Seqlock counter
+    ULONG64 scanSequence;       // Publisher's scan number
+    ULONG64 wallTime;           // FILETIME of the latest scan
+    LONGLONG qpcFrequency;
+    LONGLONG scanQpc;           // QPC of the latest scan (QPC is system-wide)
+    ECRegisterMask known;       // Registers that have a value
+    UCHAR values[256];
+    LONGLONG readQpc[256];      // QPC of each register's last successful read
+};
+
+// Publishes snapshots into the shared mapping. Only one process publishes at a time;
+// later instances leave a live publisher alone and take over once it has gone.
+class SnapshotPublisher : public SnapshotSink {
+private:
+    HANDLE hMapping;
+    SharedSnapshot* shared;
+    UCHAR values[256];          // Merged state for partial updates (serve)
+    LONGLONG readQpc[256];
+    ECRegisterMask known;
+    ULONG64 updates;
+    LONGLONG nextAttempt;       // QPC of the next takeover check while not publishing
+
+    // Publishing, or became the publisher on this (rate-limited) retry
+    bool Ready() {
+        if (shared != NULL) return true;
+        LONGLONG now = QpcNow();
+        if (now < nextAttempt) return false;
+        nextAttempt = now + QpcTicksFromMs(SHM_TAKEOVER_RETRY_MS);
+        return Open();
+    }
+
+    void Write(const UCHAR* newValues, const LONGLONG* newReadQpc, const ECRegisterMask& newKnown,
+               ULONG64 scanSequence, ULONG64 wallTime, LONGLONG scanQpc) {
+        InterlockedIncrement64(&shared->sequence);      // Odd: update in progress
+        shared->scanSequence = scanSequence;
+        shared->wallTime = wallTime;
+        shared->scanQpc = scanQpc;
+        shared->known = newKnown;
+        memcpy(shared->values, newValues, sizeof(shared->values));
+        memcpy(shared->readQpc, newReadQpc, sizeof(shared->readQpc));
+        InterlockedIncrement64(&shared->sequence);      // Even: consistent again
+    }
+
+public:
+    SnapshotPublisher() : hMapping(NULL), shared(NULL), updates(0), nextAttempt(0) {
+        memset(values, 0, sizeof(values));
+        memset(readQpc, 0, sizeof(readQpc));
+    }
+
+    ~SnapshotPublisher() {
+        Close();
+    }
+
+    // False if the mapping can't be created or another live process publishes. A mapping
+    // whose publisher exited (kept alive by readers) is taken over.
+    bool Open() {
+        if (shared != NULL) return true;
+        hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SharedSnapshot), SHM_NAME_GLOBAL);
+        if (hMapping == NULL) {
+            // Creating Global\ objects needs SeCreateGlobalPrivilege; fall back to this session
+            hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SharedSnapshot), SHM_NAME_LOCAL);
+        }
+        if (hMapping == NULL) return false;
+        bool created = (GetLastError() != ERROR_ALREADY_EXISTS);
+
+        shared = (SharedSnapshot*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, sizeof(SharedSnapshot));
+        if (shared == NULL) {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+            return false;
+        }
+
+        LONG self = (LONG)GetCurrentProcessId();
+        if (created) {
+            // Fresh mappings are zero-filled: sequence 0 (even), nothing known yet. The header
+            // is complete before version and magic appear, so readers never see a partial one.
+            shared->qpcFrequency = QpcFrequency();
+            shared->publisherPid = self;
+            MemoryBarrier();
+            shared->version = SHM_VERSION;
+            InterlockedExchange(&shared->magic, SHM_MAGIC);
+            return true;
+        }
+
+        // Existing mapping: ours only if its layout matches and its publisher is gone
+        LONG owner = shared->publisherPid;
+        if (shared->magic == SHM_MAGIC && shared->version == SHM_VERSION &&
+            (owner == 0 || !ProcessAlive((DWORD)owner)) &&
+            InterlockedCompareExchange(&shared->publisherPid, self, owner) == owner) {
+            if (shared->sequence & 1) InterlockedIncrement64(&shared->sequence);   // It died mid-update
+            return true;
+        }
+        Close();
+        return false;
+    }
+
+    void Close() {
+        if (shared != NULL) {
+            InterlockedCompareExchange(&shared->publisherPid, 0, (LONG)GetCurrentProcessId());
+            UnmapViewOfFile(shared);
+            shared = NULL;
+        }
+        if (hMapping != NULL) {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+    }
+
+    bool IsOpen() const { return shared != NULL; }
+
+    // Monitor/record: snapshots already carry the full register state
+    void OnSnapshot(const ECSnapshot& snap) {
+        if (!Ready()) return;
+        ECRegisterMask snapKnown;
+        for (int i = 0; i < 256; i++) {
+            if (snap.readQpc[i] != 0) snapKnown.Set((UCHAR)i);
+        }
+        Write(snap.values, snap.readQpc, snapKnown, snap.sequence, snap.wallTime, snap.endQpc);
+    }
+
+    // Serve: merge a partial read into the published state
+    void Update(const ECRegisterMask& read, const UCHAR* newValues, const bool* valid) {
+        LONGLONG now = QpcNow();
+        for (int i = 0; i < 256; i++) {
+            if (!read.Test((UCHAR)i) || !valid[i]) continue;
+            values[i] = newValues[i];
+            readQpc[i] = now;
+            known.Set((UCHAR)i);
+        }
+
+        if (!Ready()) return;
+        FILETIME wall;
+        GetSystemTimeAsFileTime(&wall);
+        Write(values, readQpc, known, ++updates, ((ULONG64)wall.dwHighDateTime << 32) | wall.dwLowDateTime, now);
+    }
+};
+
+// --budget of one running instance
+struct BudgetSlot {
+    volatile LONG pid;          // Owner, 0 = free
+    volatile LONG ceiling;      // Reads/s, 0 while the slot is being claimed or released
+};
+
+// Layout of the shared bus budget mapping. The bucket is kept in GCRA form: a single
+// "theoretical arrival time" in QPC ticks (QPC is system-wide), advanced by one emission
+// interval per token, so a grant is one compare-exchange and a crashed process can't hold a lock.
+struct SharedBudget {
+    volatile LONG magic;        // Written last by the creator
+    ULONG version;
+    volatile LONG ratePerSec;   // Lowest live ceiling in EC transactions (register reads) per second
+    volatile LONG processes;    // Attached ECReader instances (informational)
+    volatile LONG64 tat;        // Theoretical arrival time of the next token (QPC ticks)
+    volatile LONG64 granted;    // Tokens granted, all processes
+    volatile LONG64 deferred;   // Requests that had to wait, all processes
+    BudgetSlot slots[BUDGET_SLOTS];
+};
+
+// Token bucket in front of every EC transaction. Real hardware shares one bucket through a
+// named mapping next to Access_EC, so monitor, serve and ad-hoc -r calls draw from the same
+// budget; the simulator gets a private one. A request for more tokens than the bucket holds
+// is granted once the bucket is full and leaves it in debt.
+class BusGovernor {
+private:
+    HANDLE hMapping;
+    SharedBudget* shared;
+    const char* scope;          // "Global", "Local" or "private"
+    int slot;                   // Our entry in shared->slots, -1 without --budget
+    LONG ceiling;               // Our --budget, 0 = none; enforced locally even without a slot
+    ULONG64 deferrals;          // This process
+    double deferredMs;
+
+    LONG EffectiveRate() const {
+        LONG rate = shared->ratePerSec;
+        if (ceiling > 0 && (rate <= 0 || ceiling < rate)) rate = ceiling;
+        return rate;
+    }
+
+    LONGLONG TicksPerToken() const {
+        LONG rate = EffectiveRate();
+        return QpcFrequency() / (rate > 0 ? rate : 1);
+    }
+
+    // Shared rate = lowest ceiling among live instances, or the default when none set one.
+    // Slots of processes that died without Close() are released on the way.
+    void Recompute() {
+        LONG rate = 0;
+        for (int i = 0; i < BUDGET_SLOTS; i++) {
+            LONG pid = shared->slots[i].pid;
+            if (pid == 0) continue;
+            if ((DWORD)pid != GetCurrentProcessId() && !ProcessAlive((DWORD)pid)) {
+                shared->slots[i].ceiling = 0;
+                InterlockedCompareExchange(&shared->slots[i].pid, 0, pid);
+                continue;
+            }
+            LONG slotCeiling = shared->slots[i].ceiling;
+            if (slotCeiling > 0 && (rate == 0 || slotCeiling < rate)) rate = slotCeiling;
+        }
+        InterlockedExchange(&shared->ratePerSec, rate > 0 ? rate : EC_READ_BUDGET_PER_SEC);
+    }
+
+    // "Global\ECReaderBusBudget" for 62/66, "Global\ECReaderBusBudget-68-6C" for another pair
+    static void BudgetName(const char* base, ULONG channelTag, char* out, size_t size) {
+        if (channelTag == 0) snprintf(out, size, "%s", base);
+        else snprintf(out, size, "%s-%X-%X", base, (unsigned)(channelTag >> 16), (unsigned)(channelTag & 0xFFFF));
+    }
+
+    bool Map(const char* name) {
+        hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SharedBudget), name);
+        if (hMapping == NULL) return false;
+        bool created = (name == NULL || GetLastError() != ERROR_ALREADY_EXISTS);
+
+        shared = (SharedBudget*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, sizeof(SharedBudget));
+        if (shared == NULL) {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+            return false;
+        }
+
+        if (created) {
+            shared->version = BUDGET_VERSION;
+            shared->ratePerSec = EC_READ_BUDGET_PER_SEC;
+            shared->tat = QpcNow();
+            InterlockedExchange(&shared->magic, BUDGET_MAGIC);
+        } else {
+            for (int spin = 0; spin < BUDGET_INIT_SPINS && shared->magic == 0; spin++) YieldProcessor();
+        }
+        if (shared->magic != BUDGET_MAGIC || shared->version != BUDGET_VERSION) {
+            if (g_verbose) printf("[Verbose] Shared bus budget has an unknown layout, using a private one\n");
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+public:
+    BusGovernor() : hMapping(NULL), shared(NULL), scope("none"), slot(-1), ceiling(0), deferrals(0), deferredMs(0.0) {}
+
+    ~BusGovernor() {
+        Close();
+    }
+
+    // Attach to the machine-wide budget (or a private one) and register the requested ceiling.
+    // Each EC port pair is its own bus: channelTag (ECChannel::Tag) picks the bucket, 0 for
+    // 62/66, else one named after the ports. The shared rate is the lowest --budget of the
+    // instances still running (the default when none gave one), so it rises again once the
+    // strictest instance exits.
+    bool Open(bool machineWide, ULONG channelTag, int ceilingPerSec) {
+        Close();
+        if (machineWide) {
+            char globalName[64];
+            char localName[64];
+            BudgetName(BUDGET_NAME_GLOBAL, channelTag, globalName, sizeof(globalName));
+            BudgetName(BUDGET_NAME_LOCAL, channelTag, localName, sizeof(localName));
+            scope = "Global";
+            if (!Map(globalName)) {
+                // Creating Global\ objects needs SeCreateGlobalPrivilege; fall back to this session
+                scope = "Local";
+                if (!Map(localName)) scope = "private";
+            }
+        } else {
+            scope = "private";
+        }
+        if (shared == NULL && !Map(NULL)) {
+            scope = "none";
+            return false;
+        }
+
+        InterlockedIncrement(&shared->processes);
+        ceiling = ceilingPerSec > 0 ? ceilingPerSec : 0;
+        if (ceiling > 0) {
+            Recompute();    // Frees slots of crashed instances first
+            for (int i = 0; i < BUDGET_SLOTS && slot < 0; i++) {
+                if (InterlockedCompareExchange(&shared->slots[i].pid, (LONG)GetCurrentProcessId(), 0) == 0) slot = i;
+            }
+            if (slot >= 0) {
+                InterlockedExchange(&shared->slots[slot].ceiling, ceiling);
+            } else if (g_verbose) {
+                printf("[Verbose] No free bus budget slot, the ceiling applies to this instance only\n");
+            }
+        }
+        Recompute();
+        if (g_verbose) {
+            if (ceiling > 0 && shared->ratePerSec < ceiling) {
+                printf("[Verbose] Bus budget already limited to %ld reads/s by another instance\n", shared->ratePerSec);
+            }
+            printf("[Verbose] Bus budget: %ld reads/s (%s)\n", EffectiveRate(), scope);
+        }
+        return true;
+    }
+
+    void Close() {
+        if (shared != NULL) {
+            if (slot >= 0) {
+                InterlockedExchange(&shared->slots[slot].ceiling, 0);
+                InterlockedExchange(&shared->slots[slot].pid, 0);
+                slot = -1;
+                Recompute();
+            }
+            ceiling = 0;
+            InterlockedDecrement(&shared->processes);
+            UnmapViewOfFile(shared);
+            shared = NULL;
+        }
+        if (hMapping != NULL) {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+    }
+
+    bool IsOpen() const { return shared != NULL; }
+    int Rate() const { return shared != NULL ? (int)EffectiveRate() : EC_READ_BUDGET_PER_SEC; }
+
+    // Ticks until tokens could be granted (0 = now), without taking them
+    LONGLONG Delay(int tokens) const {
+        if (shared == NULL) return 0;
+        LONGLONG now = QpcNow();
+        LONGLONG base = (shared->tat > now) ? shared->tat : now;
+        LONGLONG over = base + tokens * TicksPerToken() - now - EC_READ_BUDGET_BURST * TicksPerToken();
+        return (base == now || over <= 0) ? 0 : over;
+    }
+
+    // Take tokens, waiting while the bucket is empty. Returns false, with nothing taken,
+    // if hStop is signaled first.
+    bool Acquire(int tokens, HANDLE hStop = NULL) {
+        if (shared == NULL) return true;
+        LONGLONG waitStart = 0;
+        for (;;) {
+            LONGLONG interval = TicksPerToken();
+            LONGLONG old = shared->tat;
+            LONGLONG now = QpcNow();
+            LONGLONG base = (old > now) ? old : now;
+            LONGLONG over = base + tokens * interval - now - EC_READ_BUDGET_BURST * interval;
+            if (base == now || over <= 0) {
+                if (InterlockedCompareExchange64(&shared->tat, base + tokens * interval, old) != old) continue;
+                InterlockedExchangeAdd64(&shared->granted, tokens);
+                if (waitStart != 0) deferredMs += QpcToMs(QpcNow() - waitStart);
+                return true;
+            }
+            if (waitStart == 0) {
+                waitStart = now;
+                deferrals++;
+                InterlockedIncrement64(&shared->deferred);
+            }
+            double waitMs = QpcToMs(over);
+            DWORD waitFor = waitMs < 1.0 ? 1 : (DWORD)waitMs;
+            if (hStop == NULL) {
+                Sleep(waitFor);
+            } else if (WaitForSingleObject(hStop, waitFor) == WAIT_OBJECT_0) {
+                deferredMs += QpcToMs(QpcNow() - waitStart);
+                return false;
+            }
+        }
+    }
+
+    // Take tokens without waiting (bench): the bus time still counts against everyone else
+    void Charge(int tokens) {
+        if (shared == NULL) return;
+        for (;;) {
+            LONGLONG old = shared->tat;
+            LONGLONG now = QpcNow();
+            LONGLONG base = (old > now) ? old : now;
+            if (InterlockedCompareExchange64(&shared->tat, base + tokens * TicksPerToken(), old) == old) break;
+        }
+        InterlockedExchangeAdd64(&shared->granted, tokens);
+    }
+
+    void PrintStatistics() const {
+        if (shared == NULL) return;
+        printf("Bus budget:       %ld reads/s (%s, %ld processes); deferred %llu times, %.0f ms\n",
+               EffectiveRate(), scope, shared->processes, (unsigned long long)deferrals, deferredMs);
+    }
+};
+
+class ECReader;
+
+// Paces the acquisition thread between scan slots.
+// Default: wait on the stop event at system timer resolution. The real-time profile raises the
+// thread to MMCSS "Pro Audio" (or TIME_CRITICAL), raises timer resolution so the EC wait's
+// Sleep(1) stays short, and sleeps on a high-resolution waitable timer that fires
+// RT_SPIN_LEAD_US early, spinning the rest. A raised priority also keeps the busy-wait's
+// Sleep(0) from handing the CPU to normal-priority load. All settings are reverted by End().
+class AcquisitionPacer {
+private:
+    bool realtime;
+    int cpu;                    // -1 = no pinning
+    HANDLE hTimer;
+    HANDLE hMmcss;
+    bool periodRaised;
+    bool highResTimer;
+    int previousPriority;
+    char description[128];
+
+public:
+    AcquisitionPacer() : realtime(false), cpu(-1), hTimer(NULL), hMmcss(NULL), periodRaised(false),
+                         highResTimer(false), previousPriority(THREAD_PRIORITY_NORMAL) {
+        strncpy_s(description, sizeof(description), "default", _TRUNCATE);
+    }
+
+    void Configure(bool enableRealtime, int pinCpu) {
+        realtime = enableRealtime;
+        cpu = pinCpu;
+    }
+
+    const char* Describe() const { return description; }
+
+    // Apply the profile to the calling (acquisition) thread
+    void Begin() {
+        HANDLE hThread = GetCurrentThread();
+        int len = 0;
+        description[0] = '\0';
+
+        if (cpu >= 0) {
+            if (SetThreadAffinityMask(hThread, (DWORD_PTR)1 << cpu) != 0) {
+                len += snprintf(description + len, sizeof(description) - len, "CPU %d, ", cpu);
+            } else {
+                printf("Warning: cannot pin acquisition thread to CPU %d (Error: %lu)\n", cpu, GetLastError());
+            }
+        }
+
+        if (!realtime) {
+            snprintf(description + len, sizeof(description) - len, "default priority");
+            return;
+        }
+
+        DWORD taskIndex = 0;
+        hMmcss = AvSetMmThreadCharacteristicsA(RT_MMCSS_TASK, &taskIndex);
+        if (hMmcss != NULL) {
+            AvSetMmThreadPriority(hMmcss, AVRT_PRIORITY_HIGH);
+            len += snprintf(description + len, sizeof(description) - len, "MMCSS %s", RT_MMCSS_TASK);
+        } else {
+            previousPriority = GetThreadPriority(hThread);
+            SetThreadPriority(hThread, THREAD_PRIORITY_TIME_CRITICAL);
+            len += snprintf(description + len, sizeof(description) - len, "time-critical priority");
+        }
+
+        if (timeBeginPeriod(RT_TIMER_RESOLUTION_MS) == TIMERR_NOERROR) {
+            periodRaised = true;
+            len += snprintf(description + len, sizeof(description) - len, ", %d ms timer", RT_TIMER_RESOLUTION_MS);
+        }
+
+        hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        highResTimer = (hTimer != NULL);
+        if (hTimer == NULL) hTimer = CreateWaitableTimerW(NULL, FALSE, NULL);
+        if (hTimer != NULL) {
+            snprintf(description + len, sizeof(description) - len, ", %s waitable timer",
+                     highResTimer ? "high-resolution" : "standard");
+        }
+
+        if (g_verbose) printf("[Verbose] Real-time acquisition: %s\n", description);
+    }
+
+    void End() {
+        if (hTimer != NULL) {
+            CloseHandle(hTimer);
+            hTimer = NULL;
+        }
+        if (periodRaised) {
+            timeEndPeriod(RT_TIMER_RESOLUTION_MS);
+            periodRaised = false;
+        }
+        if (hMmcss != NULL) {
+            AvRevertMmThreadCharacteristics(hMmcss);
+            hMmcss = NULL;
+        } else if (realtime) {
+            SetThreadPriority(GetCurrentThread(), previousPriority);
+        }
+    }
+
+    // Sleep until deadline (QPC ticks). Returns false if hStop was signaled first.
+    bool WaitUntil(LONGLONG deadline, HANDLE hStop) {
+        LONGLONG now = QpcNow();
+        if (!realtime) {
+            DWORD ms = (deadline > now) ? (DWORD)QpcToMs(deadline - now) : 0;
+            return WaitForSingleObject(hStop, ms) != WAIT_OBJECT_0;
+        }
+
+        LONGLONG wakeAt = deadline - (LONGLONG)RT_SPIN_LEAD_US * QpcFrequency() / 1000000;
+        if (wakeAt > now) {
+            if (hTimer != NULL) {
+                LARGE_INTEGER due;
+                due.QuadPart = -(LONGLONG)((double)(wakeAt - now) * 10000000.0 / (double)QpcFrequency());
+                SetWaitableTimer(hTimer, &due, 0, NULL, NULL, FALSE);
+                HANDLE handles[2] = { hStop, hTimer };
+                if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0) return false;
+            } else if (WaitForSingleObject(hStop, (DWORD)QpcToMs(wakeAt - now)) == WAIT_OBJECT_0) {
+                return false;
+            }
+        }
+
+        while (QpcNow() < deadline) {
+            YieldProcessor();
+        }
+        return true;
+    }
+};
+
+// Index/data port pair of an extended EC RAM window (--xram)
+struct XramPorts {
+    USHORT addrHi;
+    USHORT addrLo;
+    USHORT data;
+
+    XramPorts() : addrHi(XRAM_ENE_ADDR_HI), addrLo(XRAM_ENE_ADDR_LO), data(XRAM_ENE_DATA) {}
+
+    // Ports that belong to the chipset or the ACPI EC and are never written as an index:
+    // PIC, timer, KBC, EC 62/66, RTC, POST, A20/reset, Super I/O config, PCI config
+    static bool Reserved(unsigned port) {
+        static const USHORT reserved[][2] = {
+            {0x0020, 0x0021}, {0x0040, 0x0043}, {0x0060, 0x0066}, {0x0070, 0x0071}, {0x0080, 0x0080},
+            {0x0092, 0x0092}, {0x00A0, 0x00A1}, {0x00B2, 0x00B3}, {0x002E, 0x002F}, {0x004E, 0x004F},
+            {0x0CF8, 0x0CFF}
+        };
+        for (size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++) {
+            if (port >= reserved[i][0] && port <= reserved[i][1]) return true;
+        }
+        return false;
+    }
+
+    // A known layout by name, or "<hi>,<lo>,<data>" in hex: three distinct ports inside
+    // XRAM_CUSTOM_PORT_MIN..MAX
+    bool Parse(const char* spec) {
+        static const struct { const char* name; USHORT hi, lo, data; } layouts[] = {
+            {"ene", XRAM_ENE_ADDR_HI, XRAM_ENE_ADDR_LO, XRAM_ENE_DATA},
+        };
+        for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+            if (strcmp(spec, layouts[i].name) == 0) {
+                addrHi = layouts[i].hi;
+                addrLo = layouts[i].lo;
+                data = layouts[i].data;
+                return true;
+            }
+        }
+        unsigned hi, lo, dataPort;
+        if (sscanf(spec, "%x,%x,%x", &hi, &lo, &dataPort) != 3 || hi > 0xFFFF || lo > 0xFFFF || dataPort > 0xFFFF) {
+            printf("Error: --xram expects 'ene' or <hi>,<lo>,<data> port numbers in hex\n");
+            return false;
+        }
+        unsigned ports[3] = {hi, lo, dataPort};
+        for (int i = 0; i < 3; i++) {
+            if (Reserved(ports[i])) {
+                printf("Error: --xram port %X belongs to the chipset or the EC command interface\n", ports[i]);
+                return false;
+            }
+            if (ports[i] < XRAM_CUSTOM_PORT_MIN || ports[i] > XRAM_CUSTOM_PORT_MAX) {
+                printf("Error: --xram port %X is outside the EC index block %X-%X\n", ports[i],
+                       XRAM_CUSTOM_PORT_MIN, XRAM_CUSTOM_PORT_MAX);
+                return false;
+            }
+        }
+        if (hi == lo || hi == dataPort || lo == dataPort) {
+            printf("Error: --xram needs three different ports\n");
+            return false;
+        }
+        addrHi = (USHORT)hi;
+        addrLo = (USHORT)lo;
+        data = (USHORT)dataPort;
+        return true;
+    }
+};
+
+// Data/command port pair of one EC interface (--channel). Each reader instance talks to one.
+struct ECChannel {
+    USHORT data;
+    USHORT cmd;
+    char name[12];              // "62/66", for grid titles, stats and capture names
+
+    ECChannel() : data(EC_DATA_PORT), cmd(EC_CMD_PORT) { UpdateName(); }
+
+    bool IsPrimary() const { return data == EC_DATA_PORT && cmd == EC_CMD_PORT; }
+
+    bool SharesPort(const ECChannel& other) const {
+        return data == other.data || data == other.cmd || cmd == other.data || cmd == other.cmd;
+    }
+
+    // Stored in capture and raw output headers: 0 for the primary pair, else data << 16 | cmd
+    ULONG Tag() const { return IsPrimary() ? 0 : ((ULONG)data << 16) | cmd; }
+
+    static void TagName(ULONG tag, char* out, size_t size) {
+        if (tag == 0) tag = ((ULONG)EC_DATA_PORT << 16) | EC_CMD_PORT;
+        snprintf(out, size, "%X/%X", (unsigned)(tag >> 16), (unsigned)(tag & 0xFFFF));
+    }
+
+    // "primary", "secondary" or "<data>,<cmd>" in hex. The read sequence writes the command
+    // port and a register index to the data port, so custom pairs must have the ACPI EC
+    // layout (cmd = data + 4) inside EC_CHANNEL_PORT_MIN..MAX, off the 8042 and the 62/66 EC.
+    bool Parse(const char* spec) {
+        unsigned dataPort = EC_DATA_PORT, cmdPort = EC_CMD_PORT;
+        if (strcmp(spec, "secondary") == 0) {
+            dataPort = EC_SECONDARY_DATA_PORT;
+            cmdPort = EC_SECONDARY_CMD_PORT;
+        } else if (strcmp(spec, "primary") != 0) {
+            if (sscanf(spec, "%x,%x", &dataPort, &cmdPort) != 2) {
+                printf("Error: --channel expects 'primary', 'secondary' or <data>,<cmd> port numbers in hex\n");
+                return false;
+            }
+            bool primary = (dataPort == EC_DATA_PORT && cmdPort == EC_CMD_PORT);
+            bool layout = dataPort >= EC_CHANNEL_PORT_MIN && cmdPort <= EC_CHANNEL_PORT_MAX && cmdPort == dataPort + 4 &&
+                          dataPort != EC_KBC_CMD_PORT && cmdPort != EC_KBC_CMD_PORT;
+            bool overlaps = !primary && (dataPort == EC_DATA_PORT || dataPort == EC_CMD_PORT ||
+                                         cmdPort == EC_DATA_PORT || cmdPort == EC_CMD_PORT);
+            if (!primary && (!layout || overlaps)) {
+                printf("Error: --channel %s is not an EC port pair: expected <data>,<data+4> within %X-%X, "
+                       "not using 64 or the 62/66 ports\n", spec, EC_CHANNEL_PORT_MIN, EC_CHANNEL_PORT_MAX);
+                return false;
+            }
+        }
+        data = (USHORT)dataPort;
+        cmd = (USHORT)cmdPort;
+        UpdateName();
+        return true;
+    }
+
+private:
+    void UpdateName() {
+        snprintf(name, sizeof(name), "%X/%X", data, cmd);
+    }
+};
+
+// File of one channel (capture of a multi-channel recording, trace ring): the port pair goes
+// before the extension ("fan.ecr" -> "fan-68-6C.ecr")
+static void ChannelFilePath(const char* path, const ECChannel& channel, char* out, size_t outSize) {
+    size_t stem = strlen(path);
+    const char* dot = strrchr(path, '.');
+    if (dot != NULL && dot != path && strpbrk(dot, "\\/") == NULL) stem = (size_t)(dot - path);
+    snprintf(out, outSize, "%.*s-%X-%X%s", (int)stem, path, channel.data, channel.cmd, path + stem);
+}
+
+// Sparse extended RAM image: 256-byte pages allocated on first store, so a scan of a few
+// tables in a 64 KB space only costs memory for the pages it touches.
+class SparseECMemory {
+public:
+    struct Page {
+        UCHAR values[XRAM_PAGE_SIZE];
+        ECRegisterMask known;       // Offsets read successfully at least once
+        ULONG64 readCycle;          // Last scan cycle that read this page
+    };
+
+private:
+    std::vector<Page*> pages;       // XRAM_PAGES entries, NULL until touched
+    int allocated;
+
+    SparseECMemory(const SparseECMemory&);
+    SparseECMemory& operator=(const SparseECMemory&);
+
+public:
+    SparseECMemory() : pages(XRAM_PAGES, (Page*)NULL), allocated(0) {}
+
+    ~SparseECMemory() {
+        for (size_t i = 0; i < pages.size(); i++) delete pages[i];
+    }
+
+    const Page* GetPage(int index) const { return pages[index]; }
+    int AllocatedPages() const { return allocated; }
+
+    Page& Touch(int index) {
+        if (pages[index] == NULL) {
+            pages[index] = new Page();
+            memset(pages[index]->values, 0, sizeof(pages[index]->values));
+            pages[index]->readCycle = 0;
+            allocated++;
+        }
+        return *pages[index];
+    }
+
+    // Merge one successful read; returns true if a known value changed
+    bool Store(int address, UCHAR value) {
+        Page& page = Touch(address / XRAM_PAGE_SIZE);
+        UCHAR offset = (UCHAR)(address % XRAM_PAGE_SIZE);
+        bool changed = page.known.Test(offset) && page.values[offset] != value;
+        page.values[offset] = value;
+        page.known.Set(offset);
+        return changed;
+    }
+};
+
+// Extended RAM scan state shared by the scan thread and the viewer (guarded by lock)
+struct ExtendedScanState {
+    ECReader* reader;
+    XramPorts ports;
+    int start;                  // Inclusive address range
+    int end;
+    int intervalMs;
+    ScanScheduler scheduler;    // One slot per page: pages that change are rescanned every cycle
+    SparseECMemory memory;
+    CRITICAL_SECTION lock;
+    HANDLE hThread;
+    HANDLE hStop;
+    volatile LONG fullSweepRequested;
+    ULONG64 cycles;
+    int lastReadBytes;
+    int lastChangedPages;
+    double lastScanMs;
+
+    ExtendedScanState() : reader(NULL), start(0), end(0), intervalMs(MIN_INTERVAL_MS), hThread(NULL), hStop(NULL),
+                          fullSweepRequested(0), cycles(0), lastReadBytes(0), lastChangedPages(0), lastScanMs(0.0) {
+        InitializeCriticalSection(&lock);
+    }
+
+    ~ExtendedScanState() {
+        DeleteCriticalSection(&lock);
+    }
+
+    int FirstPage() const { return start / XRAM_PAGE_SIZE; }
+    int LastPage() const { return end / XRAM_PAGE_SIZE; }
+    bool Stopping() const { return hStop != NULL && WaitForSingleObject(hStop, 0) == WAIT_OBJECT_0; }
+};
+
+// Acquisition thread state: what to scan, how often, and where the snapshots go
+struct AcquisitionState {
+    ECReader* reader;
+    int intervalMs;
+    bool useWatchMask;          // Read watchMask every scan instead of asking the scheduler
+    ECRegisterMask watchMask;
+    ScanScheduler scheduler;
+    std::vector<SnapshotSink*> sinks;
+    SnapshotPublisher publisher;        // Registered as a sink when no other process publishes
+
+    AcquisitionPacer pacer;
+
+    SnapshotTripleBuffer snapshots;
+    bool trackStats;                    // Maintain rolling per-register statistics (monitor)
+    std::vector<RegisterWindow> windows;
+    RegisterStatsSummary stats[256];
+    HANDLE hThread;
+    HANDLE hPublished;          // Auto-reset, signaled after every Publish()
+    HANDLE hStop;               // Manual-reset, asks the thread to exit
+    volatile LONG fullSweepRequested;
+    ULONG64 sequence;
+
+    AcquisitionState() : reader(NULL), intervalMs(MIN_INTERVAL_MS), useWatchMask(false), trackStats(false),
+                         hThread(NULL), hPublished(NULL), hStop(NULL), fullSweepRequested(0), sequence(0) {
+        memset(stats, 0, sizeof(stats));
+    }
+
+    // Allocate the sample rings up front; the acquisition loop then never allocates
+    void EnableStats() {
+        trackStats = true;
+        windows.assign(256, RegisterWindow());
+    }
+};
+
+struct CaptureFileHeader {
+    char magic[8];
+    ULONG version;
+    ULONG headerSize;
+    ULONG keyframeEvery;
+    ULONG intervalMs;
+    ULONG64 startWallTime;      // FILETIME of the first record
+    ULONG64 qpcFrequency;
+    ULONG64 recordCount;
+    ULONG64 keyframeCount;
+    ULONG64 dataEnd;            // File offset after the last record
+    ULONG flags;
+    ULONG channel;              // ECChannel::Tag() of the recorded ports (0 = 62/66, also older files)
+};
+
+struct CaptureRecordHeader {
+    UCHAR type;
+    UCHAR reserved;
+    USHORT count;               // Delta: number of (register, value) pairs that follow
+    ULONG deltaUs;              // Time since the previous record's scan start
+};
+
+struct CaptureKeyframe {
+    ULONG64 wallTime;           // FILETIME of this scan, to resynchronize the clock
+    UCHAR values[256];
+    ECRegisterMask known;       // Registers that have been read successfully at least once
+};
+
+static_assert(sizeof(CaptureFileHeader) == 72, "CaptureFileHeader layout is part of the file format");
+static_assert(sizeof(CaptureRecordHeader) == 8, "CaptureRecordHeader layout is part of the file format");
+static_assert(sizeof(CaptureKeyframe) == 8 + 256 + 32, "CaptureKeyframe layout is part of the file format");
+
+// Appends snapshots to a capture file through a sliding memory-mapped window.
+// The file is extended one window at a time, so recording costs a memcpy per snapshot
+// and the acquisition thread never waits on buffered file I/O.
+class CaptureWriter : public SnapshotSink {
+private:
+    HANDLE hFile;
+    HANDLE hMapping;
+    UCHAR* view;
+    ULONG64 viewOffset;         // File offset of view[0]
+    ULONG64 viewSize;
+    ULONG64 position;           // Next write offset
+    DWORD granularity;
+    CaptureFileHeader header;
+    UCHAR values[256];          // Last recorded value per register
+    ECRegisterMask known;
+    LONGLONG lastQpc;
+    ULONG sinceKeyframe;
+    volatile bool failed;
+
+    bool MapWindow(ULONG64 offset) {
+        // Views must start on the allocation granularity; widen so a full window follows offset
+        ULONG64 aligned = offset - (offset % granularity);
+        ULONG64 size = CAPTURE_VIEW_BYTES + (offset - aligned);
+        ULONG64 end = aligned + size;
+
+        // Creating a mapping larger than the file extends it (zero-filled)
+        hMapping = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, (DWORD)(end >> 32), (DWORD)end, NULL);
+        if (hMapping == NULL) {
+            printf("Error: Failed to extend capture file (Error: %lu)\n", GetLastError());
+            return false;
+        }
+        view = (UCHAR*)MapViewOfFile(hMapping, FILE_MAP_WRITE, (DWORD)(aligned >> 32), (DWORD)aligned, (SIZE_T)size);
+        if (view == NULL) {
+            printf("Error: Failed to map capture file (Error: %lu)\n", GetLastError());
+            CloseHandle(hMapping);
+            hMapping = NULL;
+            return false;
+        }
+        viewOffset = aligned;
+        viewSize = size;
+        return true;
+    }
+
+    void UnmapWindow() {
+        if (view != NULL) {
+            UnmapViewOfFile(view);
+            view = NULL;
+        }
+        if (hMapping != NULL) {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+    }
+
+    // Space for the next record, sliding the window forward when it doesn't fit
+    UCHAR* Reserve(size_t bytes) {
+        if (position + bytes > viewOffset + viewSize) {
+            UnmapWindow();
+            if (!MapWindow(position)) return NULL;
+        }
+        return view + (position - viewOffset);
+    }
+
+public:
+    CaptureWriter() : hFile(INVALID_HANDLE_VALUE), hMapping(NULL), view(NULL), viewOffset(0), viewSize(0), position(0),
+                      granularity(65536), lastQpc(0), sinceKeyframe(0), failed(false) {
+        memset(&header, 0, sizeof(header));
+        memset(values, 0, sizeof(values));
+    }
+
+    ~CaptureWriter() {
+        Close();
+    }
+
+    bool Open(const char* path, int keyframeEvery, int intervalMs, ULONG channel) {
+        hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            printf("Error: Cannot create capture file '%s' (Error: %lu)\n", path, GetLastError());
+            return false;
+        }
+
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        granularity = info.dwAllocationGranularity;
+
+        memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        header.version = CAPTURE_VERSION;
+        header.headerSize = sizeof(header);
+        header.keyframeEvery = keyframeEvery;
+        header.intervalMs = intervalMs;
+        header.qpcFrequency = (ULONG64)QpcFrequency();
+        header.channel = channel;
+        position = sizeof(header);
+
+        if (!MapWindow(0)) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+            return false;
+        }
+        // Readers detect a capture that was never closed by the missing COMPLETE flag
+        memcpy(view, &header, sizeof(header));
+        return true;
+    }
+
+    // Called on the acquisition thread
+    void OnSnapshot(const ECSnapshot& snap) {
+        if (failed || hFile == INVALID_HANDLE_VALUE) return;
+
+        CaptureRecordHeader rec;
+        rec.reserved = 0;
+        rec.deltaUs = 0;
+        if (lastQpc != 0) {
+            ULONG64 us = QpcToMicros(snap.startQpc - lastQpc);
+            rec.deltaUs = (us > ULONG_MAX) ? ULONG_MAX : (ULONG)us;
+        }
+
+        // Changes relative to what the file already holds
+        UCHAR pairs[512];
+        int count = 0;
+        for (int i = 0; i < 256; i++) {
+            if (!snap.valid.Test((UCHAR)i)) continue;
+            if (known.Test((UCHAR)i) && values[i] == snap.values[i]) continue;
+            pairs[count * 2] = (UCHAR)i;
+            pairs[count * 2 + 1] = snap.values[i];
+            values[i] = snap.values[i];
+            known.Set((UCHAR)i);
+            count++;
+        }
+
+        bool keyframe = (header.recordCount == 0 || sinceKeyframe >= header.keyframeEvery);
+        size_t size = sizeof(rec) + (keyframe ? sizeof(CaptureKeyframe) : (size_t)count * 2);
+        UCHAR* out = Reserve(size);
+        if (out == NULL) {
+            failed = true;
+            return;
+        }
+
+        if (keyframe) {
+            CaptureKeyframe key;
+            key.wallTime = snap.wallTime;
+            memcpy(key.values, values, sizeof(values));
+            key.known = known;
+            rec.type = CAPTURE_REC_KEYFRAME;
+            rec.count = 0;
+            memcpy(out, &rec, sizeof(rec));
+            memcpy(out + sizeof(rec), &key, sizeof(key));
+            if (header.recordCount == 0) header.startWallTime = snap.wallTime;
+            header.keyframeCount++;
+            sinceKeyframe = 0;
+        } else {
+            rec.type = CAPTURE_REC_DELTA;
+            rec.count = (USHORT)count;
+            memcpy(out, &rec, sizeof(rec));
+            memcpy(out + sizeof(rec), pairs, (size_t)count * 2);
+        }
+
+        position += size;
+        header.recordCount++;
+        header.dataEnd = position;
+        sinceKeyframe++;
+        lastQpc = snap.startQpc;
+    }
+
+    // Trims the pre-extended tail and writes the final header
+    void Close() {
+        if (hFile == INVALID_HANDLE_VALUE) return;
+        UnmapWindow();
+
+        LARGE_INTEGER offset;
+        offset.QuadPart = (LONGLONG)position;
+        SetFilePointerEx(hFile, offset, NULL, FILE_BEGIN);
+        SetEndOfFile(hFile);
+
+        header.dataEnd = position;
+        header.flags |= CAPTURE_FLAG_COMPLETE;
+        offset.QuadPart = 0;
+        SetFilePointerEx(hFile, offset, NULL, FILE_BEGIN);
+        DWORD written = 0;
+        if (!WriteFile(hFile, &header, sizeof(header), &written, NULL) || written != sizeof(header)) {
+            printf("Error: Failed to finalize capture header (Error: %lu)\n", GetLastError());
+        }
+
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+
+    bool Failed() const { return failed; }
+    ULONG64 RecordCount() const { return header.recordCount; }
+    ULONG64 KeyframeCount() const { return header.keyframeCount; }
+    ULONG64 Bytes() const { return position; }
+};
+
+// Sequential read access to a capture file, memory-mapped read-only.
+// Records are decoded in place; pages are streamed in by the OS as the cursor advances.
+class CaptureReader {
+private:
+    HANDLE hFile;
+    HANDLE hMapping;
+    const UCHAR* data;
+    ULONG64 end;                // Offset after the last readable record
+    ULONG64 offset;             // Next record
+    CaptureFileHeader header;
+
+public:
+    CaptureReader() : hFile(INVALID_HANDLE_VALUE), hMapping(NULL), data(NULL), end(0), offset(0) {
+        memset(&header, 0, sizeof(header));
+    }
+
+    ~CaptureReader() {
+        Close();
+    }
+
+    bool Open(const char* path) {
+        hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            printf("Error: Cannot open capture file '%s' (Error: %lu)\n", path, GetLastError());
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(CaptureFileHeader)) {
+            printf("Error: '%s' is not a capture file\n", path);
+            Close();
+            return false;
+        }
+
+        hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping != NULL) data = (const UCHAR*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == NULL) {
+            printf("Error: Failed to map capture file (Error: %lu)\n", GetLastError());
+            Close();
+            return false;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != CAPTURE_VERSION ||
+            header.headerSize < sizeof(header) || header.headerSize > (ULONG64)fileSize.QuadPart) {
+            printf("Error: '%s' is not a version %d capture file\n", path, CAPTURE_VERSION);
+            Close();
+            return false;
+        }
+
+        // An unfinished capture (crash, still recording) is read up to its end marker
+        end = (ULONG64)fileSize.QuadPart;
+        if ((header.flags & CAPTURE_FLAG_COMPLETE) && header.dataEnd <= end) end = header.dataEnd;
+        Rewind();
+        return true;
+    }
+
+    void Close() {
+        if (data != NULL) {
+            UnmapViewOfFile(data);
+            data = NULL;
+        }
+        if (hMapping != NULL) {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    const CaptureFileHeader& Header() const { return header; }
+    bool Complete() const { return (header.flags & CAPTURE_FLAG_COMPLETE) != 0; }
+    void Rewind() { offset = header.headerSize; }
+
+    // Next record; payload points into the mapping. False at the end of the capture
+    // or at a truncated record.
+    bool Next(CaptureRecordHeader& rec, const UCHAR*& payload) {
+        if (offset + sizeof(rec) > end) return false;
+        memcpy(&rec, data + offset, sizeof(rec));
+
+        ULONG64 size;
+        if (rec.type == CAPTURE_REC_KEYFRAME) {
+            size = sizeof(CaptureKeyframe);
+        } else if (rec.type == CAPTURE_REC_DELTA) {
+            size = (ULONG64)rec.count * 2;
+        } else {
+            return false;
+        }
+        if (offset + sizeof(rec) + size > end) return false;
+
+        payload = data + offset + sizeof(rec);
+        offset += sizeof(rec) + size;
+        return true;
+    }
+
+    // Readable records, walked from the start; unlike header.recordCount this is also right
+    // for a capture that was never closed. Leaves the reader rewound.
+    ULONG64 CountRecords() {
+        ULONG64 count = 0;
+        CaptureRecordHeader rec;
+        const UCHAR* payload;
+        Rewind();
+        while (Next(rec, payload)) count++;
+        Rewind();
+        return count;
+    }
+};
+
+// Buffered stdout for machine-readable output. Text is formatted into memory and written
+// with one WriteFile per Flush(), so a batch of lines costs a single syscall.
+class OutputBuffer {
+private:
+    HANDLE hOut;
+    std::vector<char> data;
+    size_t used;
+    bool failed;
+
+public:
+    OutputBuffer() : hOut(GetStdHandle(STD_OUTPUT_HANDLE)), data(OUTPUT_BUFFER_BYTES), used(0), failed(false) {}
+    explicit OutputBuffer(HANDLE out) : hOut(out), data(OUTPUT_BUFFER_BYTES), used(0), failed(false) {}
+
+    bool Failed() const { return failed; }
+
+    void Printf(const char* format, ...) {
+        if (data.size() - used < OUTPUT_MAX_LINE) Flush();
+
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(&data[used], data.size() - used, format, args);
+        va_end(args);
+
+        if (len > 0) used += ((size_t)len < data.size() - used) ? (size_t)len : data.size() - used - 1;
+    }
+
+    void Write(const void* bytes, size_t size) {
+        if (data.size() - used < size) Flush();
+        if (size > data.size()) return;
+        memcpy(&data[used], bytes, size);
+        used += size;
+    }
+
+    // Quoted JSON string; quotes, backslashes and control characters escaped
+    void JsonString(const char* text) {
+        Write("\"", 1);
+        for (const char* p = text; *p != '\0'; p++) {
+            if (*p == '"' || *p == '\\') {
+                char escaped[2] = {'\\', *p};
+                Write(escaped, 2);
+            } else if ((UCHAR)*p < 0x20) {
+                Printf("\\u%04x", (UCHAR)*p);
+            } else {
+                Write(p, 1);
+            }
+        }
+        Write("\"", 1);
+    }
+
+    // CSV field, quoted (with doubled quotes) only when it contains a separator, quote or line break
+    void CsvField(const char* text) {
+        if (strpbrk(text, ",\"\r\n") == NULL) {
+            Write(text, strlen(text));
+            return;
+        }
+        Write("\"", 1);
+        for (const char* p = text; *p != '\0'; p++) {
+            Write(p, 1);
+            if (*p == '"') Write(p, 1);
+        }
+        Write("\"", 1);
+    }
+
+    // Returns false once the reader has gone away (e.g. a closed pipe)
+    bool Flush() {
+        if (used == 0 || failed) {
+            used = 0;
+            return !failed;
+        }
+        fflush(stdout);     // Keep ordering with any earlier printf output
+
+        size_t offset = 0;
+        while (offset < used) {
+            DWORD written = 0;
+            if (!WriteFile(hOut, &data[offset], (DWORD)(used - offset), &written, NULL) || written == 0) {
+                failed = true;
+                break;
+            }
+            offset += written;
+        }
+        used = 0;
+        return !failed;
+    }
+};
+
+// ISO 8601 UTC with milliseconds, for JSON output
+static void FormatIsoTime(ULONG64 wallTime, char* out, size_t outSize) {
+    FILETIME utc;
+    SYSTEMTIME st;
+    utc.dwLowDateTime = (DWORD)wallTime;
+    utc.dwHighDateTime = (DWORD)(wallTime >> 32);
+    if (!FileTimeToSystemTime(&utc, &st)) {
+        snprintf(out, outSize, "?");
+        return;
+    }
+    snprintf(out, outSize, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+}
+
+// Which value changes the watch command reports
+struct WatchPredicate {
+    int threshold;      // Minimum distance from the last reported value (1 = any change)
+    bool useRange;      // Only report crossings into or out of [rangeLo, rangeHi]
+    int rangeLo;
+    int rangeHi;
+
+    WatchPredicate() : threshold(1), useRange(false), rangeLo(0), rangeHi(255) {}
+
+    bool InRange(UCHAR value) const { return value >= rangeLo && value <= rangeHi; }
+};
+
+// Emits one JSON line per change event, on the acquisition thread, so no scan is ever skipped.
+// The first successful read of a register sets its baseline and is not reported.
+class ChangeEventSink : public SnapshotSink {
+private:
+    OutputBuffer& out;
+    WatchPredicate predicate;
+    UCHAR last[256];            // Previous value read
+    UCHAR reported[256];        // Value at the last reported event (threshold baseline)
+    ECRegisterMask known;
+    ULONG64 events;
+
+public:
+    ChangeEventSink(OutputBuffer& output, const WatchPredicate& watchPredicate)
+        : out(output), predicate(watchPredicate), events(0) {
+        memset(last, 0, sizeof(last));
+        memset(reported, 0, sizeof(reported));
+    }
+
+    ULONG64 Events() const { return events; }
+
+    void OnSnapshot(const ECSnapshot& snap) {
+        char timestamp[40];
+        timestamp[0] = '\0';
+
+        for (int reg = 0; reg < 256; reg++) {
+            if (!snap.valid.Test((UCHAR)reg)) continue;
+            UCHAR value = snap.values[reg];
+            if (!known.Test((UCHAR)reg)) {
+                known.Set((UCHAR)reg);
+                last[reg] = value;
+                reported[reg] = value;
+                continue;
+            }
+
+            UCHAR old = last[reg];
+            last[reg] = value;
+            if (value == old || abs((int)value - (int)reported[reg]) < predicate.threshold) continue;
+
+            const char* edge = NULL;
+            if (predicate.useRange) {
+                bool wasIn = predicate.InRange(old);
+                bool isIn = predicate.InRange(value);
+                if (wasIn == isIn) continue;
+                edge = isIn ? "enter" : "leave";
+            }
+
+            if (timestamp[0] == '\0') FormatIsoTime(snap.wallTime, timestamp, sizeof(timestamp));
+            if (edge != NULL) {
+                out.Printf("{\"ts\":\"%s\",\"seq\":%llu,\"reg\":\"0x%02X\",\"old\":%u,\"new\":%u,\"event\":\"%s\"}\n",
+                           timestamp, (unsigned long long)snap.sequence, reg, old, value, edge);
+            } else {
+                out.Printf("{\"ts\":\"%s\",\"seq\":%llu,\"reg\":\"0x%02X\",\"old\":%u,\"new\":%u}\n",
+                           timestamp, (unsigned long long)snap.sequence, reg, old, value);
+            }
+            reported[reg] = value;
+            events++;
+        }
+
+        // Quiet scans write nothing; a scan with events costs one write
+        if (timestamp[0] != '\0') out.Flush();
+    }
+};
+
+// Decoded register state while walking a capture
+struct CaptureCursor {
+    UCHAR values[256];
+    ECRegisterMask known;
+    ULONG64 index;              // Records applied
+    ULONG64 timeUs;             // Since the first record
+    ULONG64 wallTime;           // FILETIME of the current record
+
+    CaptureCursor() : index(0), timeUs(0), wallTime(0) {
+        memset(values, 0, sizeof(values));
+    }
+
+    // Apply one record. changedRegs/oldValues (256 entries each) receive the registers it
+    // changed and their previous values; returns the number of changes.
+    int Apply(const CaptureRecordHeader& rec, const UCHAR* payload, UCHAR* changedRegs, UCHAR* oldValues) {
+        int changes = 0;
+        if (index > 0) {
+            timeUs += rec.deltaUs;
+            wallTime += (ULONG64)rec.deltaUs * 10;
+        }
+
+        if (rec.type == CAPTURE_REC_KEYFRAME) {
+            CaptureKeyframe key;
+            memcpy(&key, payload, sizeof(key));
+            wallTime = key.wallTime;
+            // Keyframes normally restate the current state; only walk them when they don't
+            if (memcmp(key.values, values, sizeof(values)) != 0 || memcmp(&key.known, &known, sizeof(known)) != 0) {
+                for (int i = 0; i < 256; i++) {
+                    if (!key.known.Test((UCHAR)i)) continue;
+                    if (known.Test((UCHAR)i) && key.values[i] == values[i]) continue;
+                    changedRegs[changes] = (UCHAR)i;
+                    oldValues[changes] = values[i];
+                    changes++;
+                }
+                memcpy(values, key.values, sizeof(values));
+                known = key.known;
+            }
+        } else {
+            for (int i = 0; i < rec.count; i++) {
+                UCHAR reg = payload[i * 2];
+                UCHAR value = payload[i * 2 + 1];
+                if (known.Test(reg) && values[reg] == value) continue;
+                changedRegs[changes] = reg;
+                oldValues[changes] = values[reg];
+                changes++;
+                values[reg] = value;
+                known.Set(reg);
+            }
+        }
+
+        index++;
+        return changes;
+    }
+};
+
+// Pipe messages (one request, one response per round trip)
+struct ServeRequest {
+    ULONG version;
+    ULONG reserved;
+    ECRegisterMask mask;        // Registers to read
+};
+
+struct ServeResponse {
+    ULONG version;
+    ULONG status;
+    ECRegisterMask valid;       // Registers read successfully
+    UCHAR values[256];
+};
+
+static_assert(sizeof(ServeRequest) == 8 + 32, "ServeRequest layout is part of the pipe protocol");
+static_assert(sizeof(ServeResponse) == 8 + 32 + 256, "ServeResponse layout is part of the pipe protocol");
+
+enum ServeInstanceState {
+    SERVE_CONNECTING,           // Waiting for a client
+    SERVE_READING,              // Waiting for the client's next request
+    SERVE_QUEUED,               // Request received, waiting for the next batch
+    SERVE_BROKEN                // Instance could not be (re)armed
+};
+
+// One overlapped named pipe instance
+struct ServeInstance {
+    HANDLE pipe;
+    OVERLAPPED overlapped;
+    ServeInstanceState state;
+    ServeRequest request;
+    ServeResponse response;
+};
+
+// Typed multi-byte field (-r 4A:u16le, or a name from --profile)
+enum FieldType {
+    FIELD_U8,
+    FIELD_S8,
+    FIELD_U16LE,
+    FIELD_U16BE,
+    FIELD_S16LE,
+    FIELD_S16BE,
+    FIELD_TYPES
+};
+
+struct FieldTypeInfo {
+    const char* name;
+    int size;                   // Registers, starting at the field's base register
+    bool isSigned;
+    bool bigEndian;             // Base register holds the high byte
+};
+
+static const FieldTypeInfo g_fieldTypes[FIELD_TYPES] = {
+    { "u8",    1, false, false },
+    { "s8",    1, true,  false },
+    { "u16le", 2, false, false },
+    { "u16be", 2, false, true  },
+    { "s16le", 2, true,  false },
+    { "s16be", 2, true,  true  },
+};
+
+static bool ParseFieldType(const char* name, FieldType* type) {
+    for (int t = 0; t < FIELD_TYPES; t++) {
+        if (strcmp(name, g_fieldTypes[t].name) == 0) {
+            *type = (FieldType)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct ECField {
+    char name[FIELD_NAME_MAX];  // "" for inline fields
+    UCHAR reg;                  // Base (lowest) register
+    FieldType type;
+    double scale;               // Reported value = decoded * scale
+    char unit[FIELD_UNIT_MAX];
+
+    ECField() : reg(0), type(FIELD_U8), scale(1.0) {
+        name[0] = '\0';
+        unit[0] = '\0';
+    }
+
+    int Size() const { return g_fieldTypes[type].size; }
+    // Register reads of one pass: a verified 16-bit field reads its high byte twice
+    int Reads(bool verify) const { return Size() + ((verify && Size() == 2) ? 1 : 0); }
+    UCHAR LowReg() const { return (Size() == 1 || !g_fieldTypes[type].bigEndian) ? reg : (UCHAR)(reg + 1); }
+    UCHAR HighReg() const { return (Size() == 1 || g_fieldTypes[type].bigEndian) ? reg : (UCHAR)(reg + 1); }
+
+    // Integer value of the raw bytes (lo, hi; hi ignored for 8-bit types)
+    LONG Decode(UCHAR lo, UCHAR hi) const {
+        if (Size() == 1) return g_fieldTypes[type].isSigned ? (LONG)(signed char)lo : (LONG)lo;
+        USHORT raw = (USHORT)((hi << 8) | lo);
+        return g_fieldTypes[type].isSigned ? (LONG)(SHORT)raw : (LONG)raw;
+    }
+};
+
+struct ECFieldValue {
+    bool ok;
+    bool torn;                  // Verification never saw the high byte hold still
+    int tears;                  // Re-reads forced by a changed high byte
+    UCHAR lo;
+    UCHAR hi;
+    LONG value;
+};
+
+// Field definitions, one per line: <name> <reg> <type> [scale] [unit]; '#' starts a comment.
+//   fan_rpm   4A  u16le
+//   pack_mv   A0  u16le  1      mV
+//   cpu_temp  30  s8     1      C
+class FieldProfile {
+private:
+    std::vector<ECField> fields;
+
+    bool ParseLine(char* line, const char* path, int lineNumber) {
+        char* hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+
+        char* context = NULL;
+        char* tokens[5];
+        int count = 0;
+        for (char* token = strtok_s(line, " \t\r", &context); token != NULL; token = strtok_s(NULL, " \t\r", &context)) {
+            if (count == 5) {
+                printf("Error: %s:%d: too many columns (expected <name> <reg> <type> [scale] [unit])\n", path, lineNumber);
+                return false;
+            }
+            tokens[count++] = token;
+        }
+        if (count == 0) return true;
+        if (count < 3) {
+            printf("Error: %s:%d: expected <name> <reg> <type> [scale] [unit]\n", path, lineNumber);
+            return false;
+        }
+
+        ECField field;
+        char* end = NULL;
+        unsigned long reg = strtoul(tokens[1], &end, 16);
+        if (!ParseFieldType(tokens[2], &field.type)) {
+            printf("Error: %s:%d: unknown type '%s' (u8, s8, u16le, u16be, s16le, s16be)\n", path, lineNumber, tokens[2]);
+            return false;
+        }
+        if (end == tokens[1] || *end != '\0' || reg + field.Size() > 256) {
+            printf("Error: %s:%d: register '%s' out of range\n", path, lineNumber, tokens[1]);
+            return false;
+        }
+        if (strlen(tokens[0]) >= sizeof(field.name) || strchr(tokens[0], ':') != NULL || Find(tokens[0]) != NULL) {
+            printf("Error: %s:%d: field name '%s' is too long, contains ':' or is defined twice\n", path, lineNumber, tokens[0]);
+            return false;
+        }
+        strncpy_s(field.name, sizeof(field.name), tokens[0], _TRUNCATE);
+        field.reg = (UCHAR)reg;
+        if (count >= 4) {
+            field.scale = strtod(tokens[3], &end);
+            if (end == tokens[3] || *end != '\0' || field.scale == 0.0) {
+                printf("Error: %s:%d: invalid scale '%s'\n", path, lineNumber, tokens[3]);
+                return false;
+            }
+        }
+        if (count == 5) strncpy_s(field.unit, sizeof(field.unit), tokens[4], _TRUNCATE);
+        fields.push_back(field);
+        return true;
+    }
+
+public:
+    bool Load(const char* path) {
+        HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            printf("Error: Cannot open profile %s (Error: %lu)\n", path, GetLastError());
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart > FIELD_PROFILE_MAX_BYTES) {
+            printf("Error: Profile %s is larger than %d bytes\n", path, FIELD_PROFILE_MAX_BYTES);
+            CloseHandle(hFile);
+            return false;
+        }
+        std::vector<char> text((size_t)fileSize.QuadPart + 1);
+        DWORD read = 0;
+        BOOL ok = ReadFile(hFile, text.data(), (DWORD)fileSize.QuadPart, &read, NULL);
+        CloseHandle(hFile);
+        if (!ok) {
+            printf("Error: Cannot read profile %s (Error: %lu)\n", path, GetLastError());
+            return false;
+        }
+        text[read] = '\0';
+
+        int lineNumber = 0;
+        for (char* line = text.data(); line != NULL; ) {
+            char* next = strchr(line, '\n');
+            if (next != NULL) *next++ = '\0';
+            if (!ParseLine(line, path, ++lineNumber)) return false;
+            line = next;
+        }
+        return true;
+    }
+
+    const ECField* Find(const char* name) const {
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (strcmp(fields[i].name, name) == 0) return &fields[i];
+        }
+        return NULL;
+    }
+
+    const std::vector<ECField>& Fields() const { return fields; }
+};
+
+// Parse one -r entry as a field: a profile name, <reg>:<type>, or a plain register (u8).
+static bool ParseFieldSpec(const char* spec, const FieldProfile& profile, ECField* field) {
+    const ECField* named = profile.Find(spec);
+    if (named != NULL) {
+        *field = *named;
+        return true;
+    }
+
+    *field = ECField();
+    char* end = NULL;
+    unsigned long reg = strtoul(spec, &end, 16);
+    if (end == spec || (*end != '\0' && *end != ':')) {
+        printf("Error: '%s' is neither a register, <reg>:<type> nor a field of the profile\n", spec);
+        return false;
+    }
+    if (*end == ':' && !ParseFieldType(end + 1, &field->type)) {
+        printf("Error: unknown field type in '%s' (u8, s8, u16le, u16be, s16le, s16be)\n", spec);
+        return false;
+    }
+    if (reg + field->Size() > 256) {
+        printf("Error: field '%s' runs past register 0xFF\n", spec);
+        return false;
+    }
+    field->reg = (UCHAR)reg;
+    return true;
+}
+
+// What one trace entry recorded. Status polls are folded into one wait entry per wait.
+enum ECTraceOp {
+    TRACE_PORT_READ,
+    TRACE_PORT_WRITE,
+    TRACE_WAIT_IBF,     // arg = polls, micros = wait, value = last status
+    TRACE_WAIT_OBF,
+    TRACE_LOCK,         // Access_EC acquired (or not), micros = wait
+    TRACE_UNLOCK
+};
+
+struct ECTraceEntry {
+    LONGLONG qpc;           // When the access or wait completed
+    volatile LONG64 seq;    // Event number + 1 once the entry is complete, 0 while it is written
+    ULONG arg;              // Error code of a failed IOCTL, polls, block size
+    ULONG micros;
+    USHORT port;
+    UCHAR op;
+    UCHAR value;
+    bool ok;
+};
+
+// Fixed ring of binary trace entries. Recording is a few stores and one interlocked increment,
+// so it stays on even at full scan rates; entries are formatted only when dumped. Dumps may
+// run on another thread than the recording one: an entry overwritten while it is copied is
+// skipped, the same way SharedSnapshot readers retry.
+class ECTraceRing {
+private:
+    std::vector<ECTraceEntry> entries;
+    volatile LONG64 next;   // Events recorded so far
+    LONG64 echoed;          // Events already echoed by -v
+    LONG64 dumped;          // Events already written by DumpNew
+
+    static_assert((TRACE_ENTRIES & (TRACE_ENTRIES - 1)) == 0, "TRACE_ENTRIES must be a power of two");
+
+    // Consistent copy of event 'index', false if it was overwritten or is still being written
+    bool Copy(LONG64 index, ECTraceEntry& out) const {
+        const ECTraceEntry& slot = entries[index & (TRACE_ENTRIES - 1)];
+        if (slot.seq != index + 1) return false;
+        _ReadWriteBarrier();
+        out.qpc = slot.qpc;
+        out.arg = slot.arg;
+        out.micros = slot.micros;
+        out.port = slot.port;
+        out.op = slot.op;
+        out.value = slot.value;
+        out.ok = slot.ok;
+        _ReadWriteBarrier();
+        return slot.seq == index + 1;
+    }
+
+    static void FormatEntry(OutputBuffer& out, const char* prefix, const ECTraceEntry& e, double ms, double deltaUs) {
+        out.Printf("%s%10.3f ms %+9.1f us  ", prefix, ms, deltaUs);
+        switch (e.op) {
+        case TRACE_PORT_READ:
+            if (e.ok) out.Printf("read   0x%02X -> 0x%02X\n", e.port, e.value);
+            else out.Printf("read   0x%02X FAILED (error %lu)\n", e.port, e.arg);
+            break;
+        case TRACE_PORT_WRITE:
+            if (e.ok) out.Printf("write  0x%02X <- 0x%02X\n", e.port, e.value);
+            else out.Printf("write  0x%02X <- 0x%02X FAILED (error %lu)\n", e.port, e.value, e.arg);
+            break;
+        case TRACE_WAIT_IBF:
+        case TRACE_WAIT_OBF:
+            out.Printf("wait   %s %s, %lu polls, %lu us, status 0x%02X\n",
+                       e.op == TRACE_WAIT_IBF ? "IBF=0" : "OBF=1", e.ok ? "ok" : "TIMED OUT",
+                       e.arg, e.micros, e.value);
+            break;
+        case TRACE_LOCK:
+            out.Printf("lock   Access_EC %s after %lu us\n", e.ok ? "acquired" : "NOT acquired", e.micros);
+            break;
+        case TRACE_UNLOCK:
+            out.Printf("unlock Access_EC\n");
+            break;
+        }
+    }
+
+    // Events [from, Next()) that are still in the ring; returns the new marker
+    LONG64 Format(OutputBuffer& out, const char* prefix, LONG64 from, bool header) const {
+        LONG64 end = next;
+        LONG64 first = from;
+        if (end - first > TRACE_ENTRIES) first = end - TRACE_ENTRIES;
+        if (header) {
+            out.Printf("%s=== EC trace: events %lld-%lld", prefix, (long long)first + 1, (long long)end);
+            if (first > from) out.Printf(" (%lld earlier overwritten)", (long long)(first - from));
+            out.Printf(" ===\n");
+        }
+
+        LONGLONG baseQpc = 0;
+        LONGLONG prevQpc = 0;
+        int skipped = 0;
+        for (LONG64 index = first; index < end; index++) {
+            ECTraceEntry e;
+            if (!Copy(index, e)) {
+                skipped++;
+                continue;
+            }
+            if (baseQpc == 0) baseQpc = prevQpc = e.qpc;
+            FormatEntry(out, prefix, e, QpcToMs(e.qpc - baseQpc), QpcToMs(e.qpc - prevQpc) * 1000.0);
+            prevQpc = e.qpc;
+        }
+        if (skipped > 0) out.Printf("%s(%d events overwritten while dumping)\n", prefix, skipped);
+        return end;
+    }
+
+public:
+    static const bool compiled = true;
+
+    ECTraceRing() : entries(TRACE_ENTRIES), next(0), echoed(0), dumped(0) {}
+
+    inline void Record(ECTraceOp op, USHORT port, UCHAR value, bool ok, ULONG arg = 0, ULONG micros = 0) {
+        LONG64 index = InterlockedIncrement64(&next) - 1;
+        ECTraceEntry& slot = entries[index & (TRACE_ENTRIES - 1)];
+        slot.seq = 0;
+        _ReadWriteBarrier();
+        slot.qpc = QpcNow();
+        slot.arg = arg;
+        slot.micros = micros;
+        slot.port = port;
+        slot.op = (UCHAR)op;
+        slot.value = value;
+        slot.ok = ok;
+        _ReadWriteBarrier();
+        slot.seq = index + 1;
+    }
+
+    LONG64 Events() const { return next; }
+
+    // -v: print what happened since the last echo, as [Verbose] lines
+    void Echo() {
+        if (next == echoed) return;
+        OutputBuffer out;
+        echoed = Format(out, "[Verbose]   ", echoed, false);
+        out.Flush();
+    }
+
+    // Everything still in the ring (exit, T in monitor)
+    bool DumpAll(HANDLE hOut) const {
+        OutputBuffer out(hOut);
+        Format(out, "", 0, true);
+        return out.Flush();
+    }
+
+    // Events since the previous DumpNew (--trace error): what led up to the failure
+    void DumpNew(HANDLE hOut) {
+        OutputBuffer out(hOut);
+        dumped = Format(out, "", dumped, true);
+        out.Flush();
+    }
+};
+
+// ECREADER_TRACE=0 build: same interface, nothing recorded, nothing left in the IOCTL loop
+class ECTraceOff {
+public:
+    static const bool compiled = false;
+
+    inline void Record(ECTraceOp, USHORT, UCHAR, bool, ULONG = 0, ULONG = 0) {}
+    LONG64 Events() const { return 0; }
+    void Echo() {}
+    bool DumpAll(HANDLE) const { return false; }
+    void DumpNew(HANDLE) {}
+};
+
+#if ECREADER_TRACE
+typedef ECTraceRing ECTrace;
+#else
+typedef ECTraceOff ECTrace;
+#endif
+
+// Set by the console control handler; long-running modes poll it to shut down cleanly
+static volatile LONG g_stopRequested = 0;
+
+static BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType) {
+    if (ctrlType == CTRL_C_EVENT || ctrlType == CTRL_BREAK_EVENT) {
+        InterlockedExchange(&g_stopRequested, 1);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+class ECReader {
+private:
+    HANDLE hMutex;
+    bool verboseMode;
+
+public:
+    bool suppressVerbose;
+
+private:
+    int mutexWaitFailures;
+    int mutexRetries;
+    int successfulReads;
+    int failedReads;
+    int retryCount;  // Track retry attempts
+
+    // Burst mode for batched reads (--burst); support is probed on first use
+    enum BurstSupport { BURST_UNKNOWN, BURST_UNSUPPORTED, BURST_SUPPORTED };
+    bool burstEnabled;
+    BurstSupport burstSupport;
+    int burstSessions;
+    int burstFallbacks;     // Enable not acknowledged after support was confirmed
+    int burstDrops;         // EC left burst mode before we disabled it
+
+    // Typed field reads (-r 4A:u16le): fields read, re-reads forced by a moving high byte,
+    // fields that never read consistently
+    int fieldReads;
+    int fieldTears;
+    int fieldTorn;
+
+    // Acquisition thread profile (--realtime, --cpu), and what was actually applied for -s
+    bool realtimeProfile;
+    int acquisitionCpu;
+    char acquisitionProfile[128];
+
+    // EC bus budget shared with other ECReader processes (--budget sets the ceiling)
+    BusGovernor governor;
+    BusGovernor xramGovernor;   // Index/data port bytes (xdump/xmonitor), private to this process
+    int budgetCeiling;          // 0 = keep the shared ceiling (default EC_READ_BUDGET_PER_SEC)
+    bool budgetChargeOnly;      // Bench: count reads against the budget but never wait
+
+    PawnIOTransport pawnio;     // Default backend
+    ECTransport* transport;     // Active backend (pawnio or e.g. a SimulatedTransport)
+
+    // Port pair this instance talks to (--channel); labelChannel names it in titles and -s
+    // even when it is the primary pair, for sessions scanning several channels
+    ECChannel channel;
+    bool labelChannel;
+    char tracePath[MAX_PATH];   // T key: TRACE_FILE, with the port pair when labeled
+    char traceErrorPath[MAX_PATH];  // --trace error under a full-screen frame: TRACE_ERROR_FILE, likewise
+    char traceStatus[48];       // Outcome of the last T, for the status line
+    ULONG traceSaves;           // T presses handled, so frames know to redraw
+
+    ECWaitPolicy waitPolicy;
+    LockChunkPolicy lockChunks;     // Registers per Access_EC hold (--lock-chunk)
+    ECFaultPolicy faults;           // Failure backoff, register quarantine, breaker
+    ECFailure lastFailure;          // Class of the most recent failed step of the EC protocol
+
+    // Port-level trace: -v echoes it after each handshake, --trace error dumps it after a
+    // failed read once Access_EC is released
+    ECTrace trace;
+    bool traceOnError;
+    bool traceOnExit;
+    bool traceDumpPending;
+    HANDLE hTraceErrors;        // Opened on the first dump that can't go to the console
+    volatile LONG traceErrorDumps;
+
+    // ETW health window (ETW_KEYWORD_HEALTH): counters when it started, histograms of its scans
+    bool eventsRegistered;
+    LONGLONG healthStart;       // 0 = no session listening
+    int healthScans;
+    int healthReads;
+    int healthFailed;
+    int healthRetries;
+    LatencyHistogram healthMutexWait;
+    LatencyHistogram healthScanDuration;
+
+    // Latency histograms: cumulative for -s, and for the scan in progress (Monitor summary)
+    ECPhaseStats phaseTotals;
+    ECPhaseStats phaseScan;
+
+    void RecordPhase(LatencyHistogram ECPhaseStats::*phase, ULONG64 value) {
+        (phaseTotals.*phase).Record(value);
+        (phaseScan.*phase).Record(value);
+    }
+
+    bool AcquireMutex() {
+        if (hMutex == NULL) {
+            if (verboseMode) printf("Warning: No mutex available\n");
+            return true;
+        }
+
+        LONGLONG waitStart = QpcNow();
+        int tries = faults.BackingOff(EC_FAIL_MUTEX) ? 1 : MUTEX_RETRY_COUNT;
+        for (int retry = 0; retry < tries; retry++) {
+            DWORD waitResult = WaitForSingleObject(hMutex, MUTEX_TIMEOUT_MS);
+            
+            if (waitResult == WAIT_OBJECT_0) {
+                ULONG64 waitUs = QpcToMicros(QpcNow() - waitStart);
+                trace.Record(TRACE_LOCK, 0, 0, true, 0, (ULONG)waitUs);
+                RecordPhase(&ECPhaseStats::mutexWait, waitUs);
+                lockChunks.OnAcquire(waitUs, retry > 0);
+                faults.OnMutexAcquired();
+                if (verboseMode && retry > 0) printf("Mutex acquired after %d retries\n", retry);
+                if (retry > 0) mutexRetries++;
+                return true;
+            }
+            else if (waitResult == WAIT_ABANDONED) {
+                ULONG64 waitUs = QpcToMicros(QpcNow() - waitStart);
+                trace.Record(TRACE_LOCK, 0, 0, true, 0, (ULONG)waitUs);
+                RecordPhase(&ECPhaseStats::mutexWait, waitUs);
+                lockChunks.OnAcquire(waitUs, retry > 0);
+                faults.OnMutexAcquired();
+                if (verboseMode) printf("Warning: Mutex was abandoned\n");
+                return true;
+            }
+            else if (waitResult == WAIT_TIMEOUT) {
+                if (verboseMode) printf("Mutex timeout (attempt %d/%d)\n", retry + 1, tries);
+                if (retry < tries - 1) Sleep(MUTEX_RETRY_DELAY_MS);
+            }
+            else {
+                if (verboseMode) printf("Mutex wait failed: %lu\n", GetLastError());
+                break;
+            }
+        }
+        
+        // Failed waits go into the histogram too, or contention would only ever show as fast grabs
+        ULONG64 waitUs = QpcToMicros(QpcNow() - waitStart);
+        trace.Record(TRACE_LOCK, 0, 0, false, 0, (ULONG)waitUs);
+        RecordPhase(&ECPhaseStats::mutexWait, waitUs);
+        mutexWaitFailures++;
+        lastFailure = EC_FAIL_MUTEX;
+        faults.OnAttemptFailed(EC_FAIL_MUTEX);
+        if (traceOnError) traceDumpPending = true;
+        FlushTrace();
+        return false;
+    }
+
+    void ReleaseMutexSafe() {
+        if (hMutex != NULL) {
+            trace.Record(TRACE_UNLOCK, 0, 0, true);
+            ReleaseMutex(hMutex);
+        }
+        FlushTrace();
+    }
+
+    // Trace output that had to wait until nothing is timing-critical
+    void FlushTrace() {
+        if (verboseMode && !suppressVerbose) trace.Echo();
+        if (traceDumpPending) {
+            traceDumpPending = false;
+            if (g_fullScreenFrames == 0) {
+                fflush(stdout);
+                trace.DumpNew(GetStdHandle(STD_ERROR_HANDLE));
+                return;
+            }
+            if (hTraceErrors == NULL) {
+                hTraceErrors = CreateFileA(traceErrorPath, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (hTraceErrors == INVALID_HANDLE_VALUE) hTraceErrors = NULL;
+            }
+            if (hTraceErrors != NULL) {
+                trace.DumpNew(hTraceErrors);
+                InterlockedIncrement(&traceErrorDumps);
+            }
+        }
+    }
+
+public:
+    ECReader() : hMutex(NULL), verboseMode(false),
+                 suppressVerbose(false), mutexWaitFailures(0), mutexRetries(0),
+                 successfulReads(0), failedReads(0), retryCount(0),
+                 burstEnabled(false), burstSupport(BURST_UNKNOWN), burstSessions(0), burstFallbacks(0), burstDrops(0),
+                 fieldReads(0), fieldTears(0), fieldTorn(0),
+                 
+                 realtimeProfile(false), acquisitionCpu(-1), budgetCeiling(0), budgetChargeOnly(false),
+                 transport(&pawnio), labelChannel(false), lastFailure(EC_FAIL_NONE), traceOnError(false), traceOnExit(false), traceDumpPending(false), hTraceErrors(NULL), traceErrorDumps(0),
+                 eventsRegistered(false), healthStart(0), healthScans(0), healthReads(0), healthFailed(0), healthRetries(0) {
+        acquisitionProfile[0] = '\0';
+        strncpy_s(tracePath, sizeof(tracePath), TRACE_FILE, _TRUNCATE);
+        strncpy_s(traceErrorPath, sizeof(traceErrorPath), TRACE_ERROR_FILE, _TRUNCATE);
+        traceStatus[0] = '\0';
+        traceSaves = 0;
+        faults.SetChannelName(channel.name);
+    }
+
+    void SetVerbose(bool verbose) {
+        verboseMode = verbose;
+        g_verbose = verbose;
+        transport->SetVerbose(verbose);
+    }
+
+    // Switch to another backend (e.g. the simulator); call before Open()
+    void SetTransport(ECTransport* newTransport) {
+        transport = newTransport;
+        transport->SetVerbose(verboseMode);
+    }
+
+    const char* TransportName() const {
+        return transport->Name();
+    }
+
+    // Load the PawnIO module from a file instead of the embedded copy; call before Open()
+    void SetModulePath(const char* path) {
+        pawnio.SetModulePath(path);
+    }
+
+    // Talk to another EC interface (e.g. the 68/6C pair); call before Open()
+    void SetChannel(const ECChannel& newChannel, bool label) {
+        channel = newChannel;
+        faults.SetChannelName(channel.name);
+        labelChannel = label || !newChannel.IsPrimary();
+        if (labelChannel) {
+            ChannelFilePath(TRACE_FILE, channel, tracePath, sizeof(tracePath));
+            ChannelFilePath(TRACE_ERROR_FILE, channel, traceErrorPath, sizeof(traceErrorPath));
+        } else {
+            strncpy_s(tracePath, sizeof(tracePath), TRACE_FILE, _TRUNCATE);
+            strncpy_s(traceErrorPath, sizeof(traceErrorPath), TRACE_ERROR_FILE, _TRUNCATE);
+        }
+    }
+
+    const ECChannel& Channel() const {
+        return channel;
+    }
+
+    bool LabelsChannel() const {
+        return labelChannel;
+    }
+
+    bool Open() {
+        if (!transport->Open()) {
+            return false;
+        }
+
+        // Cheap while no session listens; lets one attach to a long-running monitor at any time
+        if (!eventsRegistered) {
+            g_events.Register();
+            eventsRegistered = true;
+        }
+
+        // Real hardware shares one budget per port pair machine-wide; a simulated EC has its own bus
+        bool sharedBus = transport->UsesSystemMutex();
+        if (!governor.Open(sharedBus, channel.Tag(), budgetCeiling)) {
+            if (verboseMode) printf("[Verbose] Warning: Bus budget unavailable (Error: %lu), reads are not paced\n", GetLastError());
+        }
+
+        if (!transport->UsesSystemMutex()) {
+            const char* privateLock = transport->PrivateLockName();
+            if (privateLock != NULL) hMutex = OpenMutexA(SYNCHRONIZE, FALSE, privateLock);
+            if (verboseMode) {
+                printf("[Verbose] %s transport: Access_EC not used%s\n", transport->Name(),
+                       hMutex != NULL ? ", sharing the simulated peer's lock" : "");
+            }
+            return true;
+        }
+
+        // Access_EC serializes the primary EC only; other interfaces have their own firmware
+        // handshake and nobody else locks them
+        if (!channel.IsPrimary()) {
+            if (verboseMode) printf("[Verbose] Channel %s: Access_EC not used\n", channel.name);
+            return true;
+        }
+
+        // Open the EC mutex
+        hMutex = OpenMutexA(SYNCHRONIZE, FALSE, "Access_EC");
+        if (hMutex == NULL) {
+            hMutex = OpenMutexA(SYNCHRONIZE, FALSE, "Global\\Access_EC");
+        }
+
+        if (hMutex == NULL) {
+            if (verboseMode) printf("[Verbose] Warning: Access_EC mutex not found (Error: %lu), continuing without sync\n", GetLastError());
+        } else {
+            if (verboseMode) printf("[Verbose] EC mutex opened\n");
+        }
+
+        return true;
+    }
+
+    void Close() {
+        if (hMutex != NULL) {
+            CloseHandle(hMutex);
+            hMutex = NULL;
+        }
+        governor.Close();
+        xramGovernor.Close();
+        transport->Close();
+        if (eventsRegistered) {
+            g_events.Unregister();
+            eventsRegistered = false;
+        }
+        if (traceOnExit) {
+            traceOnExit = false;
+            DumpTrace();
+        }
+        if (hTraceErrors != NULL) {
+            CloseHandle(hTraceErrors);
+            hTraceErrors = NULL;
+            fprintf(stderr, "Traces of %ld failures saved to %s\n", (long)traceErrorDumps, traceErrorPath);
+        }
+    }
+
+    // Low-level port I/O through the active transport (timed for the IOCTL histogram, traced).
+    // Nothing is printed here: -v shows the trace once the handshake is over.
+    bool PortRead(USHORT port, UCHAR* value) {
+        if (!PortReadUntraced(port, value)) {
+            trace.Record(TRACE_PORT_READ, port, 0xFF, false, GetLastError());
+            return false;
+        }
+        trace.Record(TRACE_PORT_READ, port, *value, true);
+        return true;
+    }
+
+    // Status polls of WaitECStatus, which traces the whole wait as one entry
+    bool PortReadUntraced(USHORT port, UCHAR* value) {
+        LONGLONG ioStart = QpcNow();
+        bool result = transport->PortRead(port, value);
+        RecordPhase(&ECPhaseStats::ioctl, QpcToMicros(QpcNow() - ioStart));
+
+        if (!result) {
+            lastFailure = EC_FAIL_IOCTL;
+            return false;
+        }
+        return true;
+    }
+
+    bool PortWrite(USHORT port, UCHAR value) {
+        LONGLONG ioStart = QpcNow();
+        bool result = transport->PortWrite(port, value);
+        RecordPhase(&ECPhaseStats::ioctl, QpcToMicros(QpcNow() - ioStart));
+
+        if (!result) {
+            trace.Record(TRACE_PORT_WRITE, port, value, false, GetLastError());
+            lastFailure = EC_FAIL_IOCTL;
+            return false;
+        }
+
+        trace.Record(TRACE_PORT_WRITE, port, value, true);
+        return true;
+    }
+
+    // Poll the EC status port until (status & flag) matches wantSet or the QPC deadline passes.
+    // Backoff between polls is decided by waitPolicy, which learns typical poll counts.
+    bool WaitECStatus(UCHAR flag, bool wantSet, ECWaitKind kind, int timeoutMs, int* pollsOut) {
+        LONGLONG start = QpcNow();
+        LONGLONG deadline = start + QpcTicksFromMs(timeoutMs);
+        int polls = 0;
+        bool ok = false;
+        UCHAR status = 0xFF;
+
+        while (true) {
+            if (!PortReadUntraced(channel.cmd, &status)) {
+                trace.Record(TRACE_PORT_READ, channel.cmd, 0xFF, false, GetLastError());
+                break;
+            }
+            polls++;
+
+            if (((status & flag) != 0) == wantSet) {
+                waitPolicy.Learn(kind, polls, QpcToMicros(QpcNow() - start));
+                ok = true;
+                break;
+            }
+
+            LONGLONG remaining = deadline - QpcNow();
+            if (remaining <= 0) {
+                lastFailure = (kind == EC_WAIT_IBF) ? EC_FAIL_IBF : EC_FAIL_OBF;
+                break;
+            }
+            waitPolicy.Backoff(kind, polls, remaining);
+        }
+
+        ULONG64 elapsed = QpcToMicros(QpcNow() - start);
+        trace.Record(kind == EC_WAIT_IBF ? TRACE_WAIT_IBF : TRACE_WAIT_OBF, channel.cmd, status, ok, polls, (ULONG)elapsed);
+        if (kind == EC_WAIT_IBF) {
+            RecordPhase(&ECPhaseStats::ibfWait, elapsed);
+            RecordPhase(&ECPhaseStats::ibfPolls, polls);
+        } else {
+            RecordPhase(&ECPhaseStats::obfWait, elapsed);
+            RecordPhase(&ECPhaseStats::obfPolls, polls);
+        }
+
+        if (pollsOut) *pollsOut = polls;
+        return ok;
+    }
+
+    // Wait for EC Input Buffer to be empty (IBF=0). timeoutMs 0 = EC_WAIT_TIMEOUT_MS, shortened
+    // while IBF failures back off.
+    bool WaitECReady(int timeoutMs = 0) {
+        if (timeoutMs <= 0) timeoutMs = faults.WaitTimeoutMs(EC_WAIT_IBF, waitPolicy);
+        int polls = 0;
+        if (WaitECStatus(EC_IBF, false, EC_WAIT_IBF, timeoutMs, &polls)) return true;
+        if (verboseMode) printf("[Verbose] WaitECReady timeout after %dms (%d polls)\n", timeoutMs, polls);
+        return false;
+    }
+
+    // Wait for EC Output Buffer to be full (OBF=1), timeout like WaitECReady
+    bool WaitECOBF(int timeoutMs = 0) {
+        if (timeoutMs <= 0) timeoutMs = faults.WaitTimeoutMs(EC_WAIT_OBF, waitPolicy);
+        int polls = 0;
+        if (WaitECStatus(EC_OBF, true, EC_WAIT_OBF, timeoutMs, &polls)) return true;
+        if (verboseMode) printf("[Verbose] WaitECOBF timeout after %dms (%d polls)\n", timeoutMs, polls);
+        return false;
+    }
+
+    // Backoff tuning: 0 = adaptive (learned per machine), N = fixed spin polls before yielding
+    void SetBackoffSpin(int polls) {
+        waitPolicy.SetFixedSpin(polls);
+    }
+
+    // Batched reads enter ACPI burst mode for up to EC_BURST_MAX_REGISTERS registers at a time
+    void SetBurst(bool enable) {
+        burstEnabled = enable;
+    }
+
+    bool BurstEnabled() const {
+        return burstEnabled;
+    }
+
+    // Acquisition thread: real-time profile and optional core pinning (cpu < 0 = any core)
+    void SetAcquisitionProfile(bool realtime, int cpu) {
+        realtimeProfile = realtime;
+        acquisitionCpu = cpu;
+    }
+
+    // Registers per Access_EC hold for batched reads: 0 = adapt to contention (default)
+    void SetLockChunk(int registers) {
+        lockChunks.SetFixedChunk(registers);
+    }
+
+    // Ceiling for the shared EC bus budget in reads/s; call before Open()
+    void SetBudget(int readsPerSec) {
+        budgetCeiling = readsPerSec;
+    }
+
+    // Effective budget after joining the shared bucket (another instance may have lowered it)
+    int BudgetRate() const {
+        return governor.Rate();
+    }
+
+    // --trace error: dump the trace leading up to each failed read to stderr.
+    // --trace exit: dump the whole ring to stderr on Close().
+    void SetTraceDump(bool onError, bool onExit) {
+        traceOnError = onError;
+        traceOnExit = onExit;
+    }
+
+    // Whole trace ring to stderr (--trace exit); false if this build has no trace
+    bool DumpTrace() {
+        fflush(stdout);
+        return trace.DumpAll(GetStdHandle(STD_ERROR_HANDLE));
+    }
+
+    // Whole trace ring into a file (T in monitor), replacing an earlier one
+    bool SaveTrace(const char* path) {
+        if (!ECTrace::compiled) return false;
+        HANDLE hFile = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+        bool ok = trace.DumpAll(hFile);
+        CloseHandle(hFile);
+        return ok;
+    }
+
+    // Tri-state for reports: -1 not probed yet, 0 firmware ignores burst, 1 honored
+    int BurstHonored() const {
+        if (burstSupport == BURST_UNKNOWN) return -1;
+        return burstSupport == BURST_SUPPORTED ? 1 : 0;
+    }
+
+private:
+    // Run the 6-step EC read protocol for one register.
+    // Caller must already hold Access_EC (see AcquireMutex).
+    bool ReadECRegisterLocked(UCHAR reg, UCHAR* value) {
+        bool ok = true;
+        lastFailure = EC_FAIL_NONE;
+
+        // EC Read Protocol:
+        // 1. Wait for IBF=0 (EC ready)
+        // 2. Write 0x80 (read command) to command port (0x66)
+        // 3. Wait for IBF=0
+        // 4. Write register address to data port (0x62)
+        // 5. Wait for OBF=1 (data ready)
+        // 6. Read data from data port (0x62)
+
+        if (verboseMode) {
+            printf("[Verbose] Reading EC register 0x%02X\n", reg);
+        }
+
+        // Step 1: Wait for EC to be ready
+        if (!WaitECReady()) {
+            if (verboseMode) printf("[Verbose] EC not ready before command\n");
+            ok = false;
+        }
+
+        // Step 2: Send read command (0x80)
+        if (ok && !PortWrite(channel.cmd, 0x80)) {
+            if (verboseMode) printf("[Verbose] Failed to write read command\n");
+            ok = false;
+        }
+
+        // Step 3: Wait for EC to accept command
+        if (ok && !WaitECReady()) {
+            if (verboseMode) printf("[Verbose] EC not ready after command\n");
+            ok = false;
+        }
+
+        // Steps 4-6: Critical timing section, recorded in the trace only
+        *value = 0xFF;
+        if (ok) ok = PortWrite(channel.data, reg);      // Step 4: Write register address
+        if (ok) ok = WaitECOBF();                       // Step 5: Wait for data ready
+        if (ok) ok = PortRead(channel.data, value);     // Step 6: Read data
+
+        if (verboseMode && !suppressVerbose) trace.Echo();
+        if (!ok && verboseMode) {
+            printf("[Verbose] EC read sequence failed\n");
+        }
+
+        return ok;
+    }
+
+    // Read one register with per-register retries, without touching the mutex.
+    // Used by the batched readers, which hold Access_EC for the whole set.
+    bool ReadECRegisterRetryLocked(UCHAR reg, UCHAR* value) {
+        LONGLONG readStart = QpcNow();
+        for (int attempt = 0; attempt < EC_MAX_RETRIES; attempt++) {
+            if (ReadECRegisterLocked(reg, value)) {
+                RecordPhase(&ECPhaseStats::registerRead, QpcToMicros(QpcNow() - readStart));
+                if (attempt > 0 && verboseMode) {
+                    printf("[Verbose] Read succeeded on retry %d\n", attempt);
+                }
+                if (verboseMode) {
+                    printf("[Verbose] EC[0x%02X] = 0x%02X\n", reg, *value);
+                }
+                successfulReads++;
+                faults.OnRead(reg, true, EC_FAIL_NONE);
+                return true;
+            }
+
+            // Failed - retry if attempts remaining and this kind of failure isn't backing off
+            faults.OnAttemptFailed(lastFailure, reg);
+            if (attempt < EC_MAX_RETRIES - 1) {
+                if (!faults.RetryAllowed(lastFailure)) break;
+                retryCount++;
+                if (verboseMode) {
+                    printf("[Verbose] Read failed, retry %d/%d\n", attempt + 1, EC_MAX_RETRIES - 1);
+                }
+                Sleep(0);  // Brief yield before retry
+            }
+        }
+
+        // All retries exhausted; --trace error dumps once Access_EC is released
+        RecordPhase(&ECPhaseStats::registerRead, QpcToMicros(QpcNow() - readStart));
+        *value = 0xFF;
+        failedReads++;
+        faults.OnRead(reg, false, lastFailure);
+        if (traceOnError) traceDumpPending = true;
+        return false;
+    }
+
+    // Enter burst mode: write 0x82, the EC answers 0x90 through OBF once it is dedicated to us.
+    // The first unacknowledged attempt marks the firmware as not supporting burst.
+    bool EnterBurstLocked() {
+        UCHAR ack = 0;
+        bool ok = WaitECReady() && PortWrite(channel.cmd, EC_CMD_BURST_ENABLE) &&
+                  WaitECOBF() && PortRead(channel.data, &ack) && ack == EC_BURST_ACK;
+
+        if (ok) {
+            if (burstSupport == BURST_UNKNOWN && verboseMode) printf("[Verbose] EC acknowledged burst mode\n");
+            burstSupport = BURST_SUPPORTED;
+            burstSessions++;
+            return true;
+        }
+
+        if (burstSupport == BURST_UNKNOWN) {
+            if (verboseMode) printf("[Verbose] EC did not acknowledge burst mode (0x%02X), using normal reads\n", ack);
+            burstSupport = BURST_UNSUPPORTED;
+        } else {
+            burstFallbacks++;
+        }
+        return false;
+    }
+
+    // Leave burst mode with 0x83. Reads stay valid if the EC dropped out early; we just count it.
+    void ExitBurstLocked() {
+        UCHAR status = 0;
+        if (PortRead(channel.cmd, &status) && !(status & EC_BURST)) burstDrops++;
+        if (WaitECReady()) PortWrite(channel.cmd, EC_CMD_BURST_DISABLE);
+        WaitECReady();
+    }
+
+    // Burst bookkeeping around each register of a batch. burstLeft > 0 counts down the
+    // current session, < 0 counts down normal reads before retrying after a failed enable.
+    void BurstBeforeRead(int& burstLeft) {
+        if (burstLeft != 0 || !burstEnabled || burstSupport == BURST_UNSUPPORTED) return;
+        burstLeft = EnterBurstLocked() ? EC_BURST_MAX_REGISTERS : -EC_BURST_MAX_REGISTERS;
+    }
+
+    void BurstAfterRead(int& burstLeft) {
+        if (burstLeft > 0) {
+            if (--burstLeft == 0) ExitBurstLocked();
+        } else if (burstLeft < 0) {
+            burstLeft++;
+        }
+    }
+
+    void BurstEndBatch(int& burstLeft) {
+        if (burstLeft > 0) ExitBurstLocked();
+        burstLeft = 0;
+    }
+
+    // Read a list of registers under the caller's Access_EC hold. values[i] / ok[i] receive
+    // regs[i]. Port-level handshake, in burst mode if enabled. Returns number of successful reads.
+    int ReadListLocked(const UCHAR* regs, int count, UCHAR* values, bool* ok) {
+        int good = 0;
+        int burstLeft = 0;
+        for (int i = 0; i < count; i++) {
+            bool success;
+            if (faults.BreakerOpen()) {
+                // Tripped earlier in this batch: leave the EC alone
+                values[i] = 0xFF;
+                faults.CountSkipped(1);
+                success = false;
+            } else {
+                BurstBeforeRead(burstLeft);
+                success = ReadECRegisterRetryLocked(regs[i], &values[i]);
+                BurstAfterRead(burstLeft);
+            }
+            if (ok) ok[i] = success;
+            if (success) good++;
+        }
+        BurstEndBatch(burstLeft);
+        return good;
+    }
+
+    // One byte of a field under the caller's hold, inside the caller's burst session
+    bool ReadFieldByteLocked(UCHAR reg, UCHAR* value, int& burstLeft, int& reads) {
+        BurstBeforeRead(burstLeft);
+        bool ok = ReadECRegisterRetryLocked(reg, value);
+        BurstAfterRead(burstLeft);
+        reads++;
+        return ok;
+    }
+
+    // One field under the caller's hold (see ReadFields). Returns the register reads it took.
+    int ReadFieldLocked(const ECField& field, bool verify, ECFieldValue& out, int& burstLeft) {
+        int reads = 0;
+        if (field.Size() == 1) {
+            out.ok = ReadFieldByteLocked(field.reg, &out.lo, burstLeft, reads);
+            out.hi = 0;
+        } else if (!verify) {
+            out.ok = ReadFieldByteLocked(field.reg, field.reg == field.LowReg() ? &out.lo : &out.hi, burstLeft, reads) &&
+                     ReadFieldByteLocked((UCHAR)(field.reg + 1), field.reg == field.LowReg() ? &out.hi : &out.lo, burstLeft, reads);
+        } else {
+            UCHAR hiAgain = 0xFF;
+            out.ok = ReadFieldByteLocked(field.HighReg(), &out.hi, burstLeft, reads) &&
+                     ReadFieldByteLocked(field.LowReg(), &out.lo, burstLeft, reads) &&
+                     ReadFieldByteLocked(field.HighReg(), &hiAgain, burstLeft, reads);
+            while (out.ok && hiAgain != out.hi) {
+                if (out.tears == FIELD_TEAR_RETRIES) {
+                    out.torn = true;
+                    out.ok = false;
+                    break;
+                }
+                out.tears++;
+                out.hi = hiAgain;
+                out.ok = ReadFieldByteLocked(field.LowReg(), &out.lo, burstLeft, reads) &&
+                         ReadFieldByteLocked(field.HighReg(), &hiAgain, burstLeft, reads);
+            }
+        }
+        if (out.ok) out.value = field.Decode(out.lo, out.hi);
+        return reads;
+    }
+
+    // Draw EC transactions from the bus budget before taking Access_EC, waiting if it is spent.
+    // Returns false, with nothing drawn, if hStop is signaled during the wait.
+    bool Throttle(int tokens, HANDLE hStop = NULL) {
+        if (budgetChargeOnly) {
+            governor.Charge(tokens);
+            return true;
+        }
+        return governor.Acquire(tokens, hStop);
+    }
+
+    // Acquire Access_EC for a batch, retrying like ReadECRegister does per attempt
+    bool AcquireMutexForBatch() {
+        for (int attempt = 0; attempt < EC_MAX_RETRIES; attempt++) {
+            if (AcquireMutex()) return true;
+            if (attempt < EC_MAX_RETRIES - 1) {
+                if (!faults.RetryAllowed(EC_FAIL_MUTEX)) break;
+                retryCount++;
+                if (verboseMode) printf("[Verbose] Mutex acquisition failed, retry %d/%d\n", attempt + 1, EC_MAX_RETRIES - 1);
+                Sleep(0);  // Brief yield before retry
+            }
+        }
+        return false;
+    }
+
+public:
+    // Explicit single reads are never skipped for quarantine, only while the breaker is open
+    UCHAR ReadECRegister(UCHAR reg, bool* success = NULL) {
+        if (success) *success = false;
+        bool probeOnly;
+        if (!faults.Admit(&probeOnly)) {
+            if (verboseMode) printf("[Verbose] EC access paused by the fault breaker\n");
+            faults.CountSkipped(1);
+            return 0xFF;
+        }
+        Throttle(1);
+        LONGLONG readStart = QpcNow();
+
+        // Retry loop for improved reliability
+        for (int attempt = 0; attempt < EC_MAX_RETRIES; attempt++) {
+            if (!AcquireMutex()) {
+                if (attempt < EC_MAX_RETRIES - 1 && faults.RetryAllowed(EC_FAIL_MUTEX)) {
+                    retryCount++;
+                    if (verboseMode) printf("[Verbose] Mutex acquisition failed, retry %d/%d\n", attempt + 1, EC_MAX_RETRIES - 1);
+                    Sleep(0);  // Brief yield before retry
+                    continue;
+                }
+                RecordPhase(&ECPhaseStats::registerRead, QpcToMicros(QpcNow() - readStart));
+                failedReads++;
+                faults.OnMutexFailed();
+                return 0xFF;
+            }
+
+            UCHAR value = 0xFF;
+            bool ok = ReadECRegisterLocked(reg, &value);
+
+            ReleaseMutexSafe();
+
+            if (ok) {
+                // Success!
+                RecordPhase(&ECPhaseStats::registerRead, QpcToMicros(QpcNow() - readStart));
+                if (attempt > 0 && verboseMode) {
+                    printf("[Verbose] Read succeeded on retry %d\n", attempt);
+                }
+                if (verboseMode) {
+                    printf("[Verbose] EC[0x%02X] = 0x%02X\n", reg, value);
+                }
+                successfulReads++;
+                faults.OnRead(reg, true, EC_FAIL_NONE);
+                if (success) *success = true;
+                return value;
+            }
+
+            // Failed - retry if attempts remaining and this kind of failure isn't backing off
+            faults.OnAttemptFailed(lastFailure, reg);
+            if (attempt < EC_MAX_RETRIES - 1) {
+                if (!faults.RetryAllowed(lastFailure)) break;
+                retryCount++;
+                if (verboseMode) {
+                    printf("[Verbose] Read failed, retry %d/%d\n", attempt + 1, EC_MAX_RETRIES - 1);
+                }
+                Sleep(0);  // Brief yield before retry
+            }
+        }
+
+        // All retries exhausted
+        RecordPhase(&ECPhaseStats::registerRead, QpcToMicros(QpcNow() - readStart));
+        failedReads++;
+        faults.OnRead(reg, false, lastFailure);
+        if (traceOnError) traceDumpPending = true;
+        FlushTrace();
+        return 0xFF;
+    }
+
+    // Per-scan latency tracking for Monitor's summary line
+    void BeginScanStats() {
+        phaseScan.Reset();
+    }
+
+    // After each acquisition scan or served batch (phaseScan holds its latencies): the per-scan
+    // ETW event, and the scan's share of the health window. Only costs work while a session
+    // enables the provider.
+    void EmitScanEvents(ULONG64 sequence, int registers, int good, ULONG64 durationUs, ULONG64 jitterUs, bool fullSweep) {
+        if (healthStart != 0) {
+            healthScans++;
+            healthMutexWait.Merge(phaseScan.mutexWait);
+            healthScanDuration.Record(durationUs);
+        }
+        if (g_events.Enabled(ETW_LEVEL_VERBOSE, ETW_KEYWORD_SCAN)) {
+            EtwEvent event("Scan");
+            event.Str("Channel", channel.name);
+            event.U64("Sequence", sequence);
+            event.U32("Registers", registers);
+            event.U32("Good", good);
+            event.U32("Failed", registers - good);
+            event.U32("DurationUs", (ULONG)durationUs);
+            event.U32("JitterUs", (ULONG)jitterUs);
+            event.U32("MutexWaitUs", (ULONG)(phaseScan.mutexWait.Mean() * phaseScan.mutexWait.Count()));
+            event.U32("LockHoldMaxUs", (ULONG)phaseScan.lockHold.Max());
+            event.U32("ReadP99Us", (ULONG)phaseScan.registerRead.Percentile(99));
+            event.Bool("FullSweep", fullSweep);
+            g_events.Write(event, ETW_LEVEL_VERBOSE, ETW_KEYWORD_SCAN);
+        }
+        EmitHealth();
+    }
+
+    // Health event once per ETW_HEALTH_INTERVAL_MS: rates over the window since the last one,
+    // mutex wait and scan duration percentiles of its scans. Called after each scan and from
+    // idle loops (serve).
+    void EmitHealth() {
+        if (!g_events.Enabled(ETW_LEVEL_INFO, ETW_KEYWORD_HEALTH)) {
+            healthStart = 0;
+            return;
+        }
+        LONGLONG now = QpcNow();
+        if (healthStart != 0 && now - healthStart < QpcTicksFromMs(ETW_HEALTH_INTERVAL_MS)) return;
+
+        if (healthStart != 0) {
+            double seconds = QpcToMs(now - healthStart) / 1000.0;
+            int reads = successfulReads + failedReads - healthReads;
+            int failed = failedReads - healthFailed;
+            int retries = retryCount - healthRetries;
+            EtwEvent event("Health");
+            event.Str("Channel", channel.name);
+            event.U32("IntervalMs", (ULONG)(seconds * 1000.0));
+            event.Double("ScansPerSec", healthScans / seconds);
+            event.Double("ReadsPerSec", reads / seconds);
+            event.Double("FailuresPerSec", failed / seconds);
+            event.Double("RetriesPerSec", retries / seconds);
+            event.Double("FailureRatePct", reads > 0 ? 100.0 * failed / reads : 0.0);
+            event.U32("MutexWaitP50Us", (ULONG)healthMutexWait.Percentile(50));
+            event.U32("MutexWaitP99Us", (ULONG)healthMutexWait.Percentile(99));
+            event.U32("MutexWaitMaxUs", (ULONG)healthMutexWait.Max());
+            event.U32("ScanP50Us", (ULONG)healthScanDuration.Percentile(50));
+            event.U32("ScanP90Us", (ULONG)healthScanDuration.Percentile(90));
+            event.U32("ScanP99Us", (ULONG)healthScanDuration.Percentile(99));
+            event.U32("ScanMaxUs", (ULONG)healthScanDuration.Max());
+            event.U32("Quarantined", faults.QuarantinedCount());
+            event.Bool("BreakerOpen", faults.BreakerOpen());
+            g_events.Write(event, ETW_LEVEL_INFO, ETW_KEYWORD_HEALTH);
+        }
+
+        healthStart = now;
+        healthScans = 0;
+        healthReads = successfulReads + failedReads;
+        healthFailed = failedReads;
+        healthRetries = retryCount;
+        healthMutexWait.Reset();
+        healthScanDuration.Reset();
+    }
+
+    const ECPhaseStats& ScanStats() const {
+        return phaseScan;
+    }
+
+    const ECPhaseStats& TotalStats() const {
+        return phaseTotals;
+    }
+
+    // Read a register list (at most 256) in as many Access_EC holds as the lock chunk policy
+    // asks for: one on an idle system, several short ones while other EC clients want the lock.
+    // Quarantined registers are left out unless their re-probe is due, and nothing is read
+    // while the fault breaker is open; only registers actually read are drawn from the budget.
+    // values / ok are filled like ReadListLocked; registers not read stay 0xFF. A signaled
+    // hStop abandons the list while it waits for the budget.
+    int ReadListChunked(const UCHAR* regs, int count, UCHAR* values, bool* ok, HANDLE hStop = NULL) {
+        UCHAR live[256];
+        int index[256];         // live[j] is regs[index[j]]
+        int liveCount = 0;
+        for (int i = 0; i < count; i++) {
+            values[i] = 0xFF;
+            if (ok) ok[i] = false;
+            if (faults.Skip(regs[i])) continue;
+            index[liveCount] = i;
+            live[liveCount++] = regs[i];
+        }
+        if (liveCount == 0) return 0;
+
+        UCHAR liveValues[256];
+        bool liveOk[256];
+        int good = 0;
+        int done = 0;
+        while (done < liveCount) {
+            bool probeOnly;
+            if (!faults.Admit(&probeOnly)) {
+                faults.CountSkipped(liveCount - done);
+                break;
+            }
+            int chunk = probeOnly ? 1 : lockChunks.Chunk();
+            if (chunk > liveCount - done) chunk = liveCount - done;
+            if (!Throttle(chunk, hStop)) break;
+
+            if (!AcquireMutexForBatch()) {
+                failedReads += liveCount - done;
+                faults.OnMutexFailed();
+                break;
+            }
+            LONGLONG holdStart = QpcNow();
+            good += ReadListLocked(live + done, chunk, liveValues + done, liveOk + done);
+            ReleaseMutexSafe();
+
+            ULONG64 holdUs = QpcToMicros(QpcNow() - holdStart);
+            RecordPhase(&ECPhaseStats::lockHold, holdUs);
+            lockChunks.OnHold(holdUs, chunk);
+            done += chunk;
+        }
+
+        for (int j = 0; j < done; j++) {
+            values[index[j]] = liveValues[j];
+            if (ok) ok[index[j]] = liveOk[j];
+        }
+        return good;
+    }
+
+    // Read registers [start, start + count), chunked into Access_EC holds (ReadListChunked).
+    // out[i] / ok[i] receive register start + i. Returns number of successful reads.
+    int ReadECRange(UCHAR start, int count, UCHAR* out, bool* ok) {
+        if (count > 256 - start) count = 256 - start;
+        if (count <= 0) return 0;
+
+        for (int i = 0; i < count; i++) {
+            out[i] = 0xFF;
+            if (ok) ok[i] = false;
+        }
+
+        UCHAR regs[256];
+        for (int i = 0; i < count; i++) regs[i] = (UCHAR)(start + i);
+        return ReadListChunked(regs, count, out, ok);
+    }
+
+    // Sparse variant: read every register set in mask, chunked the same way.
+    // out / ok are indexed by register address (256 entries); unselected entries are untouched.
+    int ReadECRegisters(const ECRegisterMask& mask, UCHAR* out, bool* ok, HANDLE hStop = NULL) {
+        int count = mask.Count();
+        if (count == 0) return 0;
+
+        for (int reg = 0; reg < 256; reg++) {
+            if (!mask.Test((UCHAR)reg)) continue;
+            out[reg] = 0xFF;
+            if (ok) ok[reg] = false;
+        }
+
+        UCHAR regs[256];
+        UCHAR values[256];
+        bool valid[256];
+        int listed = 0;
+        for (int reg = 0; reg < 256; reg++) {
+            if (mask.Test((UCHAR)reg)) regs[listed++] = (UCHAR)reg;
+        }
+        int good = ReadListChunked(regs, listed, values, valid, hStop);
+
+        for (int i = 0; i < listed; i++) {
+            out[regs[i]] = values[i];
+            if (ok) ok[regs[i]] = valid[i];
+        }
+        return good;
+    }
+
+    // Read typed fields, each back to back inside one Access_EC hold (consecutive fields share
+    // a hold up to the lock chunk size, a field is never split), in burst mode when enabled.
+    // The port-level handshake is used so the bytes go out in a known order. With verify,
+    // 16-bit fields are read high, low, high again and re-read while the high byte moves, so
+    // an update landing between the two bytes is caught instead of returned torn.
+    // A half-open breaker admits a single field as its probe, then the rest is re-checked.
+    // Each hold draws its reads from the budget once the breaker has admitted it.
+    // Returns number of fields read successfully.
+    int ReadFields(const std::vector<ECField>& fields, bool verify, ECFieldValue* out) {
+        for (size_t f = 0; f < fields.size(); f++) {
+            out[f].ok = out[f].torn = false;
+            out[f].tears = 0;
+            out[f].lo = out[f].hi = 0xFF;
+            out[f].value = 0;
+        }
+
+        int good = 0;
+        for (size_t f = 0; f < fields.size(); ) {
+            bool probeOnly;
+            if (!faults.Admit(&probeOnly)) {
+                int skipped = 0;
+                for (; f < fields.size(); f++) skipped += fields[f].Reads(verify);
+                faults.CountSkipped(skipped);
+                break;
+            }
+            // Fields of this hold: the probe alone, else as many whole fields as the lock chunk takes
+            size_t end = f + 1;
+            int planned = fields[f].Reads(verify);
+            while (!probeOnly && end < fields.size() && planned + fields[end].Reads(verify) <= lockChunks.Chunk()) {
+                planned += fields[end].Reads(verify);
+                end++;
+            }
+            Throttle(planned);
+
+            if (!AcquireMutexForBatch()) {
+                for (; f < fields.size(); f++) failedReads += fields[f].Reads(verify);
+                faults.OnMutexFailed();
+                break;
+            }
+            LONGLONG holdStart = QpcNow();
+            int held = 0;
+            int burstLeft = 0;
+            for (; f < end; f++) {
+                held += ReadFieldLocked(fields[f], verify, out[f], burstLeft);
+                if (out[f].ok) good++;
+                fieldReads++;
+                fieldTears += out[f].tears;
+                if (out[f].torn) fieldTorn++;
+            }
+            BurstEndBatch(burstLeft);
+            ReleaseMutexSafe();
+
+            ULONG64 holdUs = QpcToMicros(QpcNow() - holdStart);
+            RecordPhase(&ECPhaseStats::lockHold, holdUs);
+            lockChunks.OnHold(holdUs, held);
+        }
+        return good;
+    }
+
+    // Acquisition thread body: scan, publish a snapshot, sleep until the next slot.
+    // Cadence is set by the QPC schedule alone, independent of how fast consumers render.
+    void RunAcquisition(AcquisitionState& acq) {
+        UCHAR values[256];
+        UCHAR readValues[256];
+        bool valid[256];
+        LONGLONG readQpc[256];
+        memset(values, 0, sizeof(values));
+        memset(readQpc, 0, sizeof(readQpc));
+
+        acq.pacer.Begin();
+
+        LONGLONG nextScan = QpcNow();
+        while (WaitForSingleObject(acq.hStop, 0) != WAIT_OBJECT_0) {
+            if (InterlockedExchange(&acq.fullSweepRequested, 0)) acq.scheduler.RequestFullSweep();
+
+            ECRegisterMask mask;
+            bool fullSweep = false;
+            if (acq.useWatchMask) {
+                mask = acq.watchMask;
+            } else {
+                fullSweep = acq.scheduler.PlanCycle(mask);
+            }
+
+            ECSnapshot& snap = acq.snapshots.WriteSlot();
+            FILETIME now;
+            GetSystemTimeAsFileTime(&now);
+            snap.wallTime = ((ULONG64)now.dwHighDateTime << 32) | now.dwLowDateTime;
+
+            BeginScanStats();
+            snap.startQpc = QpcNow();
+            ReadECRegisters(mask, readValues, valid, acq.hStop);
+            snap.endQpc = QpcNow();
+            // Stopped while waiting for the bus budget: the scan was abandoned, don't publish it
+            if (WaitForSingleObject(acq.hStop, 0) == WAIT_OBJECT_0) break;
+            LONGLONG offset = snap.startQpc - nextScan;
+            ULONG64 jitterUs = QpcToMicros(offset < 0 ? -offset : offset);
+            ULONG64 durationUs = QpcToMicros(snap.endQpc - snap.startQpc);
+            RecordPhase(&ECPhaseStats::scanJitter, jitterUs);
+            RecordPhase(&ECPhaseStats::scanDuration, durationUs);
+
+            // Merge: only successful reads update the known value
+            snap.read = mask;
+            snap.valid.Clear();
+            snap.changed.Clear();
+            snap.changeCount = 0;
+            for (int i = 0; i < 256; i++) {
+                if (!mask.Test((UCHAR)i)) continue;
+                bool changed = false;
+                if (valid[i]) {
+                    changed = (readValues[i] != values[i]);
+                    values[i] = readValues[i];
+                    readQpc[i] = snap.endQpc;
+                    snap.valid.Set((UCHAR)i);
+                    if (acq.trackStats) {
+                        acq.windows[i].Add(readValues[i], snap.endQpc);
+                        acq.windows[i].Summarize(acq.stats[i]);
+                    }
+                    if (changed) {
+                        snap.changed.Set((UCHAR)i);
+                        snap.changeCount++;
+                    }
+                }
+                if (!acq.useWatchMask) acq.scheduler.Observe((UCHAR)i, valid[i], changed);
+            }
+            if (!acq.useWatchMask) acq.scheduler.EndCycle();
+
+            memcpy(snap.values, values, sizeof(values));
+            memcpy(snap.readQpc, readQpc, sizeof(readQpc));
+            if (acq.trackStats) memcpy(snap.stats, acq.stats, sizeof(snap.stats));
+            snap.sequence = ++acq.sequence;
+            snap.fullSweep = fullSweep;
+            snap.readCount = mask.Count();
+            snap.hotCount = acq.scheduler.HotCount();
+            snap.cyclesToFullSweep = acq.scheduler.CyclesToFullSweep();
+            snap.summary.readP50 = phaseScan.registerRead.Percentile(50);
+            snap.summary.readP99 = phaseScan.registerRead.Percentile(99);
+            snap.summary.ioctlP50 = phaseScan.ioctl.Percentile(50);
+            snap.summary.ioctlP99 = phaseScan.ioctl.Percentile(99);
+            snap.summary.mutexMax = phaseScan.mutexWait.Max();
+            snap.summary.obfPollsP50 = phaseScan.obfPolls.Percentile(50);
+            snap.summary.obfPollsP99 = phaseScan.obfPolls.Percentile(99);
+            EmitScanEvents(snap.sequence, snap.readCount, snap.valid.Count(), durationUs, jitterUs, fullSweep);
+
+            for (size_t i = 0; i < acq.sinks.size(); i++) acq.sinks[i]->OnSnapshot(snap);
+            acq.snapshots.Publish();
+            SetEvent(acq.hPublished);
+
+            // Fixed-rate schedule on the QPC clock; skip missed slots instead of bursting
+            nextScan += QpcTicksFromMs(acq.intervalMs);
+            LONGLONG current = QpcNow();
+            if (nextScan < current) nextScan = current;
+            if (!acq.pacer.WaitUntil(nextScan, acq.hStop)) break;
+        }
+
+        acq.pacer.End();
+    }
+
+    static DWORD WINAPI AcquisitionThreadProc(LPVOID param) {
+        AcquisitionState* acq = (AcquisitionState*)param;
+        acq->reader->RunAcquisition(*acq);
+        return 0;
+    }
+
+    bool StartAcquisition(AcquisitionState& acq) {
+        acq.reader = this;
+        acq.pacer.Configure(realtimeProfile, acquisitionCpu);
+
+        // Ctrl+C stops the mode cleanly instead of killing the process (statistics still print)
+        InterlockedExchange(&g_stopRequested, 0);
+        SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+        // Share every snapshot with -r --from-shm readers and other tools; the shared snapshot
+        // is the 62/66 EC, so other channels never take it. While another instance publishes,
+        // the sink keeps checking and takes over once that one has gone.
+        if (channel.IsPrimary()) {
+            acq.publisher.Open();
+            acq.sinks.push_back(&acq.publisher);
+        }
+
+        acq.hPublished = CreateEventA(NULL, FALSE, FALSE, NULL);
+        acq.hStop = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (acq.hPublished == NULL || acq.hStop == NULL) {
+            printf("Error: Failed to create acquisition events (Error: %lu)\n", GetLastError());
+            StopAcquisition(acq);
+            return false;
+        }
+
+        acq.hThread = CreateThread(NULL, 0, AcquisitionThreadProc, &acq, 0, NULL);
+        if (acq.hThread == NULL) {
+            printf("Error: Failed to start acquisition thread (Error: %lu)\n", GetLastError());
+            StopAcquisition(acq);
+            return false;
+        }
+        return true;
+    }
+
+    void StopAcquisition(AcquisitionState& acq) {
+        if (acq.hThread != NULL) {
+            SetEvent(acq.hStop);
+            WaitForSingleObject(acq.hThread, INFINITE);
+            CloseHandle(acq.hThread);
+            acq.hThread = NULL;
+            strncpy_s(acquisitionProfile, sizeof(acquisitionProfile), acq.pacer.Describe(), _TRUNCATE);
+        }
+        if (acq.hStop != NULL) {
+            CloseHandle(acq.hStop);
+            acq.hStop = NULL;
+        }
+        if (acq.hPublished != NULL) {
+            CloseHandle(acq.hPublished);
+            acq.hPublished = NULL;
+        }
+        acq.publisher.Close();
+        SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+    }
+
+    // Consumer side: wait for the next snapshot (or timeoutMs), handling Ctrl+C, the F key and
+    // T (save the trace ring to TracePath()).
+    // Other keys go to 'keys' if given. Returns the latest snapshot, or NULL if none arrived;
+    // sets *stop when the user asked to exit.
+    const ECSnapshot* WaitSnapshot(AcquisitionState& acq, DWORD timeoutMs, bool* stop, ConsoleKeys* keys = NULL) {
+        WaitForSingleObject(acq.hPublished, timeoutMs);
+        *stop = (g_stopRequested != 0);
+
+        ConsoleKeys pressed;
+        ReadConsoleKeys(pressed);
+        for (int k = 0; k < pressed.count; k++) {
+            int key = pressed.keys[k];
+            if (!HandleAcquisitionKey(acq, key) && keys != NULL) keys->Add(key);
+        }
+
+        return LatestSnapshot(acq);
+    }
+
+    // As WaitSnapshot, without the keyboard: sessions with several channels read keys once
+    // and pass them to every reader through HandleAcquisitionKey
+    const ECSnapshot* NextSnapshot(AcquisitionState& acq, DWORD timeoutMs, bool* stop) {
+        WaitForSingleObject(acq.hPublished, timeoutMs);
+        *stop = (g_stopRequested != 0);
+        return LatestSnapshot(acq);
+    }
+
+    // F requests a full sweep, T saves the trace ring; false for keys the mode handles itself
+    bool HandleAcquisitionKey(AcquisitionState& acq, int key) {
+        if (key == 'f' || key == 'F') {
+            InterlockedExchange(&acq.fullSweepRequested, 1);
+            return true;
+        }
+        if (key == 't' || key == 'T') {
+            if (!ECTrace::compiled) return false;
+            if (SaveTrace(tracePath)) snprintf(traceStatus, sizeof(traceStatus), "trace saved");
+            else snprintf(traceStatus, sizeof(traceStatus), "trace not saved (Error: %lu)", GetLastError());
+            traceSaves++;
+            return true;
+        }
+        return false;
+    }
+
+    const char* TracePath() const {
+        return tracePath;
+    }
+
+    // Status line text for the trace: the last T outcome and how many --trace error dumps went
+    // to the file; "" while there is nothing to report
+    void TraceStatusText(char* out, size_t outSize) const {
+        out[0] = '\0';
+        if (traceStatus[0] != '\0') snprintf(out, outSize, " | %s", traceStatus);
+        if (traceErrorDumps > 0) {
+            size_t used = strlen(out);
+            snprintf(out + used, outSize - used, " | %ld failures traced to %s", (long)traceErrorDumps, traceErrorPath);
+        }
+    }
+
+    ULONG TraceSaves() const {
+        return traceSaves;
+    }
+
+    const ECSnapshot* LatestSnapshot(AcquisitionState& acq) {
+        if (!acq.snapshots.Acquire()) return NULL;
+        return &acq.snapshots.ReadSlot();
+    }
+
+    // Monitor mode - track changes across all registers in grid format.
+    // fullEvery > 1 enables the adaptive scheduler: only volatile registers are re-read each
+    // cycle and a full sweep runs every fullEvery cycles (or when F is pressed).
+    // Scanning runs on the acquisition thread; this thread only renders the latest snapshot.
+    // The acquisition thread also keeps rolling statistics of the last STATS_WINDOW samples per
+    // register: arrow keys select the register shown in the detail panel, H cycles heat maps.
+    void Monitor(int intervalMs, bool useDecimal, int fullEvery = 1) {
+        static const char* heatNames[HEAT_MODES] = { "off", "change rate", "spread" };
+
+        AcquisitionState acq;
+        acq.intervalMs = intervalMs;
+        acq.scheduler.Reset(fullEvery);
+        acq.EnableStats();
+        bool adaptive = acq.scheduler.IsAdaptive();
+
+        UCHAR displayed[256];   // Values of the previous scan, for change highlighting
+        UCHAR latest[256];
+        memset(displayed, 0, sizeof(displayed));
+        memset(latest, 0, sizeof(latest));
+        int selected = 0;
+        int heatMode = HEAT_OFF;
+        bool haveSnapshot = false;
+
+        ConsoleFrame frame(FRAME_MAX_COLS, MONITOR_FRAME_ROWS + MONITOR_PANEL_ROWS);
+        frame.BeginFullScreen();
+        if (!StartAcquisition(acq)) return;
+
+        bool stop = false;
+        ULONG shownTraceSaves = TraceSaves();
+        while (!stop) {
+            ConsoleKeys keys;
+            const ECSnapshot* snap = WaitSnapshot(acq, RENDER_POLL_MS, &stop, &keys);
+
+            bool viewChanged = (TraceSaves() != shownTraceSaves);
+            shownTraceSaves = TraceSaves();
+            for (int k = 0; k < keys.count; k++) {
+                int key = keys.keys[k];
+                if (key == KEY_UP) selected = (selected + 240) % 256;
+                else if (key == KEY_DOWN) selected = (selected + 16) % 256;
+                else if (key == KEY_LEFT) selected = (selected + 255) % 256;
+                else if (key == KEY_RIGHT) selected = (selected + 1) % 256;
+                else if (key == 'h' || key == 'H') heatMode = (heatMode + 1) % HEAT_MODES;
+                else continue;
+                viewChanged = true;
+            }
+
+            if (snap != NULL) {
+                memcpy(displayed, latest, sizeof(displayed));
+                memcpy(latest, snap->values, sizeof(latest));
+                haveSnapshot = true;
+            } else if (viewChanged && haveSnapshot) {
+                snap = &acq.snapshots.ReadSlot();   // Redraw the current scan for the new view
+            } else {
+                continue;
+            }
+
+            DWORD readDuration = (DWORD)QpcToMs(snap->endQpc - snap->startQpc);
+            int changeCount = 0;
+            for (int i = 0; i < 256; i++) {
+                if (snap->values[i] != displayed[i]) changeCount++;
+            }
+
+            // Compose the frame off-screen; only cells that differ from the last frame are written
+            WORD text = frame.DefaultAttr();
+            frame.Clear();
+            frame.Text(0, 0, text, "EC Register Monitor (16x16 grid) - Updates every %g seconds", intervalMs / 1000.0);
+            char traceText[2 * MAX_PATH + 64];
+            TraceStatusText(traceText, sizeof(traceText));
+            frame.Text(0, 1, text, "Ctrl+C: exit | Arrows: select register | H: heat map (%s)%s%s", heatNames[heatMode],
+                       ECTrace::compiled ? " | T: save trace" : "", traceText);
+            if (heatMode != HEAT_OFF) {
+                frame.Text(0, 2, text, "Heat (%s, last %d samples): Gray=static, Cyan=low, Yellow=medium, Magenta=high",
+                           heatNames[heatMode], STATS_WINDOW);
+            } else if (adaptive) {
+                frame.Text(0, 2, text, "Red=changed, Green=non-zero unchanged, Cyan=stale (not re-read), Gray=zero/empty");
+            } else {
+                frame.Text(0, 2, text, "Red=changed, Green=non-zero unchanged, Gray=zero/empty");
+            }
+            if (adaptive) {
+                frame.Text(0, 3, text, "Changes detected: %d | Read time: %lums | Reads: %d/256 (%s) | Hot: %d | Full sweep in %d (F=now)",
+                           changeCount, readDuration, snap->readCount, snap->fullSweep ? "full" : "adaptive",
+                           snap->hotCount, snap->cyclesToFullSweep);
+            } else {
+                frame.Text(0, 3, text, "Changes detected: %d | Read time: %lums", changeCount, readDuration);
+            }
+            frame.Text(0, 4, text, "Scan #%llu p50/p99: read %llu/%llu us | ioctl %llu/%llu us | mutex max %llu us | OBF polls %llu/%llu",
+                       (unsigned long long)snap->sequence,
+                       (unsigned long long)snap->summary.readP50, (unsigned long long)snap->summary.readP99,
+                       (unsigned long long)snap->summary.ioctlP50, (unsigned long long)snap->summary.ioctlP99,
+                       (unsigned long long)snap->summary.mutexMax,
+                       (unsigned long long)snap->summary.obfPollsP50, (unsigned long long)snap->summary.obfPollsP99);
+            frame.Text(0, 5, text, "=======================================================");
+
+            // Registers not re-read by this scan are shown as stale
+            ECRegisterMask stale;
+            UCHAR heat[256];
+            for (int i = 0; i < 256; i++) {
+                if (snap->readQpc[i] < snap->startQpc) stale.Set((UCHAR)i);
+                heat[i] = (heatMode != HEAT_OFF) ? HeatLevel(snap->stats[i], heatMode) : 0;
+            }
+            DrawRegisterGrid(frame, 7, snap->values, displayed, &stale, useDecimal,
+                             heatMode != HEAT_OFF ? heat : NULL, selected);
+
+            // Detail panel for the selected register
+            const RegisterStatsSummary& stats = snap->stats[selected];
+            int panelY = MONITOR_FRAME_ROWS + 1;
+            if (stats.samples == 0) {
+                frame.Text(0, panelY, text, "Register 0x%02X: no samples yet", selected);
+            } else {
+                frame.Text(0, panelY, text, "Register 0x%02X = %u (0x%02X) | last %u samples over %.0f s: min %u  max %u  mean %.2f  sd %.2f",
+                           selected, snap->values[selected], snap->values[selected], stats.samples, stats.spanSeconds,
+                           stats.minValue, stats.maxValue, stats.mean, stats.stddev);
+                double perMinute = (stats.spanSeconds > 0.0f) ? stats.changes * 60.0 / stats.spanSeconds : 0.0;
+                int x = frame.Text(0, panelY + 1, text, "Changes: %u (%.0f%% of samples, %.1f/min) | last change: ",
+                                   stats.changes, stats.samples > 1 ? stats.changes * 100.0 / (stats.samples - 1) : 0.0,
+                                   perMinute);
+                if (stats.lastChangeQpc == 0) {
+                    frame.Text(x, panelY + 1, text, "none");
+                } else {
+                    frame.Text(x, panelY + 1, text, "%.0f s ago", QpcToMs(QpcNow() - stats.lastChangeQpc) / 1000.0);
+                }
+            }
+
+            frame.Present();
+        }
+
+        StopAcquisition(acq);
+        frame.End();
+    }
+
+    // Watchlist monitor - poll only the given registers, at sub-second rates if the budget allows
+    void MonitorWatchlist(const std::vector<UCHAR>& regs, int intervalMs, bool useDecimal) {
+        AcquisitionState acq;
+        acq.intervalMs = intervalMs;
+        acq.useWatchMask = true;
+        for (size_t i = 0; i < regs.size(); i++) acq.watchMask.Set(regs[i]);
+
+        UCHAR displayed[256];
+        int changeCounts[256];
+        memset(displayed, 0, sizeof(displayed));
+        memset(changeCounts, 0, sizeof(changeCounts));
+
+        ConsoleFrame frame(FRAME_MAX_COLS, WATCH_HEADER_ROWS + (int)regs.size());
+        frame.BeginFullScreen();
+        if (!StartAcquisition(acq)) return;
+
+        bool stop = false;
+        while (!stop) {
+            const ECSnapshot* snap = WaitSnapshot(acq, RENDER_POLL_MS, &stop);
+            if (snap == NULL) continue;
+            bool firstScan = (snap->sequence == 1);
+
+            WORD text = frame.DefaultAttr();
+            frame.Clear();
+            frame.Text(0, 0, text, "EC Watchlist Monitor - %d registers every %d ms (budget %d reads/s)",
+                       (int)regs.size(), intervalMs, BudgetRate());
+            char traceText[2 * MAX_PATH + 64];
+            TraceStatusText(traceText, sizeof(traceText));
+            frame.Text(0, 1, text, "Press Ctrl+C to exit%s%s", ECTrace::compiled ? " | T: save trace" : "", traceText);
+            frame.Text(0, 2, text, "Red=changed, Green=non-zero unchanged, Gray=zero/empty");
+            frame.Text(0, 3, text, "Scan #%llu | Read time: %.2fms | register p50/p99: %llu/%llu us",
+                       (unsigned long long)snap->sequence, QpcToMs(snap->endQpc - snap->startQpc),
+                       (unsigned long long)snap->summary.readP50, (unsigned long long)snap->summary.readP99);
+            frame.Text(0, 4, text, "=======================================================");
+            frame.Text(0, 5, text, "Reg    Value  Prev   Changes");
+
+            for (size_t i = 0; i < regs.size(); i++) {
+                UCHAR reg = regs[i];
+                int y = WATCH_HEADER_ROWS + (int)i;
+                bool valid = snap->valid.Test(reg);
+                bool changed = !firstScan && valid && snap->values[reg] != displayed[reg];
+                if (changed) changeCounts[reg]++;
+
+                frame.Text(0, y, text, "0x%02X", reg);
+                if (!valid) {
+                    frame.Text(7, y, text, "??");
+                } else {
+                    WORD attr;
+                    if (changed || firstScan) {
+                        attr = frame.Color(FOREGROUND_RED | FOREGROUND_INTENSITY);
+                    } else if (snap->values[reg] != 0) {
+                        attr = frame.Color(FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+                    } else {
+                        attr = frame.Color(FOREGROUND_INTENSITY);
+                    }
+                    frame.Text(7, y, attr, useDecimal ? "%3d" : "%02X", snap->values[reg]);
+                }
+                frame.Text(14, y, text, useDecimal ? "%3d" : "%02X", displayed[reg]);
+                frame.Text(21, y, text, "%d", changeCounts[reg]);
+            }
+
+            frame.Present();
+
+            // Only remember successful reads, so a transient failure doesn't count as two changes
+            for (size_t i = 0; i < regs.size(); i++) {
+                if (snap->valid.Test(regs[i])) displayed[regs[i]] = snap->values[regs[i]];
+            }
+        }
+
+        StopAcquisition(acq);
+        frame.End();
+    }
+
+    // Serve mode helpers: arm an instance for the next client or the next request
+    void ServeConnect(ServeInstance& inst) {
+        HANDLE event = inst.overlapped.hEvent;
+        memset(&inst.overlapped, 0, sizeof(inst.overlapped));
+        inst.overlapped.hEvent = event;
+        inst.state = SERVE_CONNECTING;
+
+        if (!ConnectNamedPipe(inst.pipe, &inst.overlapped)) {
+            DWORD error = GetLastError();
+            if (error == ERROR_PIPE_CONNECTED) {
+                // Client connected between CreateNamedPipe and ConnectNamedPipe
+                SetEvent(event);
+            } else if (error != ERROR_IO_PENDING) {
+                printf("Error: Failed to listen on %s (Error: %lu)\n", SERVE_PIPE_NAME, error);
+                inst.state = SERVE_BROKEN;
+            }
+        }
+    }
+
+    void ServeRead(ServeInstance& inst) {
+        inst.state = SERVE_READING;
+        if (!ReadFile(inst.pipe, &inst.request, sizeof(inst.request), NULL, &inst.overlapped) &&
+            GetLastError() != ERROR_IO_PENDING) {
+            DisconnectNamedPipe(inst.pipe);
+            ServeConnect(inst);
+        }
+    }
+
+    void ServeReply(ServeInstance& inst) {
+        DWORD written = 0;
+        BOOL ok = WriteFile(inst.pipe, &inst.response, sizeof(inst.response), NULL, &inst.overlapped);
+        if (ok || GetLastError() == ERROR_IO_PENDING) {
+            // The response fits the pipe buffer, so this completes without waiting on the client
+            ok = GetOverlappedResult(inst.pipe, &inst.overlapped, &written, TRUE);
+        }
+        if (!ok || written != sizeof(inst.response)) {
+            DisconnectNamedPipe(inst.pipe);
+            ServeConnect(inst);
+            return;
+        }
+        ServeRead(inst);
+    }
+
+    // Serve mode - answer register reads from other ECReader processes over a named pipe
+    // while the driver, module and mutex stay open. A single thread multiplexes all pipe
+    // instances with overlapped I/O; requests that arrive within SERVE_COALESCE_MS of the
+    // first queued one are answered from one batched EC transaction (one mutex hold).
+    bool Serve() {
+        ServeInstance instances[SERVE_MAX_CLIENTS];
+        HANDLE events[SERVE_MAX_CLIENTS];
+        int created = 0;
+        bool ok = true;
+
+        for (int i = 0; i < SERVE_MAX_CLIENTS && ok; i++) {
+            events[i] = CreateEventA(NULL, TRUE, FALSE, NULL);
+            memset(&instances[i].overlapped, 0, sizeof(instances[i].overlapped));
+            instances[i].overlapped.hEvent = events[i];
+            instances[i].state = SERVE_BROKEN;
+            instances[i].pipe = CreateNamedPipeA(SERVE_PIPE_NAME,
+                                                 PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (i == 0 ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                                                 PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                                 SERVE_MAX_CLIENTS, sizeof(ServeResponse), sizeof(ServeRequest), 0, NULL);
+            if (events[i] == NULL || instances[i].pipe == INVALID_HANDLE_VALUE) {
+                DWORD error = GetLastError();
+                if (i == 0 && error == ERROR_ACCESS_DENIED) {
+                    printf("Error: Another ECReader server is already running\n");
+                } else {
+                    printf("Error: Failed to create %s (Error: %lu)\n", SERVE_PIPE_NAME, error);
+                }
+                if (events[i] != NULL) CloseHandle(events[i]);
+                ok = false;
+                break;
+            }
+            created++;
+            ServeConnect(instances[i]);
+        }
+
+        ULONG64 connections = 0;
+        ULONG64 requests = 0;
+        ULONG64 batches = 0;
+        ULONG64 deferredBatches = 0;    // Batches held back by the bus budget
+        SnapshotPublisher publisher;
+
+        if (ok) {
+            InterlockedExchange(&g_stopRequested, 0);
+            SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+            printf("Serving EC reads on %s (up to %d clients)\n", SERVE_PIPE_NAME, SERVE_MAX_CLIENTS);
+            if (publisher.Open()) {
+                printf("Publishing snapshots for -r --from-shm\n");
+            } else {
+                printf("Note: Another instance is already publishing snapshots; taking over when it exits\n");
+            }
+            printf("Press Ctrl+C to stop\n");
+
+            LONGLONG batchDeadline = 0;     // 0 = nothing queued
+            while (!g_stopRequested) {
+                EmitHealth();   // Keeps health events coming while no client asks for reads
+                DWORD timeout = RENDER_POLL_MS;
+                if (batchDeadline != 0) {
+                    LONGLONG now = QpcNow();
+                    timeout = (now >= batchDeadline) ? 0 : (DWORD)QpcToMs(batchDeadline - now) + 1;
+                }
+
+                DWORD wait = WaitForMultipleObjects(SERVE_MAX_CLIENTS, events, FALSE, timeout);
+                if (wait < WAIT_OBJECT_0 + SERVE_MAX_CLIENTS) {
+                    // Handle every completed instance, not just the first signaled one
+                    for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+                        ServeInstance& inst = instances[i];
+                        if (inst.state != SERVE_CONNECTING && inst.state != SERVE_READING) continue;
+                        if (WaitForSingleObject(events[i], 0) != WAIT_OBJECT_0) continue;
+
+                        DWORD bytes = 0;
+                        BOOL done = GetOverlappedResult(inst.pipe, &inst.overlapped, &bytes, FALSE);
+                        if (inst.state == SERVE_CONNECTING) {
+                            if (done) {
+                                connections++;
+                                ServeRead(inst);
+                            } else {
+                                DisconnectNamedPipe(inst.pipe);
+                                ServeConnect(inst);
+                            }
+                            continue;
+                        }
+
+                        // Request received (or the client went away)
+                        if (!done || bytes != sizeof(inst.request)) {
+                            DisconnectNamedPipe(inst.pipe);
+                            ServeConnect(inst);
+                            continue;
+                        }
+                        inst.response.version = SERVE_PROTOCOL_VERSION;
+                        inst.response.status = SERVE_STATUS_OK;
+                        inst.response.valid.Clear();
+                        memset(inst.response.values, 0, sizeof(inst.response.values));
+                        if (inst.request.version != SERVE_PROTOCOL_VERSION) {
+                            inst.response.status = SERVE_STATUS_BAD_REQUEST;
+                            ServeReply(inst);
+                            continue;
+                        }
+                        ResetEvent(events[i]);
+                        inst.state = SERVE_QUEUED;
+                        requests++;
+                        if (batchDeadline == 0) batchDeadline = QpcNow() + QpcTicksFromMs(SERVE_COALESCE_MS);
+                    }
+                }
+
+                if (batchDeadline == 0 || QpcNow() < batchDeadline) continue;
+
+                // One EC transaction for the union of all queued requests
+                ECRegisterMask batch;
+                for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+                    if (instances[i].state != SERVE_QUEUED) continue;
+                    for (int w = 0; w < 4; w++) batch.bits[w] |= instances[i].request.mask.bits[w];
+                }
+
+                // Bus budget spent: keep the batch open so requests arriving meanwhile join it
+                LONGLONG budgetDelay = governor.Delay(batch.Count());
+                if (budgetDelay > 0) {
+                    batchDeadline = QpcNow() + budgetDelay;
+                    deferredBatches++;
+                    continue;
+                }
+                batchDeadline = 0;
+                UCHAR values[256];
+                bool valid[256];
+                BeginScanStats();
+                LONGLONG batchStart = QpcNow();
+                int good = ReadECRegisters(batch, values, valid);
+                publisher.Update(batch, values, valid);
+                batches++;
+                EmitScanEvents(batches, batch.Count(), good, QpcToMicros(QpcNow() - batchStart), 0, false);
+
+                for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+                    ServeInstance& inst = instances[i];
+                    if (inst.state != SERVE_QUEUED) continue;
+                    for (int reg = 0; reg < 256; reg++) {
+                        if (!inst.request.mask.Test((UCHAR)reg) || !valid[reg]) continue;
+                        inst.response.valid.Set((UCHAR)reg);
+                        inst.response.values[reg] = values[reg];
+                    }
+                    ServeReply(inst);
+                }
+            }
+            SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+        }
+
+        for (int i = 0; i < created; i++) {
+            CancelIo(instances[i].pipe);
+            DisconnectNamedPipe(instances[i].pipe);
+            CloseHandle(instances[i].pipe);
+            CloseHandle(events[i]);
+        }
+
+        if (ok) {
+            printf("Served %llu requests from %llu connections in %llu EC transactions",
+                   (unsigned long long)requests, (unsigned long long)connections, (unsigned long long)batches);
+            if (batches > 0) printf(" (%.2f requests/transaction)", (double)requests / batches);
+            printf("\n");
+            if (deferredBatches > 0) {
+                printf("Bus budget held back %llu batches (requests arriving meanwhile were merged)\n",
+                       (unsigned long long)deferredBatches);
+            }
+        }
+        return ok;
+    }
+
+    // Record mode - append snapshots to a capture file until Ctrl+C or durationSec elapses.
+    // Uses the monitor scan engine; an empty watchlist scans the full grid.
+    bool Record(const char* path, int intervalMs, int fullEvery, const std::vector<UCHAR>& watchRegs,
+                int keyframeEvery, int durationSec) {
+        CaptureWriter writer;
+        if (!writer.Open(path, keyframeEvery, intervalMs, channel.Tag())) return false;
+
+        AcquisitionState acq;
+        acq.intervalMs = intervalMs;
+        acq.scheduler.Reset(fullEvery);
+        if (!watchRegs.empty()) {
+            acq.useWatchMask = true;
+            for (size_t i = 0; i < watchRegs.size(); i++) acq.watchMask.Set(watchRegs[i]);
+        }
+        acq.sinks.push_back(&writer);
+
+        if (watchRegs.empty()) {
+            printf("Recording all registers every %d ms to %s\n", intervalMs, path);
+        } else {
+            printf("Recording %d registers every %d ms to %s\n", (int)watchRegs.size(), intervalMs, path);
+        }
+        printf("Press Ctrl+C to stop\n");
+        if (!StartAcquisition(acq)) return false;
+
+        LONGLONG deadline = (durationSec > 0) ? QpcNow() + QpcTicksFromMs(durationSec * 1000) : 0;
+        bool console = _isatty(_fileno(stdout)) != 0;
+        bool stop = false;
+        while (!stop && !writer.Failed()) {
+            const ECSnapshot* snap = WaitSnapshot(acq, RENDER_POLL_MS, &stop);
+            if (deadline != 0 && QpcNow() >= deadline) stop = true;
+            if (snap != NULL && console) {
+                char traceText[2 * MAX_PATH + 64];
+                TraceStatusText(traceText, sizeof(traceText));
+                printf("\rSnapshots: %llu%s", (unsigned long long)snap->sequence, traceText);
+                fflush(stdout);
+            }
+        }
+
+        StopAcquisition(acq);
+        bool ok = !writer.Failed();
+        writer.Close();
+
+        if (console) printf("\n");
+        if (!ok) printf("Error: Recording stopped, capture file could not be extended\n");
+        ULONG64 records = writer.RecordCount();
+        printf("Recorded %llu snapshots (%llu keyframes), %llu bytes",
+               (unsigned long long)records, (unsigned long long)writer.KeyframeCount(),
+               (unsigned long long)writer.Bytes());
+        if (records > 0) printf(", %.1f bytes/snapshot", (double)(writer.Bytes() - sizeof(CaptureFileHeader)) / records);
+        printf("\n");
+        return ok;
+    }
+
+    // Watch mode - stream a JSON line per change event to stdout and nothing otherwise.
+    // Events are written from the acquisition thread; this thread only waits for Ctrl+C,
+    // durationSec, or the reader closing the pipe. An empty watchlist watches the full grid.
+    bool Watch(int intervalMs, int fullEvery, const std::vector<UCHAR>& watchRegs,
+               const WatchPredicate& predicate, int durationSec) {
+        OutputBuffer out;
+        ChangeEventSink events(out, predicate);
+
+        AcquisitionState acq;
+        acq.intervalMs = intervalMs;
+        acq.scheduler.Reset(fullEvery);
+        if (!watchRegs.empty()) {
+            acq.useWatchMask = true;
+            for (size_t i = 0; i < watchRegs.size(); i++) acq.watchMask.Set(watchRegs[i]);
+        }
+        acq.sinks.push_back(&events);
+        if (!StartAcquisition(acq)) return false;
+
+        LONGLONG deadline = (durationSec > 0) ? QpcNow() + QpcTicksFromMs(durationSec * 1000) : 0;
+        bool stop = false;
+        while (!stop && !out.Failed()) {
+            WaitSnapshot(acq, RENDER_POLL_MS, &stop);
+            if (deadline != 0 && QpcNow() >= deadline) stop = true;
+        }
+
+        StopAcquisition(acq);
+        out.Flush();
+        if (verboseMode) fprintf(stderr, "[Verbose] %llu change events\n", (unsigned long long)events.Events());
+        return true;
+    }
+
+    // Correlate every register (or a watchlist) with a host signal, printing a ranked top-N list
+    // after each scan. The signal is sampled and the sums updated on this (render) thread as each
+    // snapshot arrives, so neither adds to the scan itself.
+    bool Correlate(HostSignal& signal, int intervalMs, const std::vector<UCHAR>& regs,
+                   int window, int maxLag, int top, int durationSec, bool useDecimal) {
+        if (!signal.Open()) return false;
+
+        AcquisitionState acq;
+        acq.intervalMs = intervalMs;
+        ECRegisterMask tracked;
+        if (regs.empty()) {
+            for (int i = 0; i < 256; i++) tracked.Set((UCHAR)i);
+        } else {
+            acq.useWatchMask = true;
+            for (size_t i = 0; i < regs.size(); i++) tracked.Set(regs[i]);
+            acq.watchMask = tracked;
+        }
+
+        CorrelationTracker tracker(window, maxLag, tracked);
+        std::vector<CorrelationResult> ranked(top);
+        ULONG64 lastSequence = 0;
+        ULONG64 missedScans = 0;        // Snapshots the renderer never saw (pairs then shift a scan)
+        ULONG64 signalFailures = 0;
+        double lastSignal = 0.0;
+
+        ConsoleFrame frame(FRAME_MAX_COLS, CORRELATE_HEADER_ROWS + top);
+        frame.BeginFullScreen();
+        if (!StartAcquisition(acq)) {
+            signal.Close();
+            return false;
+        }
+
+        LONGLONG deadline = (durationSec > 0) ? QpcNow() + QpcTicksFromMs(durationSec * 1000) : 0;
+        bool stop = false;
+        while (!stop) {
+            const ECSnapshot* snap = WaitSnapshot(acq, RENDER_POLL_MS, &stop);
+            if (deadline != 0 && QpcNow() >= deadline) stop = true;
+            if (snap == NULL) continue;
+
+            if (lastSequence != 0) missedScans += snap->sequence - lastSequence - 1;
+            lastSequence = snap->sequence;
+            if (signal.Sample(&lastSignal)) {
+                tracker.Add(lastSignal, snap->values);
+            } else {
+                signalFailures++;
+            }
+            int count = tracker.Rank(ranked.data(), top);
+
+            WORD text = frame.DefaultAttr();
+            frame.Clear();
+            frame.Text(0, 0, text, "EC Register Correlation - %d registers vs %s (%s) every %g seconds",
+                       tracked.Count(), signal.Name(), signal.Unit(), intervalMs / 1000.0);
+            frame.Text(0, 1, text, "Press Ctrl+C to exit | window %d scans (%g s) | lags 0..%d scans%s",
+                       window, window * intervalMs / 1000.0, maxLag, signalFailures ? " | signal unavailable on some scans" : "");
+            frame.Text(0, 2, text, "Scan #%llu | signal %.2f %s | pairs %d/%d | read time %.2fms | missed %llu",
+                       (unsigned long long)snap->sequence, lastSignal, signal.Unit(), tracker.Pairs(0), window,
+                       QpcToMs(snap->endQpc - snap->startQpc), (unsigned long long)missedScans);
+            frame.Text(0, 3, text, "=======================================================");
+            frame.Text(0, 4, text, "Rank  Reg   r       Lag (scans, s)  Value");
+            if (count == 0) {
+                frame.Text(0, CORRELATE_HEADER_ROWS, text, "Collecting samples (%d pairs needed)...", CORRELATE_MIN_PAIRS);
+            }
+            for (int i = 0; i < count; i++) {
+                const CorrelationResult& c = ranked[i];
+                double strength = fabs(c.r);
+                WORD attr = (strength >= 0.7) ? frame.Color(FOREGROUND_GREEN | FOREGROUND_INTENSITY)
+                          : (strength >= 0.4) ? frame.Color(FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY)
+                          : frame.Color(FOREGROUND_INTENSITY);
+                int y = CORRELATE_HEADER_ROWS + i;
+                frame.Text(0, y, text, "%3d.  0x%02X", i + 1, c.reg);
+                frame.Text(12, y, attr, "%+.3f", c.r);
+                frame.Text(20, y, text, "%3d (%g s)", c.lag, c.lag * intervalMs / 1000.0);
+                frame.Text(36, y, text, useDecimal ? "%3d" : "%02X", snap->values[c.reg]);
+            }
+            frame.Present();
+        }
+
+        StopAcquisition(acq);
+        frame.End();
+        signal.Close();
+        if (verboseMode) {
+            fprintf(stderr, "[Verbose] %llu paired samples, %llu missed scans, %llu signal failures\n",
+                    (unsigned long long)tracker.Samples(), (unsigned long long)missedScans,
+                    (unsigned long long)signalFailures);
+        }
+        return true;
+    }
+
+    // Read extended RAM [start, start + count) through an index/data port pair, in Access_EC
+    // holds sized by the lock chunk policy. Within a hold the high address byte is rewritten
+    // only when the page changes, so a sequential range costs two port accesses per byte;
+    // every new hold re-latches it, another owner may have moved the index.
+    // The bytes draw from their own XRAM_READ_BUDGET_PER_SEC bucket rather than the register
+    // budget; a signaled hStop abandons the range while it waits for tokens.
+    // Returns number of successful reads.
+    int ReadExtendedRange(const XramPorts& ports, int start, int count, UCHAR* out, bool* ok, HANDLE hStop = NULL) {
+        for (int i = 0; i < count; i++) {
+            out[i] = 0xFF;
+            ok[i] = false;
+        }
+        if (faults.BreakerOpen()) {
+            faults.CountSkipped(count);
+            return 0;
+        }
+        if (!xramGovernor.Acquire(count, hStop)) return 0;
+
+        int good = 0;
+        int latchedHi = -1;
+        int holdLeft = 0;
+        int held = 0;
+        LONGLONG holdStart = 0;
+        for (int i = 0; i < count; i++) {
+            if (holdLeft == 0) {
+                if (!AcquireMutexForBatch()) {
+                    failedReads += count - i;
+                    faults.OnMutexFailed();
+                    return good;
+                }
+                holdStart = QpcNow();
+                holdLeft = lockChunks.Chunk();
+                held = 0;
+                latchedHi = -1;
+            }
+
+            int address = start + i;
+            int hi = address >> 8;
+            LONGLONG readStart = QpcNow();
+
+            bool success = true;
+            if (hi != latchedHi) {
+                success = PortWrite(ports.addrHi, (UCHAR)hi);
+                latchedHi = success ? hi : -1;
+            }
+            success = success && PortWrite(ports.addrLo, (UCHAR)address) && PortRead(ports.data, &out[i]);
+            RecordPhase(&ECPhaseStats::registerRead, QpcToMicros(QpcNow() - readStart));
+
+            if (success) {
+                ok[i] = true;
+                successfulReads++;
+                good++;
+            } else {
+                out[i] = 0xFF;
+                latchedHi = -1;
+                failedReads++;
+            }
+
+            held++;
+            if (--holdLeft == 0 || i == count - 1) {
+                ReleaseMutexSafe();
+                ULONG64 holdUs = QpcToMicros(QpcNow() - holdStart);
+                RecordPhase(&ECPhaseStats::lockHold, holdUs);
+                lockChunks.OnHold(holdUs, held);
+                holdLeft = 0;
+            }
+        }
+        return good;
+    }
+
+    // One extended scan: the pages the scheduler selects, each read as one batch and merged
+    // into the sparse image. Pages whose bytes change are rescanned every cycle, static ones back off.
+    void ExtendedScanCycle(ExtendedScanState& xs) {
+        if (InterlockedExchange(&xs.fullSweepRequested, 0)) xs.scheduler.RequestFullSweep();
+
+        ECRegisterMask pages;
+        xs.scheduler.PlanCycle(pages);
+
+        UCHAR values[XRAM_PAGE_SIZE];
+        bool valid[XRAM_PAGE_SIZE];
+        int readBytes = 0;
+        int changedPages = 0;
+        LONGLONG scanStart = QpcNow();
+
+        for (int page = xs.FirstPage(); page <= xs.LastPage(); page++) {
+            if (!pages.Test((UCHAR)page)) continue;
+            if (xs.Stopping() || g_stopRequested) break;
+            int first = (page * XRAM_PAGE_SIZE > xs.start) ? page * XRAM_PAGE_SIZE : xs.start;
+            int last = (page * XRAM_PAGE_SIZE + XRAM_PAGE_SIZE - 1 < xs.end) ? page * XRAM_PAGE_SIZE + XRAM_PAGE_SIZE - 1 : xs.end;
+            int count = last - first + 1;
+
+            int good = ReadExtendedRange(xs.ports, first, count, values, valid, xs.hStop);
+            if (xs.Stopping()) break;
+            readBytes += count;
+
+            bool changed = false;
+            EnterCriticalSection(&xs.lock);
+            for (int i = 0; i < count; i++) {
+                if (valid[i] && xs.memory.Store(first + i, values[i])) changed = true;
+            }
+            if (good > 0) xs.memory.Touch(page).readCycle = xs.scheduler.Cycle();
+            LeaveCriticalSection(&xs.lock);
+
+            xs.scheduler.Observe((UCHAR)page, good > 0, changed);
+            if (changed) changedPages++;
+        }
+        xs.scheduler.EndCycle();
+
+        EnterCriticalSection(&xs.lock);
+        xs.cycles++;
+        xs.lastReadBytes = readBytes;
+        xs.lastChangedPages = changedPages;
+        xs.lastScanMs = QpcToMs(QpcNow() - scanStart);
+        LeaveCriticalSection(&xs.lock);
+    }
+
+    void OpenExtendedBudget() {
+        if (!xramGovernor.IsOpen() && !xramGovernor.Open(false, 0, XRAM_READ_BUDGET_PER_SEC) && verboseMode) {
+            printf("[Verbose] Warning: Extended RAM budget unavailable (Error: %lu), reads are not paced\n", GetLastError());
+        }
+    }
+
+    static DWORD WINAPI ExtendedThreadProc(LPVOID param) {
+        ExtendedScanState* xs = (ExtendedScanState*)param;
+        LONGLONG nextScan = QpcNow();
+        while (WaitForSingleObject(xs->hStop, 0) != WAIT_OBJECT_0) {
+            xs->reader->ExtendedScanCycle(*xs);
+
+            nextScan += QpcTicksFromMs(xs->intervalMs);
+            LONGLONG current = QpcNow();
+            if (nextScan < current) nextScan = current;
+            WaitForSingleObject(xs->hStop, (DWORD)QpcToMs(nextScan - current));
+        }
+        return 0;
+    }
+
+    // Extended RAM dump: one full scan of [start, end], 16 bytes per row, one buffered write
+    bool ExtendedDump(const XramPorts& ports, int start, int end) {
+        ExtendedScanState xs;
+        xs.reader = this;
+        xs.ports = ports;
+        xs.start = start;
+        xs.end = end;
+        xs.scheduler.Reset(1);
+        OpenExtendedBudget();
+        ExtendedScanCycle(xs);
+
+        OutputBuffer out;
+        int good = 0;
+        for (int row = start & ~0xF; row <= end; row += 16) {
+            const SparseECMemory::Page* page = xs.memory.GetPage(row / XRAM_PAGE_SIZE);
+            out.Printf("%04X:", row);
+            for (int address = row; address < row + 16; address++) {
+                UCHAR offset = (UCHAR)(address % XRAM_PAGE_SIZE);
+                if (address < start || address > end) {
+                    out.Printf("   ");
+                } else if (page != NULL && page->known.Test(offset)) {
+                    out.Printf(" %02X", page->values[offset]);
+                    good++;
+                } else {
+                    out.Printf(" ??");
+                }
+            }
+            out.Printf("\n");
+        }
+        out.Printf("Extended RAM 0x%04X-0x%04X via ports %X/%X/%X: %d/%d bytes read in %.0f ms (%d pages)\n",
+                   start, end, ports.addrHi, ports.addrLo, ports.data, good, end - start + 1,
+                   xs.lastScanMs, xs.memory.AllocatedPages());
+        out.Flush();
+
+        if (good == 0) {
+            printf("Error: No extended RAM byte could be read. The loaded module may not allow ports %X/%X/%X,\n",
+                   ports.addrHi, ports.addrLo, ports.data);
+            printf("       or this EC uses a different index/data pair (see --xram)\n");
+            return false;
+        }
+        return true;
+    }
+
+    // Extended RAM viewer: a scan thread keeps the sparse image current (change-driven with
+    // --adaptive), this thread shows one 256-byte page at a time. PgUp/PgDn switch pages.
+    bool ExtendedMonitor(const XramPorts& ports, int start, int end, int intervalMs, int fullEvery, bool useDecimal) {
+        ExtendedScanState xs;
+        xs.reader = this;
+        xs.ports = ports;
+        xs.start = start;
+        xs.end = end;
+        xs.intervalMs = intervalMs;
+        xs.scheduler.Reset(fullEvery);
+        OpenExtendedBudget();
+
+        InterlockedExchange(&g_stopRequested, 0);
+        SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+        xs.hStop = CreateEventA(NULL, TRUE, FALSE, NULL);
+        xs.hThread = (xs.hStop != NULL) ? CreateThread(NULL, 0, ExtendedThreadProc, &xs, 0, NULL) : NULL;
+        if (xs.hThread == NULL) {
+            printf("Error: Failed to start extended scan thread (Error: %lu)\n", GetLastError());
+            if (xs.hStop != NULL) CloseHandle(xs.hStop);
+            SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+            return false;
+        }
+
+        ConsoleFrame frame(FRAME_MAX_COLS, XRAM_FRAME_ROWS);
+        frame.BeginFullScreen();
+
+        int viewPage = xs.FirstPage();
+        UCHAR values[XRAM_PAGE_SIZE];
+        UCHAR displayed[XRAM_PAGE_SIZE];
+        ULONG64 shownCycle = 0;
+        bool pageSwitched = true;
+
+        while (g_stopRequested == 0) {
+            while (_kbhit()) {
+                int key = _getch();
+                if (key == 0 || key == 0xE0) {
+                    key = _getch();
+                    if (key == 73 && viewPage > xs.FirstPage()) viewPage--;             // PgUp
+                    else if (key == 81 && viewPage < xs.LastPage()) viewPage++;         // PgDn
+                    else if (key == 71) viewPage = xs.FirstPage();                      // Home
+                    else if (key == 79) viewPage = xs.LastPage();                       // End
+                    else continue;
+                    pageSwitched = true;
+                } else if ((key == 'p' || key == 'P') && viewPage > xs.FirstPage()) {
+                    viewPage--;
+                    pageSwitched = true;
+                } else if ((key == 'n' || key == 'N') && viewPage < xs.LastPage()) {
+                    viewPage++;
+                    pageSwitched = true;
+                } else if (key == 'f' || key == 'F') {
+                    InterlockedExchange(&xs.fullSweepRequested, 1);
+                }
+            }
+
+            // Copy the viewed page out under the lock; render without it
+            EnterCriticalSection(&xs.lock);
+            ULONG64 cycles = xs.cycles;
+            const SparseECMemory::Page* page = xs.memory.GetPage(viewPage);
+            bool fresh = (page != NULL && page->readCycle + 1 == cycles);
+            if (page != NULL) memcpy(values, page->values, sizeof(values));
+            else memset(values, 0, sizeof(values));
+            int readBytes = xs.lastReadBytes;
+            int changedPages = xs.lastChangedPages;
+            double scanMs = xs.lastScanMs;
+            int allocated = xs.memory.AllocatedPages();
+            LeaveCriticalSection(&xs.lock);
+
+            if (cycles == 0 || (cycles == shownCycle && !pageSwitched)) {
+                Sleep(RENDER_POLL_MS);
+                continue;
+            }
+            if (pageSwitched) memcpy(displayed, values, sizeof(displayed));
+
+            int pageStart = viewPage * XRAM_PAGE_SIZE;
+            int shownStart = (pageStart > start) ? pageStart : start;
+            int shownEnd = (pageStart + XRAM_PAGE_SIZE - 1 < end) ? pageStart + XRAM_PAGE_SIZE - 1 : end;
+
+            WORD text = frame.DefaultAttr();
+            frame.Clear();
+            frame.Text(0, 0, text, "Extended EC RAM 0x%04X-0x%04X (ports %X/%X/%X) - Updates every %g seconds",
+                       start, end, ports.addrHi, ports.addrLo, ports.data, intervalMs / 1000.0);
+            frame.Text(0, 1, text, "PgUp/PgDn or P/N: page, Home/End, F: full sweep, Ctrl+C: exit");
+            frame.Text(0, 2, text, "Page %02X: 0x%04X-0x%04X (%d of %d)%s", viewPage, shownStart, shownEnd,
+                       viewPage - xs.FirstPage() + 1, xs.LastPage() - xs.FirstPage() + 1,
+                       fresh ? "" : " - not re-read this scan");
+            frame.Text(0, 3, text, "Scan #%llu: %d bytes in %.0f ms, %d pages changed | %d pages in memory",
+                       (unsigned long long)cycles, readBytes, scanMs, changedPages, allocated);
+            frame.Text(0, 4, text, "=======================================================");
+
+            ECRegisterMask stale;
+            if (!fresh) {
+                for (int i = 0; i < XRAM_PAGE_SIZE; i++) stale.Set((UCHAR)i);
+            }
+            DrawRegisterGrid(frame, 6, values, displayed, &stale, useDecimal);
+            frame.Present();
+
+            memcpy(displayed, values, sizeof(displayed));
+            shownCycle = cycles;
+            pageSwitched = false;
+            Sleep(RENDER_POLL_MS);
+        }
+
+        SetEvent(xs.hStop);
+        WaitForSingleObject(xs.hThread, INFINITE);
+        CloseHandle(xs.hThread);
+        CloseHandle(xs.hStop);
+        SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+        frame.End();
+        return true;
+    }
+
+    // Dump all registers in grid format (one buffered write)
+    void DumpGrid(bool useDecimal) {
+        // Read all registers in one batch, then display
+        UCHAR values[256];
+        bool valid[256];
+        ReadECRange(0, 256, values, valid);
+        DrawDumpGrid(values, valid, useDecimal, labelChannel ? channel.name : NULL);
+    }
+
+    // Grid of one full read; channelName (NULL = unlabeled) goes into the title
+    static void DrawDumpGrid(const UCHAR* values, const bool* valid, bool useDecimal, const char* channelName) {
+        ConsoleFrame frame(FRAME_MAX_COLS, DUMP_FRAME_ROWS);
+        frame.BeginAtCursor();
+
+        WORD text = frame.DefaultAttr();
+        if (channelName != NULL) {
+            frame.Text(0, 0, text, "EC Register Dump (16x16 Grid), channel %s", channelName);
+        } else {
+            frame.Text(0, 0, text, "EC Register Dump (16x16 Grid)");
+        }
+        frame.Text(0, 1, text, "Red = Non-zero values, Gray = Zero/Empty");
+        frame.Text(0, 2, text, "=======================================================");
+
+        // Header
+        DrawGridHeader(frame, 4, useDecimal);
+
+        for (int row = 0; row < 16; row++) {
+            int y = 5 + row;
+            frame.Text(0, y, text, "%X0:  ", row);
+
+            for (int col = 0; col < 16; col++) {
+                int index = row * 16 + col;
+                UCHAR value = values[index];
+                int x = GridCellX(col, useDecimal);
+
+                if (valid[index]) {
+                    // Red for non-zero values, Dark gray for zero
+                    WORD attr = (value != 0) ? frame.Color(FOREGROUND_RED | FOREGROUND_INTENSITY)
+                                             : frame.Color(FOREGROUND_INTENSITY);
+                    frame.Text(x, y, attr, useDecimal ? "%3d" : "%02X", value);
+                } else {
+                    frame.Text(x, y, text, useDecimal ? " ??" : "??");
+                }
+            }
+        }
+
+        frame.Present();
+        frame.End();
+    }
+
+    // Benchmark: full scans, a single-register hot loop and raw status-port IOCTLs.
+    // Prints a human-readable report, or a single JSON object when json is set.
+    void Bench(int scans, int samples, UCHAR hotReg, bool json) {
+        LatencyHistogram scanTime;      // us per 256-register scan
+        LatencyHistogram hotRead;       // us per ReadECRegister
+        LatencyHistogram rawIoctl;      // us per ioctl_pio_read of the status port
+
+        // Bench measures the bus, so it doesn't wait on the budget; its reads still count
+        // against it, and other instances back off for the duration
+        budgetChargeOnly = true;
+
+        // 1. Full scans through the batched range reader, without burst mode
+        bool burstRequested = burstEnabled;
+        burstEnabled = false;
+        UCHAR values[256];
+        int scanGood = 0;
+        ULONG64 ioctlsBefore = phaseTotals.ioctl.Count();
+        LONGLONG sectionStart = QpcNow();
+        for (int i = 0; i < scans; i++) {
+            LONGLONG scanStart = QpcNow();
+            scanGood += ReadECRange(0, 256, values, NULL);
+            scanTime.Record(QpcToMicros(QpcNow() - scanStart));
+        }
+        double scanSeconds = QpcToMs(QpcNow() - sectionStart) / 1000.0;
+        ULONG64 scanIoctls = phaseTotals.ioctl.Count() - ioctlsBefore;
+
+        // 1b. The same scans in burst mode (--burst), to report the speedup
+        LatencyHistogram burstScanTime;
+        int burstGood = 0;
+        double burstSeconds = 0.0;
+        ULONG64 burstIoctls = 0;
+        burstEnabled = burstRequested;
+        if (burstEnabled) {
+            ioctlsBefore = phaseTotals.ioctl.Count();
+            sectionStart = QpcNow();
+            for (int i = 0; i < scans; i++) {
+                LONGLONG scanStart = QpcNow();
+                burstGood += ReadECRange(0, 256, values, NULL);
+                burstScanTime.Record(QpcToMicros(QpcNow() - scanStart));
+            }
+            burstSeconds = QpcToMs(QpcNow() - sectionStart) / 1000.0;
+            burstIoctls = phaseTotals.ioctl.Count() - ioctlsBefore;
+        }
+        double burstSpeedup = (burstSeconds > 0 && scanSeconds > 0) ? scanSeconds / burstSeconds : 0.0;
+
+        // 2. Hot loop on one register (lock per read, like a script polling -r)
+        int hotGood = 0;
+        ioctlsBefore = phaseTotals.ioctl.Count();
+        sectionStart = QpcNow();
+        for (int i = 0; i < samples; i++) {
+            bool success;
+            LONGLONG readStart = QpcNow();
+            ReadECRegister(hotReg, &success);
+            hotRead.Record(QpcToMicros(QpcNow() - readStart));
+            if (success) hotGood++;
+        }
+        double hotSeconds = QpcToMs(QpcNow() - sectionStart) / 1000.0;
+        ULONG64 hotIoctls = phaseTotals.ioctl.Count() - ioctlsBefore;
+
+        // 3. Raw ioctl_pio_read of the status port (pure driver round trip), in short lock holds
+        int rawGood = 0;
+        sectionStart = QpcNow();
+        for (int done = 0; done < samples; ) {
+            if (!AcquireMutexForBatch()) break;
+            for (int n = 0; n < BENCH_RAW_CHUNK && done < samples; n++, done++) {
+                UCHAR status;
+                LONGLONG ioStart = QpcNow();
+                if (PortRead(channel.cmd, &status)) rawGood++;
+                rawIoctl.Record(QpcToMicros(QpcNow() - ioStart));
+            }
             ReleaseMutexSafe();
+        }
+        double rawSeconds = QpcToMs(QpcNow() - sectionStart) / 1000.0;
+        budgetChargeOnly = false;
 
-            if (ok) {
-                // Success!
-                if (attempt > 0 && verboseMode) {
-                    printf("[Verbose] Read succeeded on retry %d\n", attempt);
-                }
-                if (verboseMode) {
-                    printf("[Verbose] EC[0x%02X] = 0x%02X\n", reg, value);
-                }
-                successfulReads++;
-                if (success) *success = true;
-                return value;
+        double scanRegsPerSec = scanSeconds > 0 ? scanGood / scanSeconds : 0.0;
+        double scanIoctlsPerSec = scanSeconds > 0 ? scanIoctls / scanSeconds : 0.0;
+        double hotReadsPerSec = hotSeconds > 0 ? hotGood / hotSeconds : 0.0;
+        double rawIoctlsPerSec = rawSeconds > 0 ? rawGood / rawSeconds : 0.0;
+
+        if (json) {
+            printf("{\"version\":\"%s\",\"transport\":\"%s\",", ECREADER_VERSION, transport->Name());
+            printf("\"scan\":{\"count\":%d,\"registers_ok\":%d,\"registers_failed\":%d,\"seconds\":%.6f,"
+                   "\"registers_per_sec\":%.1f,\"ioctls\":%llu,\"ioctls_per_sec\":%.1f,\"us\":",
+                   scans, scanGood, scans * 256 - scanGood, scanSeconds,
+                   scanRegsPerSec, (unsigned long long)scanIoctls, scanIoctlsPerSec);
+            PrintHistogramJson(scanTime);
+            if (burstEnabled) {
+                printf("},\"burst_scan\":{\"honored\":%s,\"sessions\":%d,\"drops\":%d,\"registers_ok\":%d,"
+                       "\"registers_failed\":%d,\"seconds\":%.6f,\"registers_per_sec\":%.1f,\"ioctls\":%llu,"
+                       "\"speedup\":%.2f,\"us\":",
+                       burstSupport == BURST_SUPPORTED ? "true" : "false", burstSessions, burstDrops,
+                       burstGood, scans * 256 - burstGood, burstSeconds,
+                       burstSeconds > 0 ? burstGood / burstSeconds : 0.0, (unsigned long long)burstIoctls, burstSpeedup);
+                PrintHistogramJson(burstScanTime);
             }
+            printf("},\"hot\":{\"register\":%u,\"count\":%d,\"ok\":%d,\"seconds\":%.6f,"
+                   "\"reads_per_sec\":%.1f,\"ioctls\":%llu,\"us\":",
+                   hotReg, samples, hotGood, hotSeconds, hotReadsPerSec, (unsigned long long)hotIoctls);
+            PrintHistogramJson(hotRead);
+            printf("},\"raw_ioctl\":{\"port\":%u,\"count\":%d,\"ok\":%d,\"seconds\":%.6f,"
+                   "\"ioctls_per_sec\":%.1f,\"us\":",
+                   channel.cmd, samples, rawGood, rawSeconds, rawIoctlsPerSec);
+            PrintHistogramJson(rawIoctl);
+            printf("}}\n");
+            return;
+        }
 
-            // Failed - retry if attempts remaining
-            if (attempt < EC_MAX_RETRIES - 1) {
-                retryCount++;
-                if (verboseMode) {
-                    printf("[Verbose] Read failed, retry %d/%d\n", attempt + 1, EC_MAX_RETRIES - 1);
-                }
-                Sleep(0);  // Brief yield before retry
+        printf("=== EC Benchmark (v%s, %s transport) ===\n", ECREADER_VERSION, transport->Name());
+        printf("Full scans:         %d x 256 registers (%d failed)\n", scans, scans * 256 - scanGood);
+        PrintHistogramLine("  Scan time:", scanTime, "us");
+        printf("  Registers/sec:    %.1f\n", scanRegsPerSec);
+        printf("  IOCTLs/sec:       %.1f (%.1f per register)\n", scanIoctlsPerSec,
+               scanGood > 0 ? (double)scanIoctls / scanGood : 0.0);
+        if (burstEnabled) {
+            printf("Burst scans:        %d x 256 registers (%d failed), firmware %s burst mode\n",
+                   scans, scans * 256 - burstGood, burstSupport == BURST_SUPPORTED ? "honors" : "ignores");
+            PrintHistogramLine("  Scan time:", burstScanTime, "us");
+            printf("  Registers/sec:    %.1f\n", burstSeconds > 0 ? burstGood / burstSeconds : 0.0);
+            printf("  IOCTLs/sec:       %.1f (%.1f per register)\n", burstSeconds > 0 ? burstIoctls / burstSeconds : 0.0,
+                   burstGood > 0 ? (double)burstIoctls / burstGood : 0.0);
+            printf("  Speedup:          %.2fx over normal scans (%d sessions, %d early exits)\n",
+                   burstSpeedup, burstSessions, burstDrops);
+        }
+        printf("Hot loop 0x%02X:      %d reads (%d failed)\n", hotReg, samples, samples - hotGood);
+        PrintHistogramLine("  Read latency:", hotRead, "us");
+        printf("  Reads/sec:        %.1f\n", hotReadsPerSec);
+        printf("Raw status IOCTL:   %d x ioctl_pio_read(0x%02X) (%d failed)\n", samples, channel.cmd, samples - rawGood);
+        PrintHistogramLine("  IOCTL latency:", rawIoctl, "us");
+        printf("  IOCTLs/sec:       %.1f\n", rawIoctlsPerSec);
+        printf("(percentiles: p50 / p90 / p99 / max)\n");
+    }
+
+    void PrintStatistics() {
+        if (labelChannel) {
+            printf("\n=== Statistics (channel %s) ===\n", channel.name);
+        } else {
+            printf("\n=== Statistics ===\n");
+        }
+        printf("Successful reads: %d\n", successfulReads);
+        printf("Failed reads:     %d\n", failedReads);
+        printf("Retry attempts:   %d\n", retryCount);
+        if (hMutex != NULL) {
+            printf("Mutex retries:    %d\n", mutexRetries);
+            printf("Mutex failures:   %d\n", mutexWaitFailures);
+            if (lockChunks.IsAdaptive()) {
+                printf("Lock chunking:    adaptive, %d registers/hold now (smallest %d); %d of %d acquires contended\n",
+                       lockChunks.Chunk(), lockChunks.SmallestChunk(), lockChunks.Contended(), lockChunks.Acquires());
+            } else {
+                printf("Lock chunking:    fixed %d registers/hold; %d of %d acquires contended\n",
+                       lockChunks.Chunk(), lockChunks.Contended(), lockChunks.Acquires());
+            }
+        }
+        if (waitPolicy.IsAdaptive()) {
+            printf("Wait backoff:     adaptive (typical polls IBF %.1f, OBF %.1f; spin %d/%d)\n",
+                   waitPolicy.TypicalPolls(EC_WAIT_IBF), waitPolicy.TypicalPolls(EC_WAIT_OBF),
+                   waitPolicy.SpinBudget(EC_WAIT_IBF), waitPolicy.SpinBudget(EC_WAIT_OBF));
+        } else {
+            printf("Wait backoff:     fixed spin %d polls\n", waitPolicy.SpinBudget(EC_WAIT_IBF));
+        }
+        governor.PrintStatistics();
+        if (acquisitionProfile[0] != '\0') {
+            printf("Acquisition:      %s\n", acquisitionProfile);
+        }
+        if (fieldReads > 0) {
+            printf("Field reads:      %d (%d re-reads for a moving high byte, %d torn)\n", fieldReads, fieldTears, fieldTorn);
+        }
+        if (burstEnabled) {
+            if (burstSupport == BURST_SUPPORTED) {
+                printf("Burst mode:       %d sessions (%d early exits, %d fallbacks)\n",
+                       burstSessions, burstDrops, burstFallbacks);
+            } else {
+                printf("Burst mode:       %s, normal reads used\n",
+                       burstSupport == BURST_UNSUPPORTED ? "not acknowledged by firmware" : "not used");
+            }
+        }
+        faults.PrintStatistics();
+        g_events.PrintStatistics();
+        if (successfulReads + failedReads > 0) {
+            float rate = (float)successfulReads / (successfulReads + failedReads) * 100.0f;
+            printf("Success rate:     %.1f%%\n", rate);
+            if (retryCount > 0) {
+                float retryRate = (float)retryCount / (successfulReads + failedReads);
+                printf("Avg retries:      %.2f per operation\n", retryRate);
             }
         }
 
-        // All retries exhausted
-        failedReads++;
-        return 0xFF;
+        printf("\n--- Latency (p50 / p90 / p99 / max) ---\n");
+        if (hMutex != NULL) {
+            PrintHistogramLine("Mutex wait:", phaseTotals.mutexWait, "us");
+            PrintHistogramLine("Lock hold:", phaseTotals.lockHold, "us");
+        }
+        PrintHistogramLine("Register read:", phaseTotals.registerRead, "us");
+        PrintHistogramLine("IBF wait:", phaseTotals.ibfWait, "us");
+        PrintHistogramLine("IBF polls:", phaseTotals.ibfPolls, "polls");
+        PrintHistogramLine("OBF wait:", phaseTotals.obfWait, "us");
+        PrintHistogramLine("OBF polls:", phaseTotals.obfPolls, "polls");
+        PrintHistogramLine("IOCTL round trip:", phaseTotals.ioctl, "us");
+        if (phaseTotals.scanDuration.Count() > 0) {
+            PrintHistogramLine("Scan duration:", phaseTotals.scanDuration, "us");
+            PrintHistogramLine("Scan jitter:", phaseTotals.scanJitter, "us");
+        }
+        transport->PrintStatistics();
+        printf("==================\n");
     }
+};
 
-    // Monitor mode - track changes across all registers in grid format
-    void Monitor(int intervalMs, bool useDecimal) {
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
-        GetConsoleScreenBufferInfo(hConsole, &consoleInfo);
-        WORD savedAttributes = consoleInfo.wAttributes;
+// Consistent copy of the shared snapshot published by a running monitor/record/serve.
+// No EC access and, once mapped, no syscalls: the seqlock retry loop runs in user mode.
+static bool ReadSharedSnapshot(SharedSnapshot& out) {
+    HANDLE hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, SHM_NAME_GLOBAL);
+    if (hMapping == NULL) {
+        hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, SHM_NAME_LOCAL);
+    }
+    if (hMapping == NULL) {
+        printf("Error: No ECReader instance is publishing snapshots (start monitor, record or serve)\n");
+        return false;
+    }
 
-        UCHAR currentValues[256];
-        UCHAR previousValues[256];
-        int changeCount = 0;
+    const SharedSnapshot* shared = (const SharedSnapshot*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, sizeof(SharedSnapshot));
+    if (shared == NULL) {
+        printf("Error: Failed to map shared snapshot (Error: %lu)\n", GetLastError());
+        CloseHandle(hMapping);
+        return false;
+    }
 
-        memset(currentValues, 0, sizeof(currentValues));
-        memset(previousValues, 0, sizeof(previousValues));
+    // A publisher that just created the mapping may still be filling in the header
+    for (int spin = 0; spin < SHM_INIT_SPINS && shared->magic == 0; spin++) YieldProcessor();
 
-        while (true) {
-            DWORD readStartTime = GetTickCount();
+    bool ok = false;
+    if (shared->magic != SHM_MAGIC || shared->version != SHM_VERSION) {
+        printf("Error: Shared snapshot has an unknown layout (version %lu)\n", shared->version);
+    } else {
+        for (int attempt = 0; attempt < SHM_READ_RETRIES && !ok; attempt++) {
+            LONG64 before = shared->sequence;
+            if (before & 1) {
+                // Writer is mid-update
+                YieldProcessor();
+                continue;
+            }
+            MemoryBarrier();
+            memcpy(&out, (const void*)shared, sizeof(out));
+            MemoryBarrier();
+            ok = (shared->sequence == before);
+        }
+        if (!ok) printf("Error: Shared snapshot did not settle (publisher stalled mid-update?)\n");
+    }
 
-            // Read all registers
-            for (int i = 0; i < 256; i++) {
-                bool success;
-                currentValues[i] = ReadECRegister((UCHAR)i, &success);
-                if (!success) currentValues[i] = 0xFF;
+    UnmapViewOfFile(shared);
+    CloseHandle(hMapping);
+    return ok;
+}
+
+// Client side of serve mode: one request/response round trip to a running server
+static bool ReadViaServer(const ECRegisterMask& mask, UCHAR* values, bool* valid) {
+    HANDLE pipe;
+    for (;;) {
+        pipe = CreateFileA(SERVE_PIPE_NAME, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (pipe != INVALID_HANDLE_VALUE) break;
+
+        DWORD error = GetLastError();
+        if (error == ERROR_PIPE_BUSY) {
+            // All instances in use; wait for one to free up
+            if (WaitNamedPipeA(SERVE_PIPE_NAME, SERVE_CONNECT_TIMEOUT_MS)) continue;
+            printf("Error: ECReader server is busy\n");
+        } else if (error == ERROR_FILE_NOT_FOUND) {
+            printf("Error: No ECReader server running (start one with 'ECReader.exe serve')\n");
+        } else {
+            printf("Error: Cannot connect to ECReader server (Error: %lu)\n", error);
+        }
+        return false;
+    }
+
+    DWORD mode = PIPE_READMODE_MESSAGE;
+    SetNamedPipeHandleState(pipe, &mode, NULL, NULL);
+
+    ServeRequest request;
+    request.version = SERVE_PROTOCOL_VERSION;
+    request.reserved = 0;
+    request.mask = mask;
+
+    ServeResponse response;
+    DWORD received = 0;
+    BOOL ok = TransactNamedPipe(pipe, &request, sizeof(request), &response, sizeof(response), &received, NULL);
+    DWORD error = GetLastError();
+    CloseHandle(pipe);
+
+    if (!ok || received != sizeof(response)) {
+        printf("Error: ECReader server did not answer (Error: %lu)\n", ok ? 0 : error);
+        return false;
+    }
+    if (response.version != SERVE_PROTOCOL_VERSION || response.status != SERVE_STATUS_OK) {
+        printf("Error: ECReader server rejected the request (protocol version %d)\n", SERVE_PROTOCOL_VERSION);
+        return false;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        valid[i] = response.valid.Test((UCHAR)i);
+        values[i] = response.values[i];
+    }
+    return true;
+}
+
+// Output formats for dump and -r (--format)
+enum OutputFormat {
+    FORMAT_TEXT,        // 0x30:5A,... for -r, the colored grid for dump
+    FORMAT_JSON,
+    FORMAT_CSV,
+    FORMAT_RAW          // Binary: RawResultHeader + one RawRegisterEntry per register
+};
+
+static bool ParseOutputFormat(const char* name, OutputFormat* format) {
+    if (strcmp(name, "text") == 0) *format = FORMAT_TEXT;
+    else if (strcmp(name, "json") == 0) *format = FORMAT_JSON;
+    else if (strcmp(name, "csv") == 0) *format = FORMAT_CSV;
+    else if (strcmp(name, "raw") == 0) *format = FORMAT_RAW;
+    else return false;
+    return true;
+}
+
+#define RAW_MAGIC "ECRRAW1"
+
+struct RawResultHeader {
+    char magic[8];
+    ULONG64 startWallTime;      // FILETIME (UTC) before the first register read
+    ULONG64 endWallTime;        // FILETIME (UTC) after the last register read
+    ULONG count;                // RawRegisterEntry records that follow
+    ULONG channel;              // ECChannel::Tag() of the ports read (0 = 62/66)
+};
+
+struct RawRegisterEntry {
+    UCHAR reg;
+    UCHAR value;
+    UCHAR ok;
+    UCHAR reserved;
+};
+
+static_assert(sizeof(RawResultHeader) == 32, "RawResultHeader layout is part of the raw format");
+static_assert(sizeof(RawRegisterEntry) == 4, "RawRegisterEntry layout is part of the raw format");
+
+static ULONG64 WallTimeNow() {
+    FILETIME now;
+    GetSystemTimePreciseAsFileTime(&now);
+    return ((ULONG64)now.dwHighDateTime << 32) | now.dwLowDateTime;
+}
+
+// Format the values of regs (values / valid indexed by register) as one result and write it
+// to stdout with a single call. startWall / endWall bracket the reads (FILETIME, UTC);
+// channel, when set, labels the result with the port pair it was read from.
+static bool WriteRegisterValues(OutputFormat format, const std::vector<UCHAR>& regs, const UCHAR* values,
+                                const bool* valid, ULONG64 startWall, ULONG64 endWall, bool useDecimal,
+                                const ECChannel* channel = NULL) {
+    if (format == FORMAT_RAW && _isatty(_fileno(stdout))) {
+        printf("Error: --format raw writes binary data; redirect stdout to a file or pipe\n");
+        return false;
+    }
+
+    OutputBuffer out;
+    char startText[40];
+    char endText[40];
+    FormatIsoTime(startWall, startText, sizeof(startText));
+    FormatIsoTime(endWall, endText, sizeof(endText));
+
+    if (format == FORMAT_JSON) {
+        int good = 0;
+        for (size_t i = 0; i < regs.size(); i++) good += valid[regs[i]];
+        if (channel != NULL) out.Printf("{\"channel\":\"%s\",", channel->name);
+        else out.Printf("{");
+        out.Printf("\"start\":\"%s\",\"end\":\"%s\",\"duration_us\":%llu,\"ok\":%d,\"failed\":%d,\"registers\":[",
+                   startText, endText, (unsigned long long)(endWall > startWall ? (endWall - startWall) / 10 : 0),
+                   good, (int)regs.size() - good);
+        for (size_t i = 0; i < regs.size(); i++) {
+            UCHAR reg = regs[i];
+            if (valid[reg]) {
+                out.Printf("%s{\"reg\":\"0x%02X\",\"value\":%u,\"ok\":true}", i ? "," : "", reg, values[reg]);
+            } else {
+                out.Printf("%s{\"reg\":\"0x%02X\",\"value\":null,\"ok\":false}", i ? "," : "", reg);
+            }
+        }
+        out.Printf("]}\n");
+    } else if (format == FORMAT_CSV) {
+        out.Printf("%sstart,end,reg,value,ok\n", channel != NULL ? "channel," : "");
+        for (size_t i = 0; i < regs.size(); i++) {
+            UCHAR reg = regs[i];
+            if (channel != NULL) out.Printf("%s,", channel->name);
+            if (valid[reg]) {
+                out.Printf("%s,%s,0x%02X,%u,1\n", startText, endText, reg, values[reg]);
+            } else {
+                out.Printf("%s,%s,0x%02X,,0\n", startText, endText, reg);
+            }
+        }
+    } else if (format == FORMAT_RAW) {
+        RawResultHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RAW_MAGIC, sizeof(RAW_MAGIC));
+        header.startWallTime = startWall;
+        header.endWallTime = endWall;
+        header.count = (ULONG)regs.size();
+        header.channel = channel != NULL ? channel->Tag() : 0;
+        out.Write(&header, sizeof(header));
+        for (size_t i = 0; i < regs.size(); i++) {
+            RawRegisterEntry entry;
+            entry.reg = regs[i];
+            entry.ok = valid[regs[i]] ? 1 : 0;
+            entry.value = entry.ok ? values[regs[i]] : 0xFF;
+            entry.reserved = 0;
+            out.Write(&entry, sizeof(entry));
+        }
+    } else {
+        // "0x30:5A,0x31:3C" in command-line order, ?? for failed reads
+        for (size_t i = 0; i < regs.size(); i++) {
+            UCHAR reg = regs[i];
+            const char* separator = i ? "," : "";
+            if (!valid[reg]) {
+                out.Printf("%s0x%02X:??", separator, reg);
+            } else if (useDecimal) {
+                out.Printf("%s0x%02X:%d", separator, reg, values[reg]);
+            } else {
+                out.Printf("%s0x%02X:%02X", separator, reg, values[reg]);
             }
+        }
+        out.Printf("\n");
+    }
+
+    return out.Flush();
+}
 
-            DWORD readDuration = GetTickCount() - readStartTime;
+// Registers covered by fields
+static void FieldMask(const std::vector<ECField>& fields, ECRegisterMask& mask) {
+    mask.Clear();
+    for (size_t f = 0; f < fields.size(); f++) {
+        for (int i = 0; i < fields[f].Size(); i++) mask.Set((UCHAR)(fields[f].reg + i));
+    }
+}
 
-            // Count changes
-            changeCount = 0;
-            for (int i = 0; i < 256; i++) {
-                if (currentValues[i] != previousValues[i]) {
-                    changeCount++;
+// Decode fields from per-register values (server or shared snapshot: no verification possible)
+static void DecodeFields(const std::vector<ECField>& fields, const UCHAR* values, const bool* valid, ECFieldValue* out) {
+    for (size_t f = 0; f < fields.size(); f++) {
+        const ECField& field = fields[f];
+        ECFieldValue& v = out[f];
+        v.torn = false;
+        v.tears = 0;
+        v.lo = values[field.LowReg()];
+        v.hi = (field.Size() == 2) ? values[field.HighReg()] : 0;
+        v.ok = valid[field.LowReg()] && valid[field.HighReg()];
+        v.value = v.ok ? field.Decode(v.lo, v.hi) : 0;
+    }
+}
+
+// "fan_rpm" or "0x4A:u16le"
+static void FieldLabel(const ECField& field, char* out, size_t outSize) {
+    if (field.name[0] != '\0') snprintf(out, outSize, "%s", field.name);
+    else snprintf(out, outSize, "0x%02X:%s", field.reg, g_fieldTypes[field.type].name);
+}
+
+// Decoded value, scaled if the profile gives a scale
+static void FieldValueText(const ECField& field, const ECFieldValue& v, char* out, size_t outSize) {
+    if (field.scale == 1.0) snprintf(out, outSize, "%ld", (long)v.value);
+    else snprintf(out, outSize, "%.10g", v.value * field.scale);
+}
+
+// Field results of -r, formatted like WriteRegisterValues. Text: "fan_rpm=2600,0x30:s8=-5";
+// raw writes the underlying register bytes as RawRegisterEntry records.
+static bool WriteFieldValues(OutputFormat format, const std::vector<ECField>& fields, const ECFieldValue* results,
+                             ULONG64 startWall, ULONG64 endWall) {
+    if (format == FORMAT_RAW && _isatty(_fileno(stdout))) {
+        printf("Error: --format raw writes binary data; redirect stdout to a file or pipe\n");
+        return false;
+    }
+
+    OutputBuffer out;
+    char startText[40];
+    char endText[40];
+    FormatIsoTime(startWall, startText, sizeof(startText));
+    FormatIsoTime(endWall, endText, sizeof(endText));
+    char label[FIELD_NAME_MAX + 16];
+    char value[40];
+
+    if (format == FORMAT_JSON) {
+        int good = 0;
+        int tears = 0;
+        for (size_t f = 0; f < fields.size(); f++) {
+            good += results[f].ok;
+            tears += results[f].tears;
+        }
+        out.Printf("{\"start\":\"%s\",\"end\":\"%s\",\"duration_us\":%llu,\"ok\":%d,\"failed\":%d,\"tears\":%d,\"fields\":[",
+                   startText, endText, (unsigned long long)(endWall > startWall ? (endWall - startWall) / 10 : 0),
+                   good, (int)fields.size() - good, tears);
+        for (size_t f = 0; f < fields.size(); f++) {
+            const ECField& field = fields[f];
+            const ECFieldValue& v = results[f];
+            out.Printf("%s{", f ? "," : "");
+            if (field.name[0] != '\0') {
+                out.Printf("\"name\":");
+                out.JsonString(field.name);
+                out.Printf(",");
+            }
+            out.Printf("\"reg\":\"0x%02X\",\"type\":\"%s\",", field.reg, g_fieldTypes[field.type].name);
+            if (v.ok) {
+                FieldValueText(field, v, value, sizeof(value));
+                out.Printf("\"value\":%s,", value);
+            } else {
+                out.Printf("\"value\":null,");
+            }
+            if (field.unit[0] != '\0') {
+                out.Printf("\"unit\":");
+                out.JsonString(field.unit);
+                out.Printf(",");
+            }
+            out.Printf("\"ok\":%s,\"tears\":%d%s}", v.ok ? "true" : "false", v.tears, v.torn ? ",\"torn\":true" : "");
+        }
+        out.Printf("]}\n");
+    } else if (format == FORMAT_CSV) {
+        out.Printf("start,end,name,reg,type,value,unit,ok,tears\n");
+        for (size_t f = 0; f < fields.size(); f++) {
+            const ECField& field = fields[f];
+            const ECFieldValue& v = results[f];
+            if (v.ok) FieldValueText(field, v, value, sizeof(value));
+            else value[0] = '\0';
+            out.Printf("%s,%s,", startText, endText);
+            out.CsvField(field.name);
+            out.Printf(",0x%02X,%s,%s,", field.reg, g_fieldTypes[field.type].name, value);
+            out.CsvField(field.unit);
+            out.Printf(",%d,%d\n", v.ok ? 1 : 0, v.tears);
+        }
+    } else if (format == FORMAT_RAW) {
+        RawResultHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RAW_MAGIC, sizeof(RAW_MAGIC));
+        header.startWallTime = startWall;
+        header.endWallTime = endWall;
+        for (size_t f = 0; f < fields.size(); f++) header.count += fields[f].Size();
+        out.Write(&header, sizeof(header));
+        for (size_t f = 0; f < fields.size(); f++) {
+            for (int i = 0; i < fields[f].Size(); i++) {
+                RawRegisterEntry entry;
+                entry.reg = (UCHAR)(fields[f].reg + i);
+                entry.ok = results[f].ok ? 1 : 0;
+                entry.value = !entry.ok ? 0xFF : (entry.reg == fields[f].LowReg()) ? results[f].lo : results[f].hi;
+                entry.reserved = 0;
+                out.Write(&entry, sizeof(entry));
+            }
+        }
+    } else {
+        for (size_t f = 0; f < fields.size(); f++) {
+            const ECField& field = fields[f];
+            const ECFieldValue& v = results[f];
+            FieldLabel(field, label, sizeof(label));
+            if (!v.ok) {
+                out.Printf("%s%s=??%s", f ? "," : "", label, v.torn ? "(torn)" : "");
+            } else {
+                FieldValueText(field, v, value, sizeof(value));
+                out.Printf("%s%s=%s%s", f ? "," : "", label, value, field.unit);
+            }
+        }
+        out.Printf("\n");
+    }
+
+    return out.Flush();
+}
+
+// Shortest monitor interval allowed for regCount registers per scan at budget reads/s
+static int WatchMinIntervalMs(int regCount, int budget) {
+    int budgetMs = (regCount * 1000 + budget - 1) / budget;
+    return (budgetMs > WATCH_MIN_INTERVAL_MS) ? budgetMs : WATCH_MIN_INTERVAL_MS;
+}
+
+// Format a FILETIME as local "YYYY-MM-DD HH:MM:SS"
+static void FormatWallTime(ULONG64 wallTime, char* out, size_t outSize) {
+    FILETIME utc, local;
+    SYSTEMTIME st;
+    utc.dwLowDateTime = (DWORD)wallTime;
+    utc.dwHighDateTime = (DWORD)(wallTime >> 32);
+    if (!FileTimeToLocalFileTime(&utc, &local) || !FileTimeToSystemTime(&local, &st)) {
+        snprintf(out, outSize, "?");
+        return;
+    }
+    snprintf(out, outSize, "%04d-%02d-%02d %02d:%02d:%02d",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+}
+
+// Candidate 16-bit register pair: hi steps by one exactly when lo wraps
+#define PAIR_MIN_HI_CHANGES       2
+#define PAIR_MIN_CARRY_RATIO      0.75
+
+// Analyze mode - per-register statistics and 16-bit pair detection over a capture.
+// Work is proportional to the number of changes, not snapshots x registers: a register's
+// value is weighted by how long it was held when it changes, so unchanged registers cost nothing.
+static bool AnalyzeCapture(const char* path) {
+    CaptureReader capture;
+    if (!capture.Open(path)) return false;
+    LONGLONG started = QpcNow();
+
+    CaptureCursor cursor;
+    ULONG64 changes[256];
+    ULONG64 rises[256];
+    ULONG64 falls[256];
+    ULONG64 wraps[256];
+    double weightedSum[256];      // Sum of value x records held
+    ULONG64 heldSince[256];       // Record index at which the current value appeared
+    ULONG64 firstSeen[256];       // Record index of the first successful read
+    UCHAR minValue[256];
+    UCHAR maxValue[256];
+    ULONG64 stamp[256];           // Record index + 1 of the register's last change
+    int step[256];                // Signed step of that change (mod 256)
+    UCHAR previous[256];          // Value before that change
+    ULONG64 carryLE[256];         // Pair (lo = r, hi = r + 1): hi changes that coincided with a lo wrap
+    ULONG64 hiChangesLE[256];
+    ULONG64 carryBE[256];         // Pair (hi = r, lo = r + 1)
+    ULONG64 hiChangesBE[256];
+    memset(changes, 0, sizeof(changes));
+    memset(rises, 0, sizeof(rises));
+    memset(falls, 0, sizeof(falls));
+    memset(wraps, 0, sizeof(wraps));
+    memset(weightedSum, 0, sizeof(weightedSum));
+    memset(heldSince, 0, sizeof(heldSince));
+    memset(firstSeen, 0, sizeof(firstSeen));
+    memset(minValue, 0xFF, sizeof(minValue));
+    memset(maxValue, 0, sizeof(maxValue));
+    memset(stamp, 0, sizeof(stamp));
+    memset(carryLE, 0, sizeof(carryLE));
+    memset(hiChangesLE, 0, sizeof(hiChangesLE));
+    memset(carryBE, 0, sizeof(carryBE));
+    memset(hiChangesBE, 0, sizeof(hiChangesBE));
+
+    UCHAR changedRegs[256];
+    UCHAR oldValues[256];
+    ULONG64 keyframes = 0;
+    CaptureRecordHeader rec;
+    const UCHAR* payload;
+    while (capture.Next(rec, payload)) {
+        ULONG64 index = cursor.index;
+        ECRegisterMask knownBefore = cursor.known;
+        int count = cursor.Apply(rec, payload, changedRegs, oldValues);
+        if (rec.type == CAPTURE_REC_KEYFRAME) keyframes++;
+
+        // Per-register reductions
+        for (int i = 0; i < count; i++) {
+            UCHAR reg = changedRegs[i];
+            UCHAR value = cursor.values[reg];
+            bool seen = knownBefore.Test(reg);
+            if (seen) {
+                weightedSum[reg] += (double)oldValues[i] * (double)(index - heldSince[reg]);
+                int delta = (signed char)(UCHAR)(value - oldValues[i]);
+                changes[reg]++;
+                if (delta > 0) rises[reg]++;
+                if (delta < 0) falls[reg]++;
+                if ((delta > 0) ? (value < oldValues[i]) : (value > oldValues[i])) wraps[reg]++;
+                step[reg] = delta;
+                previous[reg] = oldValues[i];
+                stamp[reg] = index + 1;
+            } else {
+                firstSeen[reg] = index;
+            }
+            heldSince[reg] = index;
+            if (value < minValue[reg]) minValue[reg] = value;
+            if (value > maxValue[reg]) maxValue[reg] = value;
+        }
+
+        // Carry patterns: a hi byte stepping by one in the same record its lo byte wraps
+        // (hi up while lo drops, or hi down while lo rises)
+        for (int i = 0; i < count; i++) {
+            UCHAR hi = changedRegs[i];
+            if (stamp[hi] != index + 1 || (step[hi] != 1 && step[hi] != -1)) continue;
+            for (int order = 0; order < 2; order++) {
+                if ((order == 0 && hi == 0) || (order == 1 && hi == 255)) continue;
+                UCHAR lo = (order == 0) ? (UCHAR)(hi - 1) : (UCHAR)(hi + 1);
+                bool carry = stamp[lo] == index + 1 &&
+                             ((step[hi] > 0) ? cursor.values[lo] < previous[lo] : cursor.values[lo] > previous[lo]);
+                if (order == 0) {
+                    hiChangesLE[lo]++;
+                    if (carry) carryLE[lo]++;
+                } else {
+                    hiChangesBE[hi]++;
+                    if (carry) carryBE[hi]++;
                 }
             }
+        }
+    }
+    ULONG64 records = cursor.index;
+    double elapsedMs = QpcToMs(QpcNow() - started);
+
+    // Summary
+    const CaptureFileHeader& header = capture.Header();
+    char startText[32];
+    FormatWallTime(header.startWallTime, startText, sizeof(startText));
+    printf("Capture:    %s%s\n", path, capture.Complete() ? "" : " (incomplete - recording was not closed)");
+    printf("Started:    %s\n", startText);
+    if (header.channel != 0) {
+        char channelText[12];
+        ECChannel::TagName(header.channel, channelText, sizeof(channelText));
+        printf("Channel:    %s\n", channelText);
+    }
+    printf("Duration:   %.1f s, %llu snapshots (%llu keyframes), interval %lu ms\n",
+           cursor.timeUs / 1000000.0, (unsigned long long)records, (unsigned long long)keyframes, header.intervalMs);
+    printf("Registers:  %d read, ", cursor.known.Count());
+    int changing = 0;
+    for (int i = 0; i < 256; i++) {
+        if (changes[i] > 0) changing++;
+    }
+    printf("%d changed\n\n", changing);
 
-            // Clear screen and redraw
-            system("cls");
-            COORD coordScreen = { 0, 0 };
-            SetConsoleCursorPosition(hConsole, coordScreen);
+    if (changing > 0) {
+        printf("Reg   Changes    Min  Max  Mean     Trend\n");
+        printf("--------------------------------------------------\n");
+        for (int i = 0; i < 256; i++) {
+            if (changes[i] == 0) continue;
+            double sum = weightedSum[i] + (double)cursor.values[i] * (double)(records - heldSince[i]);
+            const char* trend = "mixed";
+            if (falls[i] == 0) trend = wraps[i] ? "increasing (wraps)" : "increasing";
+            else if (rises[i] == 0) trend = wraps[i] ? "decreasing (wraps)" : "decreasing";
+            printf("0x%02X  %-9llu  %3d  %3d  %-7.2f  %s\n", i, (unsigned long long)changes[i],
+                   minValue[i], maxValue[i], sum / (double)(records - firstSeen[i]), trend);
+        }
+        printf("\n");
+    }
 
-            printf("EC Register Monitor (16x16 grid) - Updates every %d seconds        \n", intervalMs / 1000);
-            printf("Press Ctrl+C to exit\n");
-            printf("Red=changed, Green=non-zero unchanged, Gray=zero/empty\n");
-            printf("Changes detected: %d | Read time: %lums\n", changeCount, readDuration);
-            printf("=======================================================\n");
-            printf("\n");
+    // 16-bit pair candidates
+    int pairs = 0;
+    for (int r = 0; r < 255; r++) {
+        for (int order = 0; order < 2; order++) {
+            ULONG64 carries = order == 0 ? carryLE[r] : carryBE[r];
+            ULONG64 hiChanges = order == 0 ? hiChangesLE[r] : hiChangesBE[r];
+            if (hiChanges < PAIR_MIN_HI_CHANGES || carries < hiChanges * PAIR_MIN_CARRY_RATIO) continue;
+            UCHAR lo = order == 0 ? (UCHAR)r : (UCHAR)(r + 1);
+            UCHAR hi = order == 0 ? (UCHAR)(r + 1) : (UCHAR)r;
+            if (changes[lo] < changes[hi]) continue;
+            if (pairs++ == 0) printf("16-bit candidates (carry from low to high byte):\n");
+            printf("  0x%02X/0x%02X  %s  lo=0x%02X hi=0x%02X  carries %llu/%llu  now %u\n",
+                   r, r + 1, order == 0 ? "LE" : "BE", lo, hi,
+                   (unsigned long long)carries, (unsigned long long)hiChanges,
+                   (unsigned)(cursor.values[lo] | (cursor.values[hi] << 8)));
+        }
+    }
+    if (pairs == 0) printf("No 16-bit register pairs detected\n");
 
-            // Header
-            printf("     ");
-            for (int col = 0; col < 16; col++) {
-                printf("+%X ", col);
+    printf("\nAnalyzed %llu snapshots in %.1f ms", (unsigned long long)records, elapsedMs);
+    if (elapsedMs > 0) printf(" (%.1f M snapshots/s)", records / elapsedMs / 1000.0);
+    printf("\n");
+    return true;
+}
+
+// Replay mode - play a capture back through the monitor grid at 'speed' x real time
+static bool ReplayCapture(const char* path, double speed, bool useDecimal) {
+    CaptureReader capture;
+    if (!capture.Open(path)) return false;
+    ULONG64 total = capture.CountRecords();
+
+    InterlockedExchange(&g_stopRequested, 0);
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+    CaptureCursor cursor;
+    UCHAR displayed[256];
+    memset(displayed, 0, sizeof(displayed));
+    UCHAR changedRegs[256];
+    UCHAR oldValues[256];
+
+    ConsoleFrame frame(FRAME_MAX_COLS, MONITOR_FRAME_ROWS);
+    frame.BeginFullScreen();
+
+    LONGLONG startQpc = QpcNow();
+    LONGLONG lastRender = 0;
+    bool dirty = false;
+    bool more = true;
+    while (more && !g_stopRequested) {
+        CaptureRecordHeader rec;
+        const UCHAR* payload;
+        more = capture.Next(rec, payload);
+
+        // Capture time of this record on the replay clock
+        LONGLONG due = startQpc;
+        if (more) {
+            ULONG64 timeUs = cursor.timeUs + (cursor.index > 0 ? rec.deltaUs : 0);
+            due += (LONGLONG)((double)timeUs / speed * (double)QpcFrequency() / 1000000.0);
+        }
+
+        // Show the state before this record while waiting for it, and at least every
+        // RENDER_POLL_MS when replaying faster than the screen can follow
+        LONGLONG now = QpcNow();
+        if (dirty && (!more || now < due || now - lastRender >= QpcTicksFromMs(RENDER_POLL_MS))) {
+            char timeText[32];
+            FormatWallTime(cursor.wallTime, timeText, sizeof(timeText));
+            int changeCount = 0;
+            for (int i = 0; i < 256; i++) {
+                if (cursor.values[i] != displayed[i]) changeCount++;
             }
-            printf("\n");
 
-            // Grid rows
-            for (int row = 0; row < 16; row++) {
-                printf("%X0:  ", row);
+            WORD text = frame.DefaultAttr();
+            frame.Clear();
+            if (capture.Header().channel != 0) {
+                char channelText[12];
+                ECChannel::TagName(capture.Header().channel, channelText, sizeof(channelText));
+                frame.Text(0, 0, text, "EC Capture Replay - %s, channel %s (%.1fx)", path, channelText, speed);
+            } else {
+                frame.Text(0, 0, text, "EC Capture Replay - %s (%.1fx)", path, speed);
+            }
+            frame.Text(0, 1, text, "Press Ctrl+C to exit");
+            frame.Text(0, 2, text, "Red=changed, Green=non-zero unchanged, Gray=zero/empty");
+            frame.Text(0, 3, text, "Snapshot %llu/%llu | %s | +%.1f s | Changes: %d",
+                       (unsigned long long)cursor.index, (unsigned long long)total, timeText,
+                       cursor.timeUs / 1000000.0, changeCount);
+            frame.Text(0, 5, text, "=======================================================");
+            DrawRegisterGrid(frame, 7, cursor.values, displayed, NULL, useDecimal);
+            frame.Present();
 
-                for (int col = 0; col < 16; col++) {
-                    int index = row * 16 + col;
-                    UCHAR value = currentValues[index];
-                    bool changed = (currentValues[index] != previousValues[index]);
+            memcpy(displayed, cursor.values, sizeof(displayed));
+            lastRender = now;
+            dirty = false;
+        }
+        if (!more) break;
 
-                    if (changed) {
-                        // Red for changed values
-                        SetConsoleTextAttribute(hConsole, FOREGROUND_RED | FOREGROUND_INTENSITY);
-                    } else if (value != 0) {
-                        // Green for non-zero unchanged values
-                        SetConsoleTextAttribute(hConsole, FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                    } else {
-                        // Dark gray for zero values
-                        SetConsoleTextAttribute(hConsole, FOREGROUND_INTENSITY);
-                    }
+        // Sleep in short slices so Ctrl+C stays responsive
+        while (!g_stopRequested && (now = QpcNow()) < due) {
+            double remaining = QpcToMs(due - now);
+            Sleep(remaining > RENDER_POLL_MS ? RENDER_POLL_MS : (DWORD)remaining);
+        }
 
-                    printf("%02X ", value);
-                    SetConsoleTextAttribute(hConsole, savedAttributes);
-                }
-                printf("\n");
+        cursor.Apply(rec, payload, changedRegs, oldValues);
+        dirty = true;
+    }
+
+    frame.End();
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+    return true;
+}
+
+// One channel's full read for a multi-channel dump, filled on its own thread
+struct ChannelDump {
+    ECReader* reader;
+    UCHAR values[256];
+    bool valid[256];
+    ULONG64 startWall;
+    ULONG64 endWall;
+    LONGLONG durationQpc;
+};
+
+static DWORD WINAPI ChannelDumpProc(LPVOID param) {
+    ChannelDump* dump = (ChannelDump*)param;
+    LONGLONG start = QpcNow();
+    dump->startWall = WallTimeNow();
+    dump->reader->ReadECRange(0, 256, dump->values, dump->valid);
+    dump->endWall = WallTimeNow();
+    dump->durationQpc = QpcNow() - start;
+    return 0;
+}
+
+// dump with several --channel options: each channel is read on its own thread, in parallel
+// (the speedup over reading them in turn is unmeasured on hardware). Results print in --channel order.
+static bool DumpChannels(std::vector<ECReader*>& readers, OutputFormat format, bool useDecimal) {
+    std::vector<ChannelDump> dumps(readers.size());
+    std::vector<HANDLE> threads;
+    LONGLONG start = QpcNow();
+    for (size_t c = 0; c < readers.size(); c++) {
+        dumps[c].reader = readers[c];
+        HANDLE hThread = CreateThread(NULL, 0, ChannelDumpProc, &dumps[c], 0, NULL);
+        if (hThread == NULL) {
+            printf("Error: Failed to start the scan thread of channel %s (Error: %lu)\n",
+                   readers[c]->Channel().name, GetLastError());
+            break;
+        }
+        threads.push_back(hThread);
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        WaitForSingleObject(threads[t], INFINITE);
+        CloseHandle(threads[t]);
+    }
+    if (threads.size() != readers.size()) return false;
+    double totalMs = QpcToMs(QpcNow() - start);
+
+    std::vector<UCHAR> regs(256);
+    for (int i = 0; i < 256; i++) regs[i] = (UCHAR)i;
+    double slowestMs = 0.0;
+    for (size_t c = 0; c < dumps.size(); c++) {
+        const ChannelDump& dump = dumps[c];
+        double ms = QpcToMs(dump.durationQpc);
+        if (ms > slowestMs) slowestMs = ms;
+        if (format == FORMAT_TEXT) {
+            ECReader::DrawDumpGrid(dump.values, dump.valid, useDecimal, dump.reader->Channel().name);
+        } else if (!WriteRegisterValues(format, regs, dump.values, dump.valid, dump.startWall, dump.endWall,
+                                        useDecimal, &dump.reader->Channel())) {
+            return false;
+        }
+    }
+    if (g_verbose) {
+        fprintf(stderr, "[Verbose] %d channels read in %.1f ms (slowest channel %.1f ms)\n",
+                (int)dumps.size(), totalMs, slowestMs);
+    }
+    return true;
+}
+
+// Keys of a session with several channels, read once: F and T go to every channel (each
+// saves its own trace file)
+static void HandleChannelKeys(std::vector<ECReader*>& readers, std::vector<AcquisitionState>& acqs) {
+    ConsoleKeys pressed;
+    ReadConsoleKeys(pressed);
+    for (int k = 0; k < pressed.count; k++) {
+        for (size_t c = 0; c < readers.size(); c++) readers[c]->HandleAcquisitionKey(acqs[c], pressed.keys[k]);
+    }
+}
+
+// monitor with several --channel options: one acquisition thread per channel at the same
+// interval, and one frame stacking a grid per channel. The first channel's snapshots pace
+// the renderer; the others are picked up as they arrive.
+static void MonitorChannels(std::vector<ECReader*>& readers, int intervalMs, bool useDecimal, int fullEvery) {
+    size_t count = readers.size();
+    std::vector<AcquisitionState> acqs(count);
+    std::vector<UCHAR> displayed(count * 256, 0);   // Previous scan per channel, for change highlighting
+    std::vector<UCHAR> latest(count * 256, 0);
+    std::vector<bool> haveSnapshot(count, false);
+
+    ConsoleFrame frame(FRAME_MAX_COLS, CHANNELS_HEADER_ROWS + (int)count * CHANNEL_BLOCK_ROWS);
+    frame.BeginFullScreen();
+
+    size_t started = 0;
+    for (; started < count; started++) {
+        acqs[started].intervalMs = intervalMs;
+        acqs[started].scheduler.Reset(fullEvery);
+        if (!readers[started]->StartAcquisition(acqs[started])) break;
+    }
+
+    bool stop = (started < count);
+    while (!stop) {
+        bool dirty = false;
+        for (size_t c = 0; c < count && !stop; c++) {
+            const ECSnapshot* snap = readers[c]->NextSnapshot(acqs[c], c == 0 ? RENDER_POLL_MS : 0, &stop);
+            if (snap == NULL) continue;
+            memcpy(&displayed[c * 256], &latest[c * 256], 256);
+            memcpy(&latest[c * 256], snap->values, 256);
+            haveSnapshot[c] = true;
+            dirty = true;
+        }
+        HandleChannelKeys(readers, acqs);
+        if (!dirty || stop) continue;
+
+        WORD text = frame.DefaultAttr();
+        frame.Clear();
+        frame.Text(0, 0, text, "EC Register Monitor - %d channels, updates every %g seconds", (int)count, intervalMs / 1000.0);
+        frame.Text(0, 1, text, "Ctrl+C: exit | F: full sweep%s", ECTrace::compiled ? " | T: save traces" : "");
+        frame.Text(0, 2, text, "Red=changed, Green=non-zero unchanged, Cyan=stale (not re-read), Gray=zero/empty");
+        frame.Text(0, 3, text, "=======================================================");
+
+        for (size_t c = 0; c < count; c++) {
+            int y = CHANNELS_HEADER_ROWS + (int)c * CHANNEL_BLOCK_ROWS;
+            if (!haveSnapshot[c]) {
+                frame.Text(0, y, text, "Channel %s: waiting for the first scan", readers[c]->Channel().name);
+                continue;
+            }
+            const ECSnapshot& snap = acqs[c].snapshots.ReadSlot();
+            const UCHAR* previous = &displayed[c * 256];
+            int changeCount = 0;
+            ECRegisterMask stale;
+            for (int i = 0; i < 256; i++) {
+                if (snap.values[i] != previous[i]) changeCount++;
+                if (snap.readQpc[i] < snap.startQpc) stale.Set((UCHAR)i);
             }
+            char traceText[2 * MAX_PATH + 64];
+            readers[c]->TraceStatusText(traceText, sizeof(traceText));
+            frame.Text(0, y, text, "Channel %s | Scan #%llu | Read time: %.1fms | Reads: %d/256 (%s) | Changes: %d | read p99 %llu us%s",
+                       readers[c]->Channel().name, (unsigned long long)snap.sequence,
+                       QpcToMs(snap.endQpc - snap.startQpc), snap.readCount, snap.fullSweep ? "full" : "adaptive",
+                       changeCount, (unsigned long long)snap.summary.readP99, traceText);
+            DrawRegisterGrid(frame, y + 1, snap.values, previous, &stale, useDecimal);
+        }
+        frame.Present();
+    }
+
+    while (started > 0) {
+        started--;
+        readers[started]->StopAcquisition(acqs[started]);
+    }
+    frame.End();
+}
+
+// record with several --channel options: one acquisition thread and one capture file per
+// channel (see ChannelFilePath), each header tagged with its port pair
+static bool RecordChannels(std::vector<ECReader*>& readers, const char* path, int intervalMs, int fullEvery,
+                           const std::vector<UCHAR>& watchRegs, int keyframeEvery, int durationSec) {
+    size_t count = readers.size();
+    std::vector<CaptureWriter> writers(count);
+    std::vector<AcquisitionState> acqs(count);
+    std::vector<ULONG64> snapshots(count, 0);
+
+    for (size_t c = 0; c < count; c++) {
+        char channelPath[MAX_PATH];
+        ChannelFilePath(path, readers[c]->Channel(), channelPath, sizeof(channelPath));
+        if (!writers[c].Open(channelPath, keyframeEvery, intervalMs, readers[c]->Channel().Tag())) return false;
+
+        AcquisitionState& acq = acqs[c];
+        acq.intervalMs = intervalMs;
+        acq.scheduler.Reset(fullEvery);
+        if (!watchRegs.empty()) {
+            acq.useWatchMask = true;
+            for (size_t i = 0; i < watchRegs.size(); i++) acq.watchMask.Set(watchRegs[i]);
+        }
+        acq.sinks.push_back(&writers[c]);
+
+        if (watchRegs.empty()) {
+            printf("Recording all registers of channel %s every %d ms to %s\n", readers[c]->Channel().name, intervalMs, channelPath);
+        } else {
+            printf("Recording %d registers of channel %s every %d ms to %s\n", (int)watchRegs.size(),
+                   readers[c]->Channel().name, intervalMs, channelPath);
+        }
+    }
+    printf("Press Ctrl+C to stop\n");
+
+    size_t started = 0;
+    for (; started < count; started++) {
+        if (!readers[started]->StartAcquisition(acqs[started])) break;
+    }
 
-            // Clear any remaining lines
-            for (int i = 0; i < 5; i++) {
-                printf("                                                                  \n");
+    LONGLONG deadline = (durationSec > 0) ? QpcNow() + QpcTicksFromMs(durationSec * 1000) : 0;
+    bool console = _isatty(_fileno(stdout)) != 0;
+    bool ok = (started == count);
+    bool stop = !ok;
+    while (!stop) {
+        bool progress = false;
+        for (size_t c = 0; c < count && !stop; c++) {
+            const ECSnapshot* snap = readers[c]->NextSnapshot(acqs[c], c == 0 ? RENDER_POLL_MS : 0, &stop);
+            if (snap == NULL) continue;
+            snapshots[c] = snap->sequence;
+            progress = true;
+        }
+        HandleChannelKeys(readers, acqs);
+        for (size_t c = 0; c < count; c++) {
+            if (writers[c].Failed()) stop = true;
+        }
+        if (deadline != 0 && QpcNow() >= deadline) stop = true;
+        if (progress && console) {
+            printf("\rSnapshots:");
+            for (size_t c = 0; c < count; c++) {
+                char traceText[2 * MAX_PATH + 64];
+                readers[c]->TraceStatusText(traceText, sizeof(traceText));
+                printf(" %s %llu%s", readers[c]->Channel().name, (unsigned long long)snapshots[c], traceText);
             }
+            fflush(stdout);
+        }
+    }
+
+    while (started > 0) {
+        started--;
+        readers[started]->StopAcquisition(acqs[started]);
+    }
+
+    if (console) printf("\n");
+    for (size_t c = 0; c < count; c++) {
+        CaptureWriter& writer = writers[c];
+        bool written = !writer.Failed();
+        writer.Close();
+        if (!written) {
+            printf("Error: Recording of channel %s stopped, capture file could not be extended\n", readers[c]->Channel().name);
+            ok = false;
+        }
+        ULONG64 records = writer.RecordCount();
+        printf("Channel %s: recorded %llu snapshots (%llu keyframes), %llu bytes", readers[c]->Channel().name,
+               (unsigned long long)records, (unsigned long long)writer.KeyframeCount(),
+               (unsigned long long)writer.Bytes());
+        if (records > 0) printf(", %.1f bytes/snapshot", (double)(writer.Bytes() - sizeof(CaptureFileHeader)) / records);
+        printf("\n");
+    }
+    return ok;
+}
+
+// Options that consume the following argument (skipped when collecting -r registers)
+static bool OptionTakesValue(const char* arg) {
+    return strcmp(arg, "-i") == 0 || strcmp(arg, "--backoff") == 0 || strcmp(arg, "--sim-config") == 0 ||
+           strcmp(arg, "--full-every") == 0 || strcmp(arg, "--keyframe") == 0 || strcmp(arg, "--duration") == 0 ||
+           strcmp(arg, "--speed") == 0 || strcmp(arg, "--module") == 0 || strcmp(arg, "--cpu") == 0 || strcmp(arg, "--format") == 0 ||
+           strcmp(arg, "--xram") == 0 || strcmp(arg, "--budget") == 0 || strcmp(arg, "--lock-chunk") == 0 ||
+           strcmp(arg, "--threshold") == 0 || strcmp(arg, "--range") == 0 || strcmp(arg, "--signal") == 0 ||
+           strcmp(arg, "--window") == 0 || strcmp(arg, "--max-lag") == 0 || strcmp(arg, "--top") == 0 ||
+           strcmp(arg, "--profile") == 0 || strcmp(arg, "--trace") == 0 || strcmp(arg, "--channel") == 0 ||
+           strcmp(arg, "--scans") == 0 || strcmp(arg, "--samples") == 0 || strcmp(arg, "--reg") == 0;
+}
+
+// Apply the scan interval default and minimum for a full grid (watchCount == 0) or a watchlist.
+// Minimums follow the bus budget: 2 s for a full grid at the default 128 reads/s.
+static bool ResolveScanInterval(int& intervalMs, int watchCount, int budget) {
+    if (watchCount > 0) {
+        int minMs = WatchMinIntervalMs(watchCount, budget);
+        if (intervalMs < 0) intervalMs = minMs;
+        if (intervalMs < minMs) {
+            printf("Error: Minimum interval for %d registers is %d ms (budget %d reads/s)\n",
+                   watchCount, minMs, budget);
+            return false;
+        }
+    } else {
+        int minMs = WatchMinIntervalMs(256, budget);
+        if (intervalMs < 0) intervalMs = (minMs > 5000) ? minMs : 5000;
+        if (intervalMs < minMs) {
+            printf("Error: Minimum interval for a full scan is %d ms (budget %d reads/s, see --budget)\n",
+                   minMs, budget);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Collect register addresses from argv[start..], skipping flags and their values
+static void CollectRegisters(int argc, char* argv[], int start, std::vector<UCHAR>& regs, ECRegisterMask& mask) {
+    for (int i = start; i < argc; i++) {
+        // Skip flags
+        if (argv[i][0] == '-') {
+            if (OptionTakesValue(argv[i])) i++; // Skip option value
+            continue;
+        }
 
-            // Copy current to previous
-            memcpy(previousValues, currentValues, sizeof(currentValues));
+        UCHAR reg = (UCHAR)strtoul(argv[i], NULL, 16);
+        regs.push_back(reg);
+        mask.Set(reg);
+    }
+}
 
-            // Sleep for remaining time (subtract read duration from interval)
-            DWORD sleepTime = (readDuration < (DWORD)intervalMs) ? (intervalMs - readDuration) : 0;
-            if (sleepTime > 0) {
-                Sleep(sleepTime);
-            }
+// Parse -r entries from argv[start..] as fields, skipping flags and their values. *typed is
+// set when any entry is more than a plain register. With a profile and no entries, all of its fields.
+static bool CollectFields(int argc, char* argv[], int start, const FieldProfile& profile,
+                          std::vector<ECField>& fields, bool* typed) {
+    *typed = false;
+    for (int i = start; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (OptionTakesValue(argv[i])) i++;
+            continue;
         }
+        ECField field;
+        if (!ParseFieldSpec(argv[i], profile, &field)) return false;
+        if (field.name[0] != '\0' || strchr(argv[i], ':') != NULL) *typed = true;
+        fields.push_back(field);
     }
+    if (fields.empty() && !profile.Fields().empty()) {
+        fields = profile.Fields();
+        *typed = true;
+    }
+    return true;
+}
 
-    // Dump all registers in grid format
-    void DumpGrid(bool useDecimal) {
-        // Get console handle for colors
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
-        GetConsoleScreenBufferInfo(hConsole, &consoleInfo);
-        WORD savedAttributes = consoleInfo.wAttributes;
+// record <file> [-r <reg> ...] [--keyframe N] [--duration seconds]
+struct RecordOptions {
+    const char* path;
+    std::vector<UCHAR> watchRegs;       // Empty = full grid
+    int keyframeEvery;
+    int durationSec;                    // 0 = until Ctrl+C
 
-        printf("EC Register Dump (16x16 Grid)\n");
-        printf("Red = Non-zero values, Gray = Zero/Empty\n");
-        printf("=======================================================\n\n");
+    RecordOptions() : path(NULL), keyframeEvery(CAPTURE_DEFAULT_KEYFRAME), durationSec(0) {}
 
-        // Header
-        printf("     ");
-        for (int col = 0; col < 16; col++) {
-            if (useDecimal) {
-                printf("+%2X ", col);
-            } else {
-                printf("+%X ", col);
+    bool Parse(int argc, char* argv[]) {
+        if (argc < 3 || argv[2][0] == '-') {
+            printf("Error: No capture file specified\n");
+            return false;
+        }
+        path = argv[2];
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--keyframe") == 0 && i + 1 < argc) {
+                keyframeEvery = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+                durationSec = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "-r") == 0 && watchRegs.empty()) {
+                // Registers may be followed by more options, so keep scanning
+                ECRegisterMask watchMask;
+                CollectRegisters(argc, argv, i + 1, watchRegs, watchMask);
             }
         }
-        printf("\n");
-
-        // Read and display all registers
-        for (int row = 0; row < 16; row++) {
-            printf("%X0:  ", row);
-
-            for (int col = 0; col < 16; col++) {
-                int index = row * 16 + col;
-                bool success;
-                UCHAR value = ReadECRegister((UCHAR)index, &success);
-
-                if (success) {
-                    // Red for non-zero values, Dark gray for zero
-                    if (value != 0) {
-                        SetConsoleTextAttribute(hConsole, FOREGROUND_RED | FOREGROUND_INTENSITY);
-                    } else {
-                        SetConsoleTextAttribute(hConsole, FOREGROUND_INTENSITY);
-                    }
+        if (keyframeEvery < 1 || durationSec < 0) {
+            printf("Error: --keyframe expects a positive count and --duration a non-negative number of seconds\n");
+            return false;
+        }
+        return true;
+    }
+};
 
-                    if (useDecimal) {
-                        printf("%3d ", value);
-                    } else {
-                        printf("%02X ", value);
-                    }
+// dump, monitor and record across the readers of several --channel options (all open)
+static bool RunChannels(std::vector<ECReader*>& readers, int argc, char* argv[], int intervalMs, int fullEvery,
+                        OutputFormat format, bool useDecimal) {
+    const char* command = argv[1];
+    for (size_t c = 0; c < readers.size(); c++) readers[c]->suppressVerbose = true;
 
-                    SetConsoleTextAttribute(hConsole, savedAttributes);
-                } else {
-                    if (useDecimal) {
-                        printf(" ?? ");
-                    } else {
-                        printf("?? ");
-                    }
-                }
-            }
-            printf("\n");
-        }
-        printf("\n");
+    if (strcmp(command, "dump") == 0) {
+        return DumpChannels(readers, format, useDecimal);
     }
 
-    void PrintStatistics() {
-        printf("\n=== Statistics ===\n");
-        printf("Successful reads: %d\n", successfulReads);
-        printf("Failed reads:     %d\n", failedReads);
-        printf("Retry attempts:   %d\n", retryCount);
-        if (hMutex != NULL) {
-            printf("Mutex retries:    %d\n", mutexRetries);
-            printf("Mutex failures:   %d\n", mutexWaitFailures);
-        }
-        if (successfulReads + failedReads > 0) {
-            float rate = (float)successfulReads / (successfulReads + failedReads) * 100.0f;
-            printf("Success rate:     %.1f%%\n", rate);
-            if (retryCount > 0) {
-                float retryRate = (float)retryCount / (successfulReads + failedReads);
-                printf("Avg retries:      %.2f per operation\n", retryRate);
+    if (strcmp(command, "monitor") == 0) {
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-r") == 0) {
+                printf("Error: monitor -r watches a single channel\n");
+                return false;
             }
         }
-        printf("==================\n");
+        if (!ResolveScanInterval(intervalMs, 0, readers[0]->BudgetRate())) return false;
+        MonitorChannels(readers, intervalMs, useDecimal, fullEvery);
+        return true;
     }
-};
+
+    RecordOptions record;
+    return record.Parse(argc, argv) &&
+           ResolveScanInterval(intervalMs, (int)record.watchRegs.size(), readers[0]->BudgetRate()) &&
+           RecordChannels(readers, record.path, intervalMs, fullEvery, record.watchRegs, record.keyframeEvery,
+                          record.durationSec);
+}
 
 void PrintUsage(const char* programName) {
     printf("EC Register Reader - READ-ONLY Tool\n");
@@ -640,27 +7640,117 @@ void PrintUsage(const char* programName) {
     
     printf("Commands:\n");
     printf("  monitor                - Monitor all registers, show changes\n");
+    printf("  monitor -r <reg> [...] - Monitor a watchlist of registers (sub-second refresh)\n");
     printf("  -r <reg> [reg2...]     - Read specific register(s)\n");
+    printf("  -r <reg>:<type> [...]  - Read typed fields: u8, s8, u16le, u16be, s16le, s16be\n");
+    printf("  watch [-r <reg> ...]   - Print a JSON line per register change, nothing otherwise\n");
+    printf("  correlate              - Rank registers by correlation with a host signal (add -r for a watchlist)\n");
     printf("  dump                   - Dump all registers in grid format\n");
+    printf("  xdump <start> <end>    - Dump extended EC RAM (16-bit addresses, hex, inclusive)\n");
+    printf("  xmonitor <start> <end> - Monitor extended EC RAM one 256-byte page at a time\n");
+    printf("                           (own budget: %d bytes/s, a full 64 KB sweep takes %d s)\n",
+           XRAM_READ_BUDGET_PER_SEC, XRAM_SPACE_SIZE / XRAM_READ_BUDGET_PER_SEC);
+    printf("  serve                  - Keep the driver open and answer reads from other processes\n");
+    printf("  record <file>          - Record snapshots to a capture file (add -r <reg> ... for a watchlist)\n");
+    printf("  analyze <file>         - Per-register statistics and 16-bit pair detection for a capture\n");
+    printf("  replay <file>          - Play a capture back in the monitor grid (--speed <factor>)\n");
+    printf("  bench                  - Measure scan, register and IOCTL throughput/latency\n");
     printf("  version                - Show version information\n");
     printf("  -h, --help             - Show this help\n\n");
     
     printf("Options:\n");
-    printf("  -i <seconds>           - Update interval for monitor (default: 5, min: 2)\n");
+    printf("  -i <seconds>           - Update interval for monitor (default: 5, min: 256 reads at the budget)\n");
+    printf("                           Watchlists accept fractions, min derives from the same budget\n");
+    printf("  --budget <reads/s>     - EC bus budget shared by all ECReader processes (default: %d,\n", EC_READ_BUDGET_PER_SEC);
+    printf("                           max: %d); the lowest ceiling among running instances applies\n", EC_READ_BUDGET_MAX);
     printf("  -d                     - Display values in decimal instead of hex\n");
-    printf("  -v                     - Verbose mode (for -r command only)\n");
-    printf("  -s                     - Show statistics after operation\n\n");
+    printf("  -v                     - Verbose mode (for -r command only), with the trace of each read\n");
+    printf("  -s                     - Show statistics after operation\n");
+    printf("  --trace <exit|error>   - Dump the port-level trace ring to stderr on exit, or after each\n");
+    printf("                           failed read (repeat for both); T saves it in monitor\n");
+    printf("  --format <fmt>         - dump / -r output: text (default), json, csv or raw (binary);\n");
+    printf("                           one write per result, timestamps and per-register ok flags\n");
+    printf("  --backoff <auto|N>     - EC wait backoff: learn per machine (default) or spin N polls\n");
+    printf("  --lock-chunk <auto|N>  - Registers per Access_EC hold: adapt to lock contention (default)\n");
+    printf("                           or hold for at most N registers\n");
+    printf("  --adaptive             - Monitor: re-read only volatile registers, full sweep every %d cycles\n", SCHED_DEFAULT_FULL_EVERY);
+    printf("  --full-every <N>       - Monitor: full sweep period in cycles (N > 1 implies --adaptive)\n");
+    printf("  --burst                - Batched reads use ACPI burst mode, %d registers per session\n", EC_BURST_MAX_REGISTERS);
+    printf("  --realtime             - Monitor/record: MMCSS or time-critical acquisition thread, 1 ms timer,\n");
+    printf("                           high-resolution interval timer (scan jitter shown with -s)\n");
+    printf("  --cpu <N>              - Monitor/record: pin the acquisition thread to processor N\n");
+    printf("                           (with several --channel options, channel k to processor N + k)\n");
+    printf("  --xram <ene|hi,lo,data> - Extended RAM index/data ports (default: ene = 381,382,383;\n");
+    printf("                           custom ports must lie within %X-%X)\n", XRAM_CUSTOM_PORT_MIN, XRAM_CUSTOM_PORT_MAX);
+    printf("  --channel <spec>       - EC port pair: primary (62/66, default), secondary (68/6C) or data,cmd\n");
+    printf("                           with cmd = data + 4 in 62-6F;\n");
+    printf("                           repeat (up to %d) to scan several channels at once in dump/monitor/record\n", EC_CHANNELS_MAX);
+    printf("  --via-server           - -r: read through a running 'serve' instance (no driver open)\n");
+    printf("  --from-shm             - -r: copy the snapshot published by monitor/record/serve (no EC access)\n");
+    printf("  --profile <file>       - -r: field definitions (<name> <reg> <type> [scale] [unit] per line)\n");
+    printf("  --verify               - -r fields: read high, low, high again and retry a torn value\n");
+    printf("  --module <file>        - Load the PawnIO module from a file instead of the embedded copy\n");
+    printf("  --sim                  - Use a simulated EC instead of PawnIO (no driver/admin needed)\n");
+    printf("  --sim-config <k=v,..>  - Simulator timing: ioctl, ibf, obf (us), dist=fixed|uniform|exp,\n");
+    printf("                           stall, stallus, busy, busyus, burst=0|1, burstus,\n");
+    printf("                           peer=<ms>, peerus, dead=<reg>,\n                           wedge=<s>, wedgefor=<s>, seed (implies --sim)\n\n");
+
+    printf("Record/replay options:\n");
+    printf("  --keyframe <N>         - Store all 256 values every N snapshots (default: %d)\n", CAPTURE_DEFAULT_KEYFRAME);
+    printf("  --duration <seconds>   - Stop after this long (default: until Ctrl+C)\n");
+    printf("  --speed <factor>       - Replay: playback speed relative to real time (default: 1)\n\n");
+
+    printf("Watch options:\n");
+    printf("  --on-change            - Report every change (default)\n");
+    printf("  --threshold <N>        - Report when a value moved N or more from the last report\n");
+    printf("  --range <lo>:<hi>      - Report only when a value enters or leaves [lo, hi]\n");
+    printf("  --duration <seconds>   - Stop after this long (default: until Ctrl+C)\n\n");
+
+    printf("Correlate options:\n");
+    printf("  --signal <src>         - cpu (default), thermal, power, pdh:<counter path> or sim (default with --sim)\n");
+    printf("  --window <N>           - Paired samples per coefficient (default: %d, max: %d)\n", CORRELATE_DEFAULT_WINDOW, CORRELATE_MAX_WINDOW);
+    printf("  --max-lag <N>          - Also try registers trailing the signal by up to N scans (default: 0, max: %d)\n", CORRELATE_MAX_LAG);
+    printf("  --top <N>              - Registers listed (default: %d, max: %d)\n", CORRELATE_DEFAULT_TOP, CORRELATE_MAX_TOP);
+    printf("  --duration <seconds>   - Stop after this long (default: until Ctrl+C)\n\n");
+
+    printf("Bench options:\n");
+    printf("  --scans <N>            - Full 256-register scans (default: %d)\n", BENCH_DEFAULT_SCANS);
+    printf("  --samples <N>          - Hot-loop reads and raw IOCTLs (default: %d)\n", BENCH_DEFAULT_SAMPLES);
+    printf("  --reg <reg>            - Register for the hot loop (default: 00)\n");
+    printf("  --json                 - Machine-readable output (one JSON object, same as --format json)\n\n");
     
     printf("Examples:\n");
     printf("  %s monitor             - Monitor with 5 second updates\n", programName);
     printf("  %s monitor -i 3        - Monitor with 3 second updates\n", programName);
     printf("  %s monitor -d          - Monitor showing decimal values\n", programName);
+    printf("  %s monitor --adaptive  - Monitor re-reading only changing registers\n", programName);
+    printf("  %s monitor -r 30 31 4A -i 0.2 - Watch 3 registers every 200 ms\n", programName);
     printf("  %s -r 30               - Read register 0x30\n", programName);
     printf("  %s -r 30 31 32         - Read multiple registers\n", programName);
     printf("  %s -r 30 -v            - Read with verbose debug output\n", programName);
     printf("  %s -r 30 -d            - Read register 0x30 in decimal\n", programName);
+    printf("  %s -r 30 31 --via-server - Read through a running server\n", programName);
+    printf("  %s -r 30 31 --from-shm - Read the latest published snapshot\n", programName);
+    printf("  %s -r 4A:u16le --verify - Read a 16-bit counter without tearing\n", programName);
+    printf("  %s -r fan_rpm --profile ec.txt - Read a field named in a profile\n", programName);
     printf("  %s dump                - Dump all 256 registers\n", programName);
-    printf("  %s dump -d             - Dump in decimal format\n\n", programName);
+    printf("  %s dump -d             - Dump in decimal format\n", programName);
+    printf("  %s dump --format csv > ec.csv - Dump all registers as CSV\n", programName);
+    printf("  %s -r 30 31 --format json - Read two registers as one JSON object\n", programName);
+    printf("  %s dump --channel primary --channel secondary - Dump both EC interfaces side by side\n", programName);
+    printf("  %s xdump 0A00 0AFF     - Dump one page of extended EC RAM\n", programName);
+    printf("  %s xmonitor 0 FFFF --adaptive - Browse the whole extended space, rescanning changing pages\n", programName);
+    printf("  %s record soak.ecr     - Record all registers every 5 seconds\n", programName);
+    printf("  %s record fan.ecr -r 4A 4B -i 0.5 - Record two registers every 500 ms\n", programName);
+    printf("  %s watch -r 30 4A 4B -i 0.5 - Stream changes of three registers as JSON lines\n", programName);
+    printf("  %s watch -r 30 --range 0:85 - Report when 0x30 leaves or re-enters 0..85\n", programName);
+    printf("  %s correlate -i 2 --max-lag 10 - Find registers that follow CPU load, up to 20 s behind\n", programName);
+    printf("  %s correlate --signal thermal -r 30 31 32 -i 1 - Match three registers to the ACPI thermal zone\n", programName);
+    printf("  %s analyze soak.ecr    - Summarize a capture\n", programName);
+    printf("  %s replay soak.ecr --speed 60 - Replay a capture at 60x\n", programName);
+    printf("  %s bench --json        - Benchmark with JSON output\n", programName);
+    printf("  %s bench --sim         - Benchmark the scan engine against the simulator\n", programName);
+    printf("  %s bench --burst       - Compare full scans with and without burst mode\n\n", programName);
 }
 
 int main(int argc, char* argv[]) {
@@ -673,7 +7763,26 @@ int main(int argc, char* argv[]) {
     bool verboseMode = false;
     bool showStats = false;
     bool useDecimal = false;
-    int intervalSec = 5;
+    int intervalMs = -1;    // -1 = mode default
+    int backoffSpin = 0;
+    int lockChunk = 0;          // 0 = adaptive
+    bool useSim = false;
+    SimConfig simConfig;
+    int fullEvery = 1;      // Monitor: 1 = full scan every cycle
+    bool useBurst = false;
+    bool realtime = false;      // Real-time acquisition profile
+    OutputFormat outputFormat = FORMAT_TEXT;    // dump / -r result format
+    int pinCpu = -1;            // Acquisition thread core, -1 = any
+    bool viaServer = false;
+    bool fromShm = false;
+    const char* modulePath = NULL;  // NULL = embedded LpcACPIEC module
+    XramPorts xramPorts;        // Extended RAM index/data ports
+    int budget = 0;             // EC reads/s ceiling, 0 = shared default
+    const char* profilePath = NULL; // -r field definitions
+    bool traceOnError = false;  // --trace error
+    bool traceOnExit = false;   // --trace exit
+    bool verifyFields = false;  // -r fields: high, low, high again
+    std::vector<ECChannel> channels;    // --channel port pairs, empty = 62/66 only
     
     // Parse global flags
     for (int i = 1; i < argc; i++) {
@@ -684,16 +7793,152 @@ int main(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "-d") == 0) {
             useDecimal = true;
         } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
-            intervalSec = atoi(argv[i + 1]);
-            if (intervalSec < 2) {
-                printf("Error: Minimum interval is 2 seconds\n");
+            intervalMs = (int)(atof(argv[i + 1]) * 1000.0 + 0.5);
+            if (intervalMs <= 0) {
+                printf("Error: Invalid interval '%s'\n", argv[i + 1]);
                 return 1;
             }
             i++; // Skip the interval value
+        } else if (strcmp(argv[i], "--backoff") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "auto") == 0) {
+                backoffSpin = 0;
+            } else {
+                backoffSpin = atoi(argv[i + 1]);
+                if (backoffSpin < 1) {
+                    printf("Error: --backoff expects 'auto' or a positive poll count\n");
+                    return 1;
+                }
+            }
+            i++; // Skip the backoff value
+        } else if (strcmp(argv[i], "--lock-chunk") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "auto") == 0) {
+                lockChunk = 0;
+            } else {
+                lockChunk = atoi(argv[i + 1]);
+                if (lockChunk < 1 || lockChunk > LOCK_CHUNK_MAX) {
+                    printf("Error: --lock-chunk expects 'auto' or a register count from 1 to %d\n", LOCK_CHUNK_MAX);
+                    return 1;
+                }
+            }
+            i++; // Skip the chunk size
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            if (fullEvery == 1) fullEvery = SCHED_DEFAULT_FULL_EVERY;
+        } else if (strcmp(argv[i], "--full-every") == 0 && i + 1 < argc) {
+            fullEvery = atoi(argv[i + 1]);
+            if (fullEvery < 1) {
+                printf("Error: --full-every expects a positive cycle count\n");
+                return 1;
+            }
+            i++; // Skip the cycle count
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "exit") == 0) traceOnExit = true;
+            else if (strcmp(argv[i + 1], "error") == 0) traceOnError = true;
+            else {
+                printf("Error: --trace expects exit or error\n");
+                return 1;
+            }
+            if (!ECTrace::compiled) {
+                printf("Error: This build has no trace ring (built with ECREADER_TRACE=0)\n");
+                return 1;
+            }
+            i++; // Skip the trace mode
+        } else if (strcmp(argv[i], "--burst") == 0) {
+            useBurst = true;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (!ParseOutputFormat(argv[i + 1], &outputFormat)) {
+                printf("Error: --format expects text, json, csv or raw\n");
+                return 1;
+            }
+            i++; // Skip the format name
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            budget = atoi(argv[i + 1]);
+            if (budget < 1 || budget > EC_READ_BUDGET_MAX) {
+                printf("Error: --budget expects a read rate from 1 to %d per second\n", EC_READ_BUDGET_MAX);
+                return 1;
+            }
+            i++; // Skip the budget value
+        } else if (strcmp(argv[i], "--channel") == 0 && i + 1 < argc) {
+            ECChannel channel;
+            if (!channel.Parse(argv[i + 1])) return 1;
+            for (size_t c = 0; c < channels.size(); c++) {
+                if (channels[c].SharesPort(channel)) {
+                    if (channels[c].Tag() == channel.Tag()) printf("Error: Channel %s given twice\n", channel.name);
+                    else printf("Error: --channel %s shares a port with channel %s\n", channel.name, channels[c].name);
+                    return 1;
+                }
+            }
+            if (channels.size() >= EC_CHANNELS_MAX) {
+                printf("Error: At most %d --channel options\n", EC_CHANNELS_MAX);
+                return 1;
+            }
+            channels.push_back(channel);
+            i++; // Skip the channel spec
+        } else if (strcmp(argv[i], "--xram") == 0 && i + 1 < argc) {
+            if (!xramPorts.Parse(argv[i + 1])) return 1;
+            i++; // Skip the port spec
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime = true;
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            pinCpu = atoi(argv[i + 1]);
+            if (pinCpu < 0 || pinCpu >= (int)(sizeof(DWORD_PTR) * 8)) {
+                printf("Error: --cpu expects a processor number from 0 to %d\n", (int)(sizeof(DWORD_PTR) * 8) - 1);
+                return 1;
+            }
+            i++; // Skip the processor number
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profilePath = argv[i + 1];
+            i++; // Skip the profile path
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verifyFields = true;
+        } else if (strcmp(argv[i], "--via-server") == 0) {
+            viaServer = true;
+        } else if (strcmp(argv[i], "--from-shm") == 0) {
+            fromShm = true;
+        } else if (strcmp(argv[i], "--module") == 0 && i + 1 < argc) {
+            modulePath = argv[i + 1];
+            i++; // Skip the module path
+        } else if (strcmp(argv[i], "--sim") == 0) {
+            useSim = true;
+        } else if (strcmp(argv[i], "--sim-config") == 0 && i + 1 < argc) {
+            if (!simConfig.Parse(argv[i + 1])) return 1;
+            useSim = true;
+            i++; // Skip the simulator spec
         }
     }
     
-    reader.SetVerbose(verboseMode);
+    // One reader per --channel: 'reader' takes the first, the others scan alongside it with
+    // the same settings, each with its own transport, thread and statistics
+    if (channels.empty()) channels.push_back(ECChannel());
+    bool multiChannel = (channels.size() > 1);
+    std::vector<ECReader> channelReaders(channels.size() - 1);
+    std::vector<SimulatedTransport> channelSims(channels.size() - 1);
+    std::vector<ECReader*> readers(1, &reader);
+    for (size_t c = 0; c < channelReaders.size(); c++) readers.push_back(&channelReaders[c]);
+
+    SimulatedTransport simTransport;
+    for (size_t c = 0; c < readers.size(); c++) {
+        ECReader& r = *readers[c];
+        if (useSim) {
+            // Each simulated channel is its own EC; only the first has the contending peer
+            SimulatedTransport& sim = (c == 0) ? simTransport : channelSims[c - 1];
+            SimConfig channelConfig = simConfig;
+            channelConfig.seed += c;
+            if (c > 0) channelConfig.peerMs = 0;
+            sim.Configure(channelConfig);
+            sim.SetPorts(channels[c].data, channels[c].cmd);
+            r.SetTransport(&sim);
+        }
+
+        r.SetChannel(channels[c], multiChannel);
+        r.SetVerbose(verboseMode);
+        r.SetBackoffSpin(backoffSpin);
+        r.SetLockChunk(lockChunk);
+        r.SetBurst(useBurst);
+        r.SetTraceDump(traceOnError, traceOnExit);
+        r.SetAcquisitionProfile(realtime, pinCpu < 0 ? -1 : pinCpu + (int)c);
+        r.SetBudget(budget);
+        if (modulePath != NULL) r.SetModulePath(modulePath);
+    }
     
     // Handle commands
     const char* command = argv[1];
@@ -708,14 +7953,320 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    // Open driver for all commands except help and version
-    if (!reader.Open()) {
+    if (multiChannel && pinCpu >= 0) {
+        // Each channel's acquisition thread gets its own core, or the channels would take turns
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        if (pinCpu + (int)channels.size() > (int)info.dwNumberOfProcessors) {
+            printf("Error: --cpu %d with %d channels needs processors %d-%d (this machine has %lu)\n", pinCpu,
+                   (int)channels.size(), pinCpu, pinCpu + (int)channels.size() - 1, (unsigned long)info.dwNumberOfProcessors);
+            return 1;
+        }
+    }
+    if (!channels[0].IsPrimary() && (strcmp(command, "xdump") == 0 || strcmp(command, "xmonitor") == 0)) {
+        // The extended RAM window belongs to the 62/66 EC; it needs that EC's Access_EC and budget
+        printf("Error: %s reads the primary EC's extended RAM and cannot be combined with --channel\n", command);
+        return 1;
+    }
+    if (!channels[0].IsPrimary() && (viaServer || fromShm)) {
+        printf("Error: --via-server and --from-shm read the 62/66 EC a running instance scans; drop --channel\n");
         return 1;
     }
+    if (multiChannel && strcmp(command, "dump") != 0 && strcmp(command, "monitor") != 0 && strcmp(command, "record") != 0) {
+        printf("Error: Several --channel options work with dump, monitor and record only\n");
+        return 1;
+    }
+
+    // -r entries may be typed fields (4A:u16le) or names from --profile; plain registers
+    // keep the register output below
+    FieldProfile profile;
+    std::vector<ECField> fields;
+    bool typedRead = false;
+    if (strcmp(command, "-r") == 0) {
+        if (profilePath != NULL && !profile.Load(profilePath)) return 1;
+        if (!CollectFields(argc, argv, 2, profile, fields, &typedRead)) return 1;
+        if (fields.empty()) {
+            printf("Error: No register address specified\n");
+            return 1;
+        }
+        typedRead = typedRead || verifyFields;
+        if (verifyFields && (viaServer || fromShm)) {
+            printf("Error: --verify re-reads the EC and cannot be combined with --via-server or --from-shm\n");
+            return 1;
+        }
+    }
+
+    if (typedRead && (viaServer || fromShm)) {
+        ECRegisterMask mask;
+        FieldMask(fields, mask);
+        UCHAR values[256];
+        bool valid[256];
+        ULONG64 startWall, endWall;
+        if (viaServer) {
+            startWall = WallTimeNow();
+            if (!ReadViaServer(mask, values, valid)) return 1;
+            endWall = WallTimeNow();
+        } else {
+            SharedSnapshot snapshot;
+            if (!ReadSharedSnapshot(snapshot)) return 1;
+            memcpy(values, snapshot.values, sizeof(values));
+            for (int i = 0; i < 256; i++) valid[i] = snapshot.known.Test((UCHAR)i);
+            startWall = endWall = snapshot.wallTime;
+        }
+        std::vector<ECFieldValue> results(fields.size());
+        DecodeFields(fields, values, valid, results.data());
+        return WriteFieldValues(outputFormat, fields, results.data(), startWall, endWall) ? 0 : 1;
+    }
+
+    // -r --via-server asks a running 'serve' instance instead of opening the driver
+    if (viaServer && strcmp(command, "-r") == 0) {
+        if (argc < 3) {
+            printf("Error: No register address specified\n");
+            return 1;
+        }
+        std::vector<UCHAR> regs;
+        ECRegisterMask mask;
+        CollectRegisters(argc, argv, 2, regs, mask);
+
+        UCHAR values[256];
+        bool valid[256];
+        ULONG64 startWall = WallTimeNow();
+        if (!ReadViaServer(mask, values, valid)) return 1;
+        ULONG64 endWall = WallTimeNow();
+        return WriteRegisterValues(outputFormat, regs, values, valid, startWall, endWall, useDecimal) ? 0 : 1;
+    }
+
+    // -r --from-shm copies values from the snapshot a running instance publishes
+    if (fromShm && strcmp(command, "-r") == 0) {
+        if (argc < 3) {
+            printf("Error: No register address specified\n");
+            return 1;
+        }
+        std::vector<UCHAR> regs;
+        ECRegisterMask mask;
+        CollectRegisters(argc, argv, 2, regs, mask);
+
+        SharedSnapshot snapshot;
+        if (!ReadSharedSnapshot(snapshot)) return 1;
+        if (verboseMode) {
+            printf("[Verbose] Shared scan #%llu, %.1f ms old\n", (unsigned long long)snapshot.scanSequence,
+                   (double)(QpcNow() - snapshot.scanQpc) * 1000.0 / (double)snapshot.qpcFrequency);
+        }
+
+        bool valid[256];
+        for (int i = 0; i < 256; i++) valid[i] = snapshot.known.Test((UCHAR)i);
+        return WriteRegisterValues(outputFormat, regs, snapshot.values, valid,
+                                   snapshot.wallTime, snapshot.wallTime, useDecimal) ? 0 : 1;
+    }
+
+    // Capture files are processed offline, without the driver
+    if (strcmp(command, "analyze") == 0 || strcmp(command, "replay") == 0) {
+        if (argc < 3 || argv[2][0] == '-') {
+            printf("Error: No capture file specified\n");
+            return 1;
+        }
+        if (strcmp(command, "analyze") == 0) {
+            return AnalyzeCapture(argv[2]) ? 0 : 1;
+        }
+
+        double speed = 1.0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+                speed = atof(argv[++i]);
+            }
+        }
+        if (speed <= 0) {
+            printf("Error: --speed expects a positive factor\n");
+            return 1;
+        }
+        return ReplayCapture(argv[2], speed, useDecimal) ? 0 : 1;
+    }
+
+    // Open driver for all commands except help, version and capture processing
+    for (size_t c = 0; c < readers.size(); c++) {
+        if (!readers[c]->Open()) {
+            if (multiChannel) printf("Error: Cannot open channel %s\n", channels[c].name);
+            while (c > 0) readers[--c]->Close();
+            return 1;
+        }
+    }
+
+    if (multiChannel) {
+        bool ok = RunChannels(readers, argc, argv, intervalMs, fullEvery, outputFormat, useDecimal);
+        for (size_t c = 0; c < readers.size(); c++) {
+            if (ok && showStats) readers[c]->PrintStatistics();
+            readers[c]->Close();
+        }
+        return ok ? 0 : 1;
+    }
+
+    // Results of a non-default channel say which ports they came from
+    const ECChannel* outputChannel = channels[0].IsPrimary() ? NULL : &channels[0];
     
     if (strcmp(command, "monitor") == 0) {
+        // monitor -r <reg> [reg2...] polls just a watchlist
+        std::vector<UCHAR> watchRegs;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-r") == 0) {
+                ECRegisterMask watchMask;
+                CollectRegisters(argc, argv, i + 1, watchRegs, watchMask);
+                break;
+            }
+        }
+
+        reader.suppressVerbose = true;
+        if (!ResolveScanInterval(intervalMs, (int)watchRegs.size(), reader.BudgetRate())) {
+            reader.Close();
+            return 1;
+        }
+        if (!watchRegs.empty()) {
+            reader.MonitorWatchlist(watchRegs, intervalMs, useDecimal);
+        } else {
+            reader.Monitor(intervalMs, useDecimal, fullEvery);
+        }
+    }
+    else if (strcmp(command, "record") == 0) {
+        RecordOptions record;
+        if (!record.Parse(argc, argv)) {
+            reader.Close();
+            return 1;
+        }
+
+        reader.suppressVerbose = true;
+        if (!ResolveScanInterval(intervalMs, (int)record.watchRegs.size(), reader.BudgetRate()) ||
+            !reader.Record(record.path, intervalMs, fullEvery, record.watchRegs, record.keyframeEvery, record.durationSec)) {
+            reader.Close();
+            return 1;
+        }
+    }
+    else if (strcmp(command, "watch") == 0) {
+        // watch [-r <reg> ...] [--on-change] [--threshold N] [--range lo:hi] [--duration seconds]
+        std::vector<UCHAR> watchRegs;
+        WatchPredicate predicate;
+        int durationSec = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--on-change") == 0) {
+                predicate.threshold = 1;
+            } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+                predicate.threshold = (int)strtol(argv[++i], NULL, 0);
+                if (predicate.threshold < 1 || predicate.threshold > 255) {
+                    printf("Error: --threshold expects a value from 1 to 255\n");
+                    reader.Close();
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--range") == 0 && i + 1 < argc) {
+                char* end = NULL;
+                const char* spec = argv[++i];
+                predicate.rangeLo = (int)strtol(spec, &end, 0);
+                if (end == NULL || *end != ':') end = NULL;
+                else predicate.rangeHi = (int)strtol(end + 1, &end, 0);
+                if (end == NULL || *end != '\0' || predicate.rangeLo < 0 || predicate.rangeHi > 255 ||
+                    predicate.rangeLo > predicate.rangeHi) {
+                    printf("Error: --range expects lo:hi with 0 <= lo <= hi <= 255 (e.g. 40:90 or 0x28:0x5A)\n");
+                    reader.Close();
+                    return 1;
+                }
+                predicate.useRange = true;
+            } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+                durationSec = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "-r") == 0 && watchRegs.empty()) {
+                // Registers may be followed by more options, so keep scanning
+                ECRegisterMask watchMask;
+                CollectRegisters(argc, argv, i + 1, watchRegs, watchMask);
+            }
+        }
+        if (durationSec < 0) {
+            printf("Error: --duration expects a non-negative number of seconds\n");
+            reader.Close();
+            return 1;
+        }
+
+        reader.suppressVerbose = true;
+        if (!ResolveScanInterval(intervalMs, (int)watchRegs.size(), reader.BudgetRate()) ||
+            !reader.Watch(intervalMs, fullEvery, watchRegs, predicate, durationSec)) {
+            reader.Close();
+            return 1;
+        }
+    }
+    else if (strcmp(command, "correlate") == 0) {
+        // correlate [--signal cpu|thermal|power|pdh:<path>|sim] [-r <reg> ...] [--window N] [--max-lag N] [--top N] [--duration seconds]
+        std::vector<UCHAR> watchRegs;
+        const char* signalSpec = useSim ? "sim" : "cpu";
+        int window = CORRELATE_DEFAULT_WINDOW;
+        int maxLag = 0;
+        int top = CORRELATE_DEFAULT_TOP;
+        int durationSec = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--signal") == 0 && i + 1 < argc) {
+                signalSpec = argv[++i];
+            } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+                window = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--max-lag") == 0 && i + 1 < argc) {
+                maxLag = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+                top = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+                durationSec = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "-r") == 0 && watchRegs.empty()) {
+                // Registers may be followed by more options, so keep scanning
+                ECRegisterMask watchMask;
+                CollectRegisters(argc, argv, i + 1, watchRegs, watchMask);
+            }
+        }
+        if (window < CORRELATE_MIN_PAIRS || window > CORRELATE_MAX_WINDOW) {
+            printf("Error: --window expects %d to %d scans\n", CORRELATE_MIN_PAIRS, CORRELATE_MAX_WINDOW);
+            reader.Close();
+            return 1;
+        }
+        if (maxLag < 0 || maxLag > CORRELATE_MAX_LAG) {
+            printf("Error: --max-lag expects 0 to %d scans\n", CORRELATE_MAX_LAG);
+            reader.Close();
+            return 1;
+        }
+        if (top < 1 || top > CORRELATE_MAX_TOP) {
+            printf("Error: --top expects 1 to %d\n", CORRELATE_MAX_TOP);
+            reader.Close();
+            return 1;
+        }
+        if (durationSec < 0) {
+            printf("Error: --duration expects a non-negative number of seconds\n");
+            reader.Close();
+            return 1;
+        }
+
+        PdhSignal pdhSignal;
+        SimHostSignal simSignal(&simTransport);
+        HostSignal* signal = &pdhSignal;
+        if (strcmp(signalSpec, "sim") == 0) {
+            if (!useSim) {
+                printf("Error: --signal sim needs the simulated EC (--sim)\n");
+                reader.Close();
+                return 1;
+            }
+            signal = &simSignal;
+        } else if (!pdhSignal.Configure(signalSpec)) {
+            printf("Error: --signal expects cpu, thermal, power, pdh:<counter path> or sim\n");
+            reader.Close();
+            return 1;
+        }
+
         reader.suppressVerbose = true;
-        reader.Monitor(intervalSec * 1000, useDecimal);
+        if (!ResolveScanInterval(intervalMs, (int)watchRegs.size(), reader.BudgetRate()) ||
+            !reader.Correlate(*signal, intervalMs, watchRegs, window, maxLag, top, durationSec, useDecimal)) {
+            reader.Close();
+            return 1;
+        }
+    }
+    else if (strcmp(command, "-r") == 0 && typedRead) {
+        // Typed fields, each read back to back in one Access_EC hold
+        std::vector<ECFieldValue> results(fields.size());
+        ULONG64 startWall = WallTimeNow();
+        reader.ReadFields(fields, verifyFields, results.data());
+        ULONG64 endWall = WallTimeNow();
+        if (!WriteFieldValues(outputFormat, fields, results.data(), startWall, endWall)) {
+            reader.Close();
+            return 1;
+        }
     }
     else if (strcmp(command, "-r") == 0) {
         // Read specific registers
@@ -726,37 +8277,103 @@ int main(int argc, char* argv[]) {
         }
         
         // Collect all register addresses
-        bool first = true;
-        for (int i = 2; i < argc; i++) {
-            // Skip flags
-            if (argv[i][0] == '-') {
-                if (strcmp(argv[i], "-i") == 0) i++; // Skip interval value
-                continue;
-            }
-            
-            UCHAR reg = (UCHAR)strtoul(argv[i], NULL, 16);
-            bool success;
-            UCHAR value = reader.ReadECRegister(reg, &success);
-            
-            if (success) {
-                if (!first) printf(",");
-                if (useDecimal) {
-                    printf("0x%02X:%d", reg, value);
-                } else {
-                    printf("0x%02X:%02X", reg, value);
-                }
-                first = false;
-            } else {
-                if (!first) printf(",");
-                printf("0x%02X:??", reg);
-                first = false;
-            }
+        std::vector<UCHAR> regs;
+        ECRegisterMask mask;
+        CollectRegisters(argc, argv, 2, regs, mask);
+
+        // Read them all under one mutex hold, then print in command-line order
+        UCHAR values[256];
+        bool valid[256];
+        ULONG64 startWall = WallTimeNow();
+        reader.ReadECRegisters(mask, values, valid);
+        ULONG64 endWall = WallTimeNow();
+        if (!WriteRegisterValues(outputFormat, regs, values, valid, startWall, endWall, useDecimal, outputChannel)) {
+            reader.Close();
+            return 1;
+        }
+    }
+    else if (strcmp(command, "serve") == 0) {
+        reader.suppressVerbose = true;
+        if (!reader.Serve()) {
+            reader.Close();
+            return 1;
         }
-        printf("\n");
     }
     else if (strcmp(command, "dump") == 0) {
         reader.suppressVerbose = true;
-        reader.DumpGrid(useDecimal);
+        if (outputFormat == FORMAT_TEXT) {
+            reader.DumpGrid(useDecimal);
+        } else {
+            // Machine-readable: all 256 registers in one batch, one write
+            std::vector<UCHAR> regs(256);
+            for (int i = 0; i < 256; i++) regs[i] = (UCHAR)i;
+            UCHAR values[256];
+            bool valid[256];
+            ULONG64 startWall = WallTimeNow();
+            reader.ReadECRange(0, 256, values, valid);
+            ULONG64 endWall = WallTimeNow();
+            if (!WriteRegisterValues(outputFormat, regs, values, valid, startWall, endWall, useDecimal, outputChannel)) {
+                reader.Close();
+                return 1;
+            }
+        }
+    }
+    else if (strcmp(command, "xdump") == 0 || strcmp(command, "xmonitor") == 0) {
+        // xdump|xmonitor <start> <end>: inclusive extended RAM range in hex
+        if (argc < 4 || argv[2][0] == '-' || argv[3][0] == '-') {
+            printf("Error: %s expects a start and end address, e.g. %s 0000 0FFF\n", command, command);
+            reader.Close();
+            return 1;
+        }
+        unsigned long start = strtoul(argv[2], NULL, 16);
+        unsigned long end = strtoul(argv[3], NULL, 16);
+        if (start > end || end >= XRAM_SPACE_SIZE) {
+            printf("Error: Extended RAM range must satisfy start <= end <= %04X\n", XRAM_SPACE_SIZE - 1);
+            reader.Close();
+            return 1;
+        }
+
+        reader.suppressVerbose = true;
+        bool ok;
+        if (strcmp(command, "xdump") == 0) {
+            ok = reader.ExtendedDump(xramPorts, (int)start, (int)end);
+        } else {
+            ok = ResolveScanInterval(intervalMs, 0, reader.BudgetRate()) &&
+                 reader.ExtendedMonitor(xramPorts, (int)start, (int)end, intervalMs, fullEvery, useDecimal);
+        }
+        if (!ok) {
+            reader.Close();
+            return 1;
+        }
+    }
+    else if (strcmp(command, "bench") == 0) {
+        int scans = BENCH_DEFAULT_SCANS;
+        int samples = BENCH_DEFAULT_SAMPLES;
+        UCHAR hotReg = 0x00;
+        bool json = (outputFormat == FORMAT_JSON);
+        if (outputFormat == FORMAT_CSV || outputFormat == FORMAT_RAW) {
+            printf("Error: bench supports --format text or json\n");
+            reader.Close();
+            return 1;
+        }
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--scans") == 0 && i + 1 < argc) {
+                scans = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+                samples = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--reg") == 0 && i + 1 < argc) {
+                hotReg = (UCHAR)strtoul(argv[++i], NULL, 16);
+            } else if (strcmp(argv[i], "--json") == 0) {
+                json = true;
+            }
+        }
+        if (scans < 0 || samples < 0) {
+            printf("Error: --scans and --samples must be non-negative\n");
+            reader.Close();
+            return 1;
+        }
+        reader.suppressVerbose = true;
+        reader.Bench(scans, samples, hotReg, json);
     }
     else {
         printf("Error: Unknown command '%s'\n", command);
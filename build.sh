@@ -96,13 +96,20 @@ echo "Embedding version ${VERSION}..."
 x86_64-w64-mingw32-windres version.rc -O coff -o version.o
 RESOURCE_OBJ="version.o"
 
-# Compile additional resource file if it exists (for icon)
+# Compile additional resources (icon and embedded LpcACPIEC.bin module)
 if [ -f "resource.rc" ]; then
+    if [ ! -f "LpcACPIEC.bin" ]; then
+        echo "❌ LpcACPIEC.bin not found (embedded through resource.rc)"
+        exit 1
+    fi
     echo "Compiling additional resources..."
     x86_64-w64-mingw32-windres resource.rc -O coff -o resource.o
     RESOURCE_OBJ="$RESOURCE_OBJ resource.o"
 fi
 
+# TRACE=0 ./build.sh compiles the port-level trace ring out
+TRACE_FLAG="-DECREADER_TRACE=${TRACE:-1}"
+
 x86_64-w64-mingw32-g++ \
     -o "$OUTPUT" \
     "$SOURCE" \
@@ -111,6 +118,11 @@ x86_64-w64-mingw32-g++ \
     -static-libgcc \
     -static-libstdc++ \
     -O2 \
+    $TRACE_FLAG \
+    -lwinmm \
+    -lavrt \
+    -lpdh \
+    -ladvapi32 \
     -Wall \
     -Wextra \
     -fdiagnostics-plain-output
@@ -140,11 +152,8 @@ if [ $? -eq 0 ]; then
         # Remove old zip if exists
         rm -f "./build/$ZIP_NAME"
 
-        # Copy module for quick testing
-        cp -f LpcACPIEC.bin ./build/
-
-        # Create zip with exe and dependencies
-        zip -q -j "./build/$ZIP_NAME" "$OUTPUT" LpcACPIEC.bin
+        # Create zip (the module is embedded in the exe)
+        zip -q -j "./build/$ZIP_NAME" "$OUTPUT"
 
         if [ $? -eq 0 ]; then
             ZIP_SIZE=$(ls -lh "./build/$ZIP_NAME" | awk '{print $5}')